@@ -1,2 +1,5 @@
 # Uncomment this to use bundled 3rdparty/hammer (not recommended)
 #USE_BUNDLED_HAMMER = yes
+
+# Uncomment this to make the hammer grammar the default packet decoder
+#CFLAGS += -DIX_DEFAULT_DECODER=IX_DECODER_HAMMER
@@ -2,6 +2,8 @@
 A = a
 S = so
 
+CFLAGS += -pthread
+LDFLAGS += -pthread
 CXXFLAGS += -pthread
 CXXLDFLAGS += -Wl,--enable-new-dtags
 SANITIZEFLAGS += -fsanitize=address -fsanitize=undefined
@@ -11,6 +11,10 @@ CFLAGS += $(OFLAGS) $(WFLAGS) -std=c11 -fvisibility=hidden
 CXXFLAGS += $(OFLAGS) $(WFLAGS) -std=c++11 -Wno-error=missing-field-initializers
 CFLAGS_S += -fPIC
 
+MUSE_CORE_OS_MOD = engine capture split session
+BENCHMARK_OS_MOD = engine_benchmark
+UNITTEST_OS_MOD = engine_test capture_test split_test session_test
+
 _L = -L
 _I = -I
 LIB = lib
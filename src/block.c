@@ -0,0 +1,184 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * Structure-of-arrays sample blocks.
+ *
+ * EEG and accelerometer blocks differ only in their number of channels, so
+ * everything here is written once against the block fields and instantiated
+ * for each through thin wrappers.
+ */
+
+#ifndef IX_MUSE_CORE_H_
+#include <stdint.h>
+#include "defs.h"
+#include "packet.h"
+#include "unpack.h"
+#include "block.h"
+#endif
+
+#ifndef IX_INTERNAL_H_
+#include "defs_internal.h"
+#include "unpack_internal.h"
+#endif
+
+#include <assert.h>
+#include <string.h>
+
+static void
+_init(uint32_t* cap, uint32_t* n, uint16_t* ch[], uint16_t** dropped,
+      uint8_t n_ch, uint16_t* storage, uint32_t cap_)
+{
+  uint8_t c;
+
+  *cap = cap_;
+  *n = 0;
+  for (c = 0; c < n_ch; c++) {
+    ch[c] = storage + c * cap_;
+  }
+  *dropped = storage + n_ch * cap_;
+}
+
+static inline int
+_append(uint32_t cap, uint32_t* n, uint16_t* const ch[], uint16_t* dropped,
+        uint8_t n_ch, const ix_packet* p)
+{
+  uint8_t c;
+
+  if (*n == cap) return 0;
+  for (c = 0; c < n_ch; c++) {
+    ch[c][*n] = p->samples_dropped.samples.data[c];
+  }
+  dropped[(*n)++] = p->samples_dropped.dropped;
+  return 1;
+}
+
+void
+ix_eeg_block_init(ix_eeg_block* b, uint16_t* storage, uint32_t cap)
+{ _init(&b->cap, &b->n, b->ch, &b->dropped, IX_EEG_BLOCK_CHANNELS, storage,
+        cap); }
+
+void
+ix_acc_block_init(ix_acc_block* b, uint16_t* storage, uint32_t cap)
+{ _init(&b->cap, &b->n, b->ch, &b->dropped, IX_ACC_BLOCK_CHANNELS, storage,
+        cap); }
+
+int
+ix_eeg_block_append(ix_eeg_block* b, const ix_packet* p)
+{
+  assert(p->type == IX_PAC_EEG);
+  assert(p->samples_dropped.samples.n == IX_EEG_BLOCK_CHANNELS);
+  return _append(b->cap, &b->n, b->ch, b->dropped, IX_EEG_BLOCK_CHANNELS, p);
+}
+
+int
+ix_acc_block_append(ix_acc_block* b, const ix_packet* p)
+{
+  assert(p->type == IX_PAC_ACCELEROMETER);
+  return _append(b->cap, &b->n, b->ch, b->dropped, IX_ACC_BLOCK_CHANNELS, p);
+}
+
+
+/*
+ * Route one packet. Returns 0 only if its block is full.
+ */
+static inline int
+_sink_put(ix_block_sink* sink, const ix_packet* p)
+{
+  switch (p->type) {
+  case IX_PAC_EEG:
+    if (sink->eeg) return ix_eeg_block_append(sink->eeg, p);
+    break;
+  case IX_PAC_ACCELEROMETER:
+    if (sink->acc) return ix_acc_block_append(sink->acc, p);
+    break;
+  default:
+    break;
+  }
+  if (sink->other_f) {
+    sink->other_f(p, sink->other_data);
+  }
+  return 1;
+}
+
+void
+ix_block_sink_fn(const ix_packet* p, void* sink)
+{ _sink_put(sink, p); }
+
+/*
+ * Unpack as much of a run as fits into a block. Returns the number of packets
+ * unpacked.
+ */
+static uint32_t
+_unpack_eeg4(ix_eeg_block* b, const uint8_t* buf, uint32_t len)
+{
+  uint16_t *ch[IX_EEG_BLOCK_CHANNELS];
+  uint32_t k;
+  uint8_t  c;
+
+  for (c = 0; c < IX_EEG_BLOCK_CHANNELS; c++) {
+    ch[c] = b->ch[c] + b->n;
+  }
+  k = ix_unpack_eeg4(buf, len, ch, b->cap - b->n);
+  memset(b->dropped + b->n, 0, k * sizeof *b->dropped);
+  b->n += k;
+  return k;
+}
+
+static uint32_t
+_unpack_acc(ix_acc_block* b, const uint8_t* buf, uint32_t len)
+{
+  uint16_t *ch[IX_ACC_BLOCK_CHANNELS];
+  uint32_t k;
+  uint8_t  c;
+
+  for (c = 0; c < IX_ACC_BLOCK_CHANNELS; c++) {
+    ch[c] = b->ch[c] + b->n;
+  }
+  k = ix_unpack_acc(buf, len, ch, b->cap - b->n);
+  memset(b->dropped + b->n, 0, k * sizeof *b->dropped);
+  b->n += k;
+  return k;
+}
+
+ix_parse_status
+ix_block_sink_parse(ix_block_sink* sink, const uint8_t* buf, uint32_t len,
+                    uint32_t* consumed)
+{
+  ix_parse_status ret = IX_PARSE_END;
+  ix_packet       pac;
+  uint32_t        off = 0, n, r;
+
+  while (off < len) {
+    if (sink->eeg && buf[off] == EEG4_HEADER &&
+        (r = _unpack_eeg4(sink->eeg, buf + off, len - off))) {
+      off += r * EEG4_STRIDE;
+      continue;
+    }
+    if (sink->acc && buf[off] == ACC_HEADER &&
+        (r = _unpack_acc(sink->acc, buf + off, len - off))) {
+      off += r * ACC_STRIDE;
+      continue;
+    }
+    /*
+     * Anything else, including the start of a run whose block is full or
+     * whose first packet is incomplete, takes the packet at a time path.
+     */
+    ret = ix_packet_parse_into(buf + off, len - off, &pac, 1, &n, &r);
+    if (!n) break;
+    if (!_sink_put(sink, &pac)) {
+      ret = IX_PARSE_FULL;
+      break;
+    }
+    off += r;
+    ret = IX_PARSE_END;
+  }
+  if (consumed) {
+    *consumed = off;
+  }
+  return ret;
+}
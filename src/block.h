@@ -0,0 +1,124 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * include <stdint.h> for sized ints
+ * include "defs.h" for IX_EXPORT
+ * include "packet.h" for ix_packet, ix_packet_fn, ix_parse_status
+ */
+
+/*
+ * Structure-of-arrays sample blocks.
+ *
+ * A block holds the samples of consecutive EEG or accelerometer packets with
+ * each channel in its own contiguous array, which is the layout filtering and
+ * FFT code wants. Alongside the samples, each packet's dropped samples count
+ * is kept in a parallel array, so gaps are still visible.
+ *
+ * Blocks never allocate: all arrays are supplied by the caller, either one by
+ * one or carved out of a single buffer by the _init functions.
+ */
+
+enum {
+  IX_EEG_BLOCK_CHANNELS = 4u,
+  IX_ACC_BLOCK_CHANNELS = 3u
+};
+
+/*
+ * Number of uint16_t needed for a block of cap packets with _init.
+ */
+#define IX_EEG_BLOCK_STORAGE(cap) ((IX_EEG_BLOCK_CHANNELS + 1) * (cap))
+#define IX_ACC_BLOCK_STORAGE(cap) ((IX_ACC_BLOCK_CHANNELS + 1) * (cap))
+
+/*
+ * EEG block. Packet i has sample ch[c][i] on channel c, and dropped[i]
+ * samples were dropped immediately before it. All arrays have room for cap
+ * packets, of which the first n are filled.
+ */
+typedef struct {
+  uint32_t  cap;
+  uint32_t  n;
+  uint16_t* ch[IX_EEG_BLOCK_CHANNELS];
+  uint16_t* dropped;
+} ix_eeg_block;
+
+/*
+ * Accelerometer block. Same as ix_eeg_block, with 3 channels.
+ */
+typedef struct {
+  uint32_t  cap;
+  uint32_t  n;
+  uint16_t* ch[IX_ACC_BLOCK_CHANNELS];
+  uint16_t* dropped;
+} ix_acc_block;
+
+/*
+ * Set up an empty block of cap packets, with all of its arrays in storage,
+ * which must hold IX_EEG_BLOCK_STORAGE(cap) (resp. IX_ACC_BLOCK_STORAGE(cap))
+ * values.
+ */
+IX_EXPORT
+void
+ix_eeg_block_init(ix_eeg_block* b, uint16_t* storage, uint32_t cap);
+
+IX_EXPORT
+void
+ix_acc_block_init(ix_acc_block* b, uint16_t* storage, uint32_t cap);
+
+/*
+ * Append a packet's samples to a block.
+ *
+ * Returns 1 on success, or 0 if the block is full. The packet must be of type
+ * IX_PAC_EEG (resp. IX_PAC_ACCELEROMETER). EEG blocks hold the 4-channel
+ * preset only, so EEG packets must have IX_EEG_BLOCK_CHANNELS channels.
+ */
+IX_EXPORT
+int
+ix_eeg_block_append(ix_eeg_block* b, const ix_packet* p);
+
+IX_EXPORT
+int
+ix_acc_block_append(ix_acc_block* b, const ix_packet* p);
+
+/*
+ * Packet sink that sorts samples into blocks.
+ *
+ * EEG packets go to eeg and accelerometer packets to acc. Every other packet,
+ * and EEG or accelerometer packets whose block is NULL, goes to other_f with
+ * other_data, if other_f is non-NULL.
+ */
+typedef struct {
+  ix_eeg_block* eeg;
+  ix_acc_block* acc;
+  ix_packet_fn  other_f;
+  void*         other_data;
+} ix_block_sink;
+
+/*
+ * ix_packet_fn that feeds packets to the ix_block_sink passed as user_data.
+ *
+ * Since a callback has no way to push back, samples that arrive when their
+ * block is full are lost. Prefer ix_block_sink_parse, which stops instead.
+ * As with ix_eeg_block_append, EEG packets must be from the 4-channel preset.
+ */
+IX_EXPORT
+void
+ix_block_sink_fn(const ix_packet* p, void* sink);
+
+/*
+ * Parse every packet in a buffer into a sink.
+ *
+ * Like ix_packet_parse_all with ix_block_sink_fn, but runs of EEG and
+ * accelerometer packets are unpacked straight into their blocks with
+ * ix_unpack_eeg4 and ix_unpack_acc, and the walk stops with IX_PARSE_FULL
+ * before the first packet whose block is full. Empty the block and call again
+ * from *consumed to continue. Blocks hold the 4-channel EEG preset only.
+ */
+IX_EXPORT
+ix_parse_status
+ix_block_sink_parse(ix_block_sink* sink, const uint8_t* buf, uint32_t len,
+                    uint32_t* consumed);
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+
+#ifndef IX_MUSE_CORE_H_
+#include <stdint.h>
+#include "defs.h"
+#include "packet.h"
+#include "unpack.h"
+#include "resync.h"
+#include "stats.h"
+#include "stream.h"
+#include "capture.h"
+#endif
+
+#ifndef IX_INTERNAL_H_
+#include "defs_internal.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int
+ix_capture_open(ix_capture* c, const char* path)
+{
+  struct stat st;
+  void*       p;
+  int         fd, err;
+
+  c->data = NULL;
+  c->len = 0;
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return errno;
+  if (fstat(fd, &st)) goto fail;
+  if (!S_ISREG(st.st_mode)) {
+    errno = EINVAL;
+    goto fail;
+  }
+  if ((uint64_t)st.st_size > SIZE_MAX) {
+    errno = EFBIG;
+    goto fail;
+  }
+  if (st.st_size) {
+    p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) goto fail;
+    /* Only a hint; nothing to do if it isn't taken. */
+    posix_madvise(p, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+    c->data = p;
+    c->len = (uint64_t)st.st_size;
+  }
+  close(fd);
+  return 0;
+
+fail:
+  err = errno;
+  close(fd);
+  return err;
+}
+
+void
+ix_capture_close(ix_capture* c)
+{
+  if (c->data) {
+    munmap((void*)c->data, (size_t)c->len);
+  }
+  c->data = NULL;
+  c->len = 0;
+}
+
+const uint8_t*
+ix_capture_data(const ix_capture* c)
+{ return c->data; }
+
+uint64_t
+ix_capture_len(const ix_capture* c)
+{ return c->len; }
+
+uint64_t
+ix_capture_feed(const ix_capture* c, ix_stream* s, uint64_t off, uint64_t len)
+{
+  if (off >= c->len) return 0;
+  if (len > c->len - off) len = c->len - off;
+  ix_stream_feed64(s, c->data + off, len);
+  return len;
+}
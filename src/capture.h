@@ -0,0 +1,70 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * include <stdint.h> for sized ints
+ * include "defs.h" for IX_EXPORT
+ * include "stream.h" for ix_stream
+ */
+
+/*
+ * Raw capture files.
+ *
+ * A capture file is nothing but the bytes that came off the link, in order.
+ * An ix_capture maps one read-only and parses straight out of the mapping:
+ * nothing is copied but the odd packet that straddles two pieces of a feed,
+ * and files may be any size the address space allows. The mapping is marked
+ * for sequential access, so the kernel reads ahead of the parser.
+ *
+ * POSIX only.
+ */
+
+/*
+ * Open capture file. Fields are private.
+ */
+typedef struct {
+  const uint8_t* data;
+  uint64_t       len;
+} ix_capture;
+
+/*
+ * Map the file at path. Returns 0 on success, or an errno value, in which
+ * case c is left closed.
+ */
+IX_EXPORT
+int
+ix_capture_open(ix_capture* c, const char* path);
+
+/*
+ * Unmap the file. Closing a closed capture does nothing.
+ */
+IX_EXPORT
+void
+ix_capture_close(ix_capture* c);
+
+/*
+ * Return the contents of the file, which stay valid until it is closed.
+ * NULL for an empty or closed file.
+ */
+IX_EXPORT
+const uint8_t*
+ix_capture_data(const ix_capture* c);
+
+/*
+ * Return the length of the file in bytes.
+ */
+IX_EXPORT
+uint64_t
+ix_capture_len(const ix_capture* c);
+
+/*
+ * Feed len bytes of the file starting at offset off to s. The range is
+ * clamped to the end of the file. Returns the number of bytes fed.
+ */
+IX_EXPORT
+uint64_t
+ix_capture_feed(const ix_capture* c, ix_stream* s, uint64_t off, uint64_t len);
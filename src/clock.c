@@ -0,0 +1,151 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * Sample clock reconstruction.
+ *
+ * A clock has seen a sample of a type once it has counted more samples of
+ * that type than were dropped, so it needs no flags of its own.
+ */
+
+#ifndef IX_MUSE_CORE_H_
+#include <stdint.h>
+#include "defs.h"
+#include "packet.h"
+#include "clock.h"
+#endif
+
+#ifndef IX_INTERNAL_H_
+#include "defs_internal.h"
+#endif
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+void
+ix_clock_init(ix_clock* c)
+{
+  memset(c, 0, sizeof *c);
+}
+
+/*
+ * Count one packet of samples against *next, keeping them in last, and
+ * describe any gap before them.
+ */
+static uint64_t
+_clock_samples(const ix_packet* p, uint64_t* next, uint64_t* dropped,
+               uint16_t* last, ix_clock_gap* gap)
+{
+  const ix_samples_n* s = &p->samples_dropped.samples;
+  uint16_t            n_dropped = p->samples_dropped.dropped;
+  uint8_t             i;
+
+  if (n_dropped && gap) {
+    gap->type = p->type;
+    gap->at = *next;
+    gap->len = n_dropped;
+    gap->channels = (uint8_t)s->n;
+    memcpy(gap->to, s->data, s->n * sizeof s->data[0]);
+    if (*next > *dropped) {
+      memcpy(gap->from, last, s->n * sizeof s->data[0]);
+    } else {
+      memcpy(gap->from, s->data, s->n * sizeof s->data[0]);
+    }
+  }
+  *next += n_dropped;
+  *dropped += n_dropped;
+  for (i = 0; i < s->n; ++i) {
+    last[i] = s->data[i];
+  }
+  return (*next)++;
+}
+
+uint64_t
+ix_clock_packet(ix_clock* c, const ix_packet* p, ix_clock_gap* gap)
+{
+  if (gap) {
+    gap->len = 0;
+  }
+  switch (p->type) {
+  case IX_PAC_EEG:
+    return _clock_samples(p, &c->eeg_next, &c->eeg_dropped, c->eeg_last, gap);
+  case IX_PAC_ACCELEROMETER:
+    return _clock_samples(p, &c->acc_next, &c->acc_dropped, c->acc_last, gap);
+  case IX_PAC_SYNC:
+    c->sync_at = c->eeg_next;
+    return c->eeg_next;
+  default:
+    return c->eeg_next;
+  }
+}
+
+uint64_t
+ix_clock_eeg_samples(const ix_clock* c)
+{ return c->eeg_next; }
+
+uint64_t
+ix_clock_acc_samples(const ix_clock* c)
+{ return c->acc_next; }
+
+uint64_t
+ix_clock_eeg_dropped(const ix_clock* c)
+{ return c->eeg_dropped; }
+
+uint64_t
+ix_clock_acc_dropped(const ix_clock* c)
+{ return c->acc_dropped; }
+
+uint64_t
+ix_clock_sync_at(const ix_clock* c)
+{ return c->sync_at; }
+
+/*
+ * Straight-line fill. Each value depends only on i, so the loop vectorizes.
+ */
+static void
+_fill_linear(float* out, uint16_t len, float from, float to)
+{
+  float    step = (to - from) / (float)(len + 1);
+  uint32_t i;
+
+  for (i = 0; i < len; ++i) {
+    out[i] = from + step * (float)(i + 1);
+  }
+}
+
+static void
+_fill_const(float* out, uint16_t len, float v)
+{
+  uint32_t i;
+
+  for (i = 0; i < len; ++i) {
+    out[i] = v;
+  }
+}
+
+void
+ix_clock_gap_fill(const ix_clock_gap* g, ix_fill_mode mode,
+                  float* const* out)
+{
+  uint8_t c;
+
+  assert(g->channels <= IX_PAC_MAXCHANNELS);
+  for (c = 0; c < g->channels; ++c) {
+    switch (mode) {
+    case IX_FILL_NAN:
+      _fill_const(out[c], g->len, NAN);
+      break;
+    case IX_FILL_HOLD:
+      _fill_const(out[c], g->len, (float)g->from[c]);
+      break;
+    case IX_FILL_LINEAR:
+      _fill_linear(out[c], g->len, (float)g->from[c], (float)g->to[c]);
+      break;
+    }
+  }
+}
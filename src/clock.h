@@ -0,0 +1,128 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * include <stdint.h> for sized ints
+ * include "defs.h" for IX_EXPORT
+ * include "packet.h" for ix_packet, ix_pac_type, IX_PAC_MAXCHANNELS
+ */
+
+/*
+ * Sample clock reconstruction.
+ *
+ * A clock follows the packets of one stream and gives every EEG and
+ * accelerometer sample its index in a continuous time series: the first
+ * sample of each is index 0, and each packet's dropped samples count moves
+ * the index on by that many before its own sample. EEG and accelerometer
+ * samples are counted separately, since they come at different rates.
+ *
+ * Whenever samples were dropped, the clock describes the gap, with the
+ * samples on either side of it, and ix_clock_gap_fill writes values for the
+ * missing samples into per-channel output arrays.
+ *
+ * Packets are clocked in constant time, and nothing here allocates.
+ */
+
+/*
+ * A run of dropped samples: len samples of type IX_PAC_EEG or
+ * IX_PAC_ACCELEROMETER, starting at index at. from holds the samples just
+ * before the gap and to the ones just after it, for each of channels
+ * channels. A gap before the first sample of its type has from equal to to.
+ */
+typedef struct {
+  ix_pac_type type;
+  uint64_t    at;
+  uint16_t    len;
+  uint8_t     channels;
+  uint16_t    from[IX_PAC_MAXCHANNELS];
+  uint16_t    to[IX_PAC_MAXCHANNELS];
+} ix_clock_gap;
+
+/*
+ * Sample clock. Fields are private.
+ */
+typedef struct {
+  uint64_t eeg_next;
+  uint64_t acc_next;
+  uint64_t eeg_dropped;
+  uint64_t acc_dropped;
+  uint64_t sync_at;
+  uint16_t eeg_last[IX_PAC_MAXCHANNELS];
+  uint16_t acc_last[3];
+} ix_clock;
+
+/*
+ * How ix_clock_gap_fill fills in dropped samples:
+ *
+ * IX_FILL_NAN    with NaN, to mark them as missing;
+ * IX_FILL_HOLD   with the last sample before the gap;
+ * IX_FILL_LINEAR with a straight line between the samples either side.
+ */
+typedef enum {
+  IX_FILL_NAN = 0,
+  IX_FILL_HOLD,
+  IX_FILL_LINEAR
+} ix_fill_mode;
+
+/*
+ * Start a clock at index 0, with nothing seen.
+ */
+IX_EXPORT
+void
+ix_clock_init(ix_clock* c);
+
+/*
+ * Clock the next packet of the stream.
+ *
+ * For an EEG or accelerometer packet, returns the index of its sample. For
+ * any other packet, returns the index the next EEG sample will get. If
+ * samples were dropped just before p, describes them in *gap, which may be
+ * NULL; otherwise sets gap->len to 0.
+ */
+IX_EXPORT
+uint64_t
+ix_clock_packet(ix_clock* c, const ix_packet* p, ix_clock_gap* gap);
+
+/*
+ * Return the number of EEG (resp. accelerometer) samples clocked so far,
+ * dropped samples included, i.e. the index the next one will get.
+ */
+IX_EXPORT
+uint64_t
+ix_clock_eeg_samples(const ix_clock* c);
+
+IX_EXPORT
+uint64_t
+ix_clock_acc_samples(const ix_clock* c);
+
+/*
+ * Return the total number of EEG (resp. accelerometer) samples dropped.
+ */
+IX_EXPORT
+uint64_t
+ix_clock_eeg_dropped(const ix_clock* c);
+
+IX_EXPORT
+uint64_t
+ix_clock_acc_dropped(const ix_clock* c);
+
+/*
+ * Return the index the next EEG sample had when the last sync packet
+ * arrived, or 0 if none has.
+ */
+IX_EXPORT
+uint64_t
+ix_clock_sync_at(const ix_clock* c);
+
+/*
+ * Fill in a gap: write g->len values for channel c to out[c][0] through
+ * out[c][g->len - 1], for each of the gap's channels.
+ */
+IX_EXPORT
+void
+ix_clock_gap_fill(const ix_clock_gap* g, ix_fill_mode mode,
+                  float* const* out);
@@ -0,0 +1,207 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * Serial commands.
+ *
+ * The response reader only tracks enough JSON to find where the object ends:
+ * brace depth, and whether it is inside a string, where braces don't count.
+ * It reads "rc" by scanning the kept text for the key.
+ */
+
+#ifndef IX_MUSE_CORE_H_
+#include <stdint.h>
+#include "defs.h"
+#include "command.h"
+#endif
+
+#ifndef IX_INTERNAL_H_
+#include "defs_internal.h"
+#endif
+
+#include <assert.h>
+#include <string.h>
+
+uint32_t
+ix_cmd_encode(ix_cmd cmd, uint8_t arg, uint8_t* buf, uint32_t len)
+{
+  uint8_t  tmp[IX_CMD_MAXSIZE];
+  uint32_t n = 0;
+
+  tmp[n++] = (uint8_t)cmd;
+  if (cmd == IX_CMD_PRESET) {
+    if (arg >= 100) tmp[n++] = (uint8_t)('0' + arg / 100);
+    if (arg >= 10) tmp[n++] = (uint8_t)('0' + arg / 10 % 10);
+    tmp[n++] = (uint8_t)('0' + arg % 10);
+  }
+  tmp[n++] = '\n';
+  if (n > len) return 0;
+  memcpy(buf, tmp, n);
+  return n;
+}
+
+int
+ix_cmd_has_response(ix_cmd cmd)
+{ return cmd != IX_CMD_KEEPALIVE; }
+
+void
+ix_response_init(ix_response_reader* r)
+{
+  r->len = 0;
+  r->depth = 0;
+  r->in_string = 0;
+  r->escaped = 0;
+  r->overflow = 0;
+}
+
+uint32_t
+ix_response_feed(ix_response_reader* r, const uint8_t* buf, uint32_t len,
+                 int* done)
+{
+  uint32_t i;
+  uint8_t  b;
+
+  *done = 0;
+  for (i = 0; i < len; i++) {
+    b = buf[i];
+    if (!r->depth && b != '{') continue;
+    if (r->len < IX_RESPONSE_MAXSIZE) r->buf[r->len++] = (char)b;
+    else r->overflow = 1;
+    if (r->in_string) {
+      if (r->escaped) r->escaped = 0;
+      else if (b == '\\') r->escaped = 1;
+      else if (b == '"') r->in_string = 0;
+    }
+    else if (b == '"') r->in_string = 1;
+    else if (b == '{') r->depth++;
+    else if (b == '}' && !--r->depth) {
+      *done = 1;
+      return i + 1;
+    }
+  }
+  return len;
+}
+
+int
+ix_response_rc(const ix_response_reader* r, int32_t* rc)
+{
+  const char* p;
+  const char* end = r->buf + r->len;
+  int32_t     sign, v;
+  uint32_t    digits;
+
+  if (r->overflow) return 0;
+  for (p = r->buf; end - p >= 4; p++) {
+    /* Only a key: "rc" as a value is followed by something else. */
+    if (memcmp(p, "\"rc\"", 4)) continue;
+    p += 4;
+    while (p < end && *p == ' ') p++;
+    if (p == end || *p != ':') continue;
+    p++;
+    while (p < end && *p == ' ') p++;
+    sign = 1;
+    if (p < end && *p == '-') {
+      sign = -1;
+      p++;
+    }
+    for (v = 0, digits = 0; p < end && *p >= '0' && *p <= '9'; p++) {
+      if (++digits > 9) return 0;
+      v = 10 * v + (*p - '0');
+    }
+    if (!digits) return 0;
+    *rc = sign * v;
+    return 1;
+  }
+  return 0;
+}
+
+const char*
+ix_response_text(const ix_response_reader* r, uint32_t* len)
+{
+  *len = r->len;
+  return r->buf;
+}
+
+/*
+ * Queue indices run freely and wrap at 256, a multiple of the capacity, so
+ * differences between them are counts and masking them gives slots.
+ */
+#define _SLOT(i) ((i) & (IX_CMDQ_MAXSIZE - 1))
+
+void
+ix_cmdq_init(ix_cmd_queue* q)
+{
+  ix_response_init(&q->resp);
+  q->head = q->sent = q->tail = 0;
+}
+
+int
+ix_cmdq_push(ix_cmd_queue* q, ix_cmd cmd, uint8_t arg)
+{
+  if (ix_cmdq_len(q) == IX_CMDQ_MAXSIZE || !ix_cmd_has_response(cmd)) {
+    return 0;
+  }
+  q->cmds[_SLOT(q->tail)] = (uint8_t)cmd;
+  q->args[_SLOT(q->tail)] = arg;
+  q->tail++;
+  return 1;
+}
+
+uint32_t
+ix_cmdq_flush(ix_cmd_queue* q, uint8_t* buf, uint32_t len)
+{
+  uint32_t n = 0, k;
+
+  for (; q->sent != q->tail; q->sent++) {
+    k = ix_cmd_encode((ix_cmd)q->cmds[_SLOT(q->sent)],
+                      q->args[_SLOT(q->sent)], buf + n, len - n);
+    if (!k) break;
+    n += k;
+  }
+  return n;
+}
+
+void
+ix_cmdq_resend(ix_cmd_queue* q)
+{ q->sent = q->head; }
+
+uint32_t
+ix_cmdq_feed(ix_cmd_queue* q, const uint8_t* buf, uint32_t len, int* done)
+{
+  if (!ix_cmdq_in_flight(q)) {
+    *done = 0;
+    return len;
+  }
+  return ix_response_feed(&q->resp, buf, len, done);
+}
+
+ix_cmd
+ix_cmdq_front(const ix_cmd_queue* q)
+{
+  assert(ix_cmdq_in_flight(q));
+  return (ix_cmd)q->cmds[_SLOT(q->head)];
+}
+
+const ix_response_reader*
+ix_cmdq_response(const ix_cmd_queue* q)
+{ return &q->resp; }
+
+void
+ix_cmdq_pop(ix_cmd_queue* q)
+{
+  assert(ix_cmdq_in_flight(q));
+  q->head++;
+  ix_response_init(&q->resp);
+}
+
+uint32_t
+ix_cmdq_len(const ix_cmd_queue* q)
+{ return (uint8_t)(q->tail - q->head); }
+
+uint32_t
+ix_cmdq_in_flight(const ix_cmd_queue* q)
+{ return (uint8_t)(q->sent - q->head); }
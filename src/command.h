@@ -0,0 +1,210 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * include <stdint.h> for sized ints
+ * include "defs.h" for IX_EXPORT
+ */
+
+/*
+ * Serial commands.
+ *
+ * Commands are sent to the headset as a single character, with an argument
+ * for some, and a newline. The headset answers each with a response: a flat
+ * JSON object whose "rc" member is 0 on success. Responses arrive on the same
+ * link as packets, in between them.
+ *
+ * Nothing here allocates.
+ */
+
+typedef enum {
+  IX_CMD_HALT = 'h',       /* stop sending data */
+  IX_CMD_VERSION = 'v',    /* report firmware and hardware versions */
+  IX_CMD_STATUS = 's',     /* report battery, preset and so on */
+  IX_CMD_PRESET = '%',     /* switch to preset arg, e.g. %21 */
+  IX_CMD_START = 'd',      /* start sending data */
+  IX_CMD_KEEPALIVE = 'k'   /* reset the headset's idle timer; no response */
+} ix_cmd;
+
+/*
+ * Longest command ix_cmd_encode writes.
+ */
+enum { IX_CMD_MAXSIZE = 5u };
+
+/*
+ * Longest response kept. Longer responses are still read through to their
+ * end, but count as failed.
+ */
+enum { IX_RESPONSE_MAXSIZE = 512u };
+
+/*
+ * Write a command to buf. arg is only used by IX_CMD_PRESET. Returns the
+ * number of bytes written, or 0, writing nothing, if they don't fit in len.
+ */
+IX_EXPORT
+uint32_t
+ix_cmd_encode(ix_cmd cmd, uint8_t arg, uint8_t* buf, uint32_t len);
+
+/*
+ * Return whether the headset answers cmd with a response.
+ */
+IX_EXPORT
+int
+ix_cmd_has_response(ix_cmd cmd);
+
+/*
+ * Incremental response reader. Fields are private.
+ */
+typedef struct {
+  uint32_t len;
+  uint32_t depth;
+  uint8_t  in_string;
+  uint8_t  escaped;
+  uint8_t  overflow;
+  char     buf[IX_RESPONSE_MAXSIZE];
+} ix_response_reader;
+
+/*
+ * Start reading a new response.
+ */
+IX_EXPORT
+void
+ix_response_init(ix_response_reader* r);
+
+/*
+ * Read bytes of a response.
+ *
+ * Bytes before the opening brace are skipped. Returns the number of bytes of
+ * buf read, which is less than len only if the response ended, in which case
+ * *done is set to 1; it is 0 otherwise. Once a response is done, read it with
+ * the functions below, then ix_response_init for the next one.
+ */
+IX_EXPORT
+uint32_t
+ix_response_feed(ix_response_reader* r, const uint8_t* buf, uint32_t len,
+                 int* done);
+
+/*
+ * Return the response's "rc" in *rc, and 1, or return 0 if it has none or
+ * was too long to keep.
+ */
+IX_EXPORT
+int
+ix_response_rc(const ix_response_reader* r, int32_t* rc);
+
+/*
+ * Return the text of the response read so far, and its length in *len. The
+ * text is not NUL-terminated.
+ */
+IX_EXPORT
+const char*
+ix_response_text(const ix_response_reader* r, uint32_t* len);
+
+/*
+ * Pipelined command queue.
+ *
+ * Commands are queued, then flushed onto the link together, without waiting
+ * for each one's response. The headset answers in order, so each response
+ * read belongs to the oldest command flushed and not yet answered. Commands
+ * without a response can't be matched, so go straight out with
+ * ix_cmd_encode instead.
+ */
+
+/*
+ * Most commands a queue holds, sent or not.
+ */
+enum { IX_CMDQ_MAXSIZE = 8u };
+
+/*
+ * Command queue. Fields are private.
+ */
+typedef struct {
+  ix_response_reader resp;
+  uint8_t            cmds[IX_CMDQ_MAXSIZE];
+  uint8_t            args[IX_CMDQ_MAXSIZE];
+  uint8_t            head;   /* oldest unanswered */
+  uint8_t            sent;   /* oldest not yet flushed */
+  uint8_t            tail;
+} ix_cmd_queue;
+
+/*
+ * Initialize a queue, or empty one, forgetting any commands in it.
+ */
+IX_EXPORT
+void
+ix_cmdq_init(ix_cmd_queue* q);
+
+/*
+ * Queue cmd, with arg as for ix_cmd_encode. Returns 1, or 0, queueing
+ * nothing, if the queue is full or cmd has no response.
+ */
+IX_EXPORT
+int
+ix_cmdq_push(ix_cmd_queue* q, ix_cmd cmd, uint8_t arg);
+
+/*
+ * Write as many queued commands as fit in len bytes of buf, in order, and
+ * count them as sent. Returns the number of bytes written.
+ */
+IX_EXPORT
+uint32_t
+ix_cmdq_flush(ix_cmd_queue* q, uint8_t* buf, uint32_t len);
+
+/*
+ * Count every unanswered command as not yet sent, so that the next flush
+ * sends them again, e.g. after a timeout. A response half read is kept.
+ * Should the headset answer both times, the extra responses are matched to
+ * whatever commands come after, so only resend commands that are safe to.
+ */
+IX_EXPORT
+void
+ix_cmdq_resend(ix_cmd_queue* q);
+
+/*
+ * Read response bytes, as ix_response_feed, for the oldest command sent and
+ * not yet answered. With none, all of buf is skipped. Once *done is set,
+ * read the response with ix_cmdq_front and ix_cmdq_response, then
+ * ix_cmdq_pop it.
+ */
+IX_EXPORT
+uint32_t
+ix_cmdq_feed(ix_cmd_queue* q, const uint8_t* buf, uint32_t len, int* done);
+
+/*
+ * Return the oldest command sent and not yet answered. There must be one.
+ */
+IX_EXPORT
+ix_cmd
+ix_cmdq_front(const ix_cmd_queue* q);
+
+/*
+ * Return the response read so far to the front command.
+ */
+IX_EXPORT
+const ix_response_reader*
+ix_cmdq_response(const ix_cmd_queue* q);
+
+/*
+ * Drop the front command and its response.
+ */
+IX_EXPORT
+void
+ix_cmdq_pop(ix_cmd_queue* q);
+
+/*
+ * Return the number of commands queued and not yet answered, sent or not.
+ */
+IX_EXPORT
+uint32_t
+ix_cmdq_len(const ix_cmd_queue* q);
+
+/*
+ * Return the number of commands sent and not yet answered.
+ */
+IX_EXPORT
+uint32_t
+ix_cmdq_in_flight(const ix_cmd_queue* q);
@@ -0,0 +1,303 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * Connection state machine.
+ *
+ * k_next says which state each event leads to, k_cmds which commands each
+ * state queues when entered, and k_wait how long each waits for them to be
+ * answered; everything else a state does on entry is in _enter. Entering a
+ * state again, e.g. IX_CONN_HALTING on a second link up, starts it over.
+ *
+ * The states from IX_CONN_VERSION to IX_CONN_STATUS queue nothing: their
+ * commands went out with IX_CMD_HALT, and each just waits for the next
+ * response in the queue. IX_CONN_STREAMING keeps the queue too, in case the
+ * response to IX_CMD_START comes after the first packet. Every other state
+ * starts with an empty queue, so a response still owed to a state that was
+ * left is never taken for one to its own commands.
+ *
+ * Responses are picked out of the stream's corrupt callback. The skipped
+ * bytes are either in the buffer being fed, or, when the stream gives up on
+ * a packet it had carried over from the last one, at the front of its
+ * carry-over. Like any corruption, a response can cost the packets right
+ * after it while the stream resyncs, but responses mostly come while the
+ * headset is halted.
+ */
+
+#ifndef IX_MUSE_CORE_H_
+#include <stdint.h>
+#include "defs.h"
+#include "packet.h"
+#include "unpack.h"
+#include "resync.h"
+#include "stats.h"
+#include "stream.h"
+#include "command.h"
+#include "conn.h"
+#endif
+
+#ifndef IX_INTERNAL_H_
+#include "defs_internal.h"
+#endif
+
+#include <assert.h>
+#include <stddef.h>
+
+enum {
+  DN = IX_CONN_DOWN,
+  HT = IX_CONN_HALTING,
+  VR = IX_CONN_VERSION,
+  PR = IX_CONN_PRESET,
+  ST = IX_CONN_STATUS,
+  RD = IX_CONN_READY,
+  SG = IX_CONN_STARTING,
+  SM = IX_CONN_STREAMING,
+  SP = IX_CONN_STOPPING,
+  FL = IX_CONN_FAILED,
+  NO = IX_CONN_N_STATES  /* stay put */
+};
+
+static const uint8_t
+k_next[IX_CONN_N_STATES][IX_CONN_N_EVENTS] = {
+  /*            up  down  ok  error timeout packet start stop */
+  [DN] =      { HT, NO,   NO, NO,   NO,     NO,    NO,   NO },
+  [HT] =      { HT, DN,   VR, FL,   FL,     NO,    NO,   NO },
+  [VR] =      { HT, DN,   PR, FL,   FL,     NO,    NO,   NO },
+  [PR] =      { HT, DN,   ST, FL,   FL,     NO,    NO,   NO },
+  [ST] =      { HT, DN,   RD, FL,   FL,     NO,    NO,   NO },
+  [RD] =      { HT, DN,   NO, NO,   NO,     NO,    SG,   NO },
+  [SG] =      { HT, DN,   NO, NO,   FL,     SM,    NO,   SP },
+  [SM] =      { HT, DN,   NO, NO,   SG,     NO,    NO,   SP },
+  [SP] =      { HT, DN,   RD, FL,   FL,     NO,    NO,   NO },
+  [FL] =      { HT, DN,   NO, NO,   NO,     NO,    NO,   NO }
+};
+
+/*
+ * Commands queued on entry, as a string of ix_cmd, or NULL to keep the queue
+ * as it is.
+ */
+static const char*
+k_cmds[IX_CONN_N_STATES] = {
+  [DN] = "",
+  [HT] = "hv%s",
+  [RD] = "",
+  [SG] = "d",
+  [SM] = NULL,
+  [SP] = "h",
+  [FL] = ""
+};
+
+/*
+ * How long each state waits for a response, or data, before it retries or
+ * times out, or 0 for as long as it takes.
+ */
+static const uint16_t
+k_wait[IX_CONN_N_STATES] = {
+  [HT] = IX_CONN_RESPONSE_MS,
+  [VR] = IX_CONN_RESPONSE_MS,
+  [PR] = IX_CONN_RESPONSE_MS,
+  [ST] = IX_CONN_RESPONSE_MS,
+  [SG] = IX_CONN_DATA_MS,
+  [SM] = IX_CONN_DATA_MS,
+  [SP] = IX_CONN_RESPONSE_MS
+};
+
+static const char*
+k_names[IX_CONN_N_STATES] = {
+  [DN] = "down",
+  [HT] = "halting",
+  [VR] = "version",
+  [PR] = "preset",
+  [ST] = "status",
+  [RD] = "ready",
+  [SG] = "starting",
+  [SM] = "streaming",
+  [SP] = "stopping",
+  [FL] = "failed"
+};
+
+static void
+_send(ix_conn* c, ix_cmd cmd)
+{
+  uint8_t  buf[IX_CMD_MAXSIZE];
+  uint32_t n = ix_cmd_encode(cmd, c->preset, buf, sizeof buf);
+
+  assert(n);
+  c->send_f(buf, n, c->user_data);
+}
+
+/*
+ * Send everything queued, in one write.
+ */
+static void
+_flush(ix_conn* c)
+{
+  uint8_t  buf[IX_CMDQ_MAXSIZE * IX_CMD_MAXSIZE];
+  uint32_t n = ix_cmdq_flush(&c->cmdq, buf, sizeof buf);
+
+  if (n) c->send_f(buf, n, c->user_data);
+}
+
+static void
+_enter(ix_conn* c, ix_conn_state s)
+{
+  const char* cmd = k_cmds[s];
+
+  c->state = s;
+  c->tries = 0;
+  c->deadline = c->now + k_wait[s];
+  if (cmd) {
+    ix_cmdq_init(&c->cmdq);
+    for (; *cmd; cmd++) {
+      ix_cmdq_push(&c->cmdq, (ix_cmd)*cmd, c->preset);
+    }
+    _flush(c);
+  }
+  switch (s) {
+  case IX_CONN_DOWN:
+    ix_stream_reset(&c->stream);
+    break;
+  case IX_CONN_STREAMING:
+    c->keepalive = c->now + IX_CONN_KEEPALIVE_MS;
+    break;
+  default:
+    break;
+  }
+}
+
+/*
+ * Send again whatever is unanswered. Data is the answer IX_CONN_STARTING
+ * waits for, so it sends IX_CMD_START again whether it was answered or not.
+ */
+static void
+_retry(ix_conn* c)
+{
+  if (c->state == IX_CONN_STARTING) {
+    ix_cmdq_init(&c->cmdq);
+    ix_cmdq_push(&c->cmdq, IX_CMD_START, 0);
+  }
+  else ix_cmdq_resend(&c->cmdq);
+  _flush(c);
+  c->deadline = c->now + k_wait[c->state];
+}
+
+static void
+_pac_f(const ix_packet* p, void* user_data)
+{
+  ix_conn* c = user_data;
+
+  if (c->state == IX_CONN_STREAMING) {
+    c->deadline = c->now + IX_CONN_DATA_MS;
+  }
+  else ix_conn_handle(c, IX_CONN_PACKET, c->now);
+  if (c->pac_f) c->pac_f(p, c->user_data);
+}
+
+static void
+_response(ix_conn* c)
+{
+  const ix_response_reader* r = ix_cmdq_response(&c->cmdq);
+  int32_t                   rc;
+  int                       ok = ix_response_rc(r, &rc) && rc == 0;
+
+  if (c->resp_f) c->resp_f(ix_cmdq_front(&c->cmdq), r, c->user_data);
+  ix_cmdq_pop(&c->cmdq);
+  ix_conn_handle(c, ok ? IX_CONN_OK : IX_CONN_ERROR, c->now);
+}
+
+static void
+_corrupt_f(uint64_t offset, uint32_t skipped, void* user_data)
+{
+  ix_conn*       c = user_data;
+  const uint8_t* b;
+  uint32_t       used;
+  int            done;
+
+  if (offset >= c->in_pos) b = c->in + (offset - c->in_pos);
+  else b = c->stream.carry;
+  while (skipped) {
+    used = ix_cmdq_feed(&c->cmdq, b, skipped, &done);
+    b += used;
+    skipped -= used;
+    if (!done) break;
+    _response(c);
+  }
+}
+
+void
+ix_conn_init(ix_conn* c, uint8_t preset, const ix_packet_format* fmt,
+             ix_conn_send_fn send_f, ix_packet_fn pac_f, void* user_data)
+{
+  assert(send_f);
+  ix_stream_init(&c->stream, _pac_f, _corrupt_f, c);
+  ix_stream_set_format(&c->stream, fmt);
+  ix_cmdq_init(&c->cmdq);
+  c->send_f = send_f;
+  c->pac_f = pac_f;
+  c->resp_f = NULL;
+  c->user_data = user_data;
+  c->in = NULL;
+  c->in_pos = 0;
+  c->now = 0;
+  c->deadline = 0;
+  c->keepalive = 0;
+  c->state = IX_CONN_DOWN;
+  c->preset = preset;
+  c->tries = 0;
+}
+
+void
+ix_conn_set_response_fn(ix_conn* c, ix_conn_response_fn resp_f)
+{ c->resp_f = resp_f; }
+
+ix_conn_state
+ix_conn_handle(ix_conn* c, ix_conn_event ev, uint64_t now)
+{
+  uint8_t next;
+
+  assert(ev < IX_CONN_N_EVENTS);
+  c->now = now;
+  next = k_next[c->state][ev];
+  if (next != NO) _enter(c, (ix_conn_state)next);
+  return c->state;
+}
+
+ix_conn_state
+ix_conn_feed(ix_conn* c, const uint8_t* buf, uint32_t len, uint64_t now)
+{
+  c->now = now;
+  c->in = buf;
+  c->in_pos = ix_stream_offset(&c->stream);
+  ix_stream_feed(&c->stream, buf, len);
+  c->in = NULL;
+  return ix_conn_tick(c, now);
+}
+
+ix_conn_state
+ix_conn_tick(ix_conn* c, uint64_t now)
+{
+  c->now = now;
+  if (c->state == IX_CONN_STREAMING && now >= c->keepalive) {
+    _send(c, IX_CMD_KEEPALIVE);
+    c->keepalive = now + IX_CONN_KEEPALIVE_MS;
+  }
+  if (!k_wait[c->state] || now < c->deadline) return c->state;
+  if (c->state != IX_CONN_STREAMING && ++c->tries < IX_CONN_TRIES) _retry(c);
+  else ix_conn_handle(c, IX_CONN_TIMEOUT, now);
+  return c->state;
+}
+
+ix_conn_state
+ix_conn_get_state(const ix_conn* c)
+{ return c->state; }
+
+const char*
+ix_conn_state_name(ix_conn_state state)
+{
+  assert(state < IX_CONN_N_STATES);
+  return k_names[state];
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * include <stdint.h> for sized ints
+ * include "defs.h" for IX_EXPORT
+ * include "packet.h" for ix_packet_fn, ix_packet_format
+ * include "stream.h" for ix_stream
+ * include "command.h" for ix_cmd, ix_cmd_queue, ix_response_reader
+ */
+
+/*
+ * Connection state machine.
+ *
+ * A connection follows one headset from the moment its link comes up: it
+ * halts whatever the headset was doing, asks for its version, sets its
+ * preset and reads its status, then waits to be told to start. Once
+ * started, it keeps the headset awake and watches that data keeps coming,
+ * and restarts it if it stops.
+ *
+ * Everything that arrives on the link goes through ix_conn_feed, which parses
+ * packets with an ix_stream and picks command responses out of what the
+ * stream skips, since no response byte can start a packet. Commands go out
+ * through a send callback, pipelined with an ix_cmd_queue: the whole
+ * configuration sequence is sent in one write, so configuring costs one
+ * round trip on the link rather than one per command. Time is whatever the
+ * caller says it is, in milliseconds, so timeouts only fire from
+ * ix_conn_feed and ix_conn_tick.
+ *
+ * Every transition is one table lookup. A connection is a fixed-size struct
+ * and never allocates or starts threads, so one thread can drive thousands.
+ */
+
+/*
+ * Connection states. IX_CONN_HALTING sends IX_CMD_HALT, IX_CMD_VERSION,
+ * IX_CMD_PRESET and IX_CMD_STATUS together on entry, and each state from it
+ * to IX_CONN_STATUS waits for the response to its command. IX_CONN_STOPPING
+ * sends IX_CMD_HALT and waits for its response; IX_CONN_STARTING sends
+ * IX_CMD_START and waits for data.
+ */
+typedef enum {
+  IX_CONN_DOWN = 0,    /* no link */
+  IX_CONN_HALTING,     /* sent IX_CMD_HALT */
+  IX_CONN_VERSION,     /* sent IX_CMD_VERSION */
+  IX_CONN_PRESET,      /* sent IX_CMD_PRESET */
+  IX_CONN_STATUS,      /* sent IX_CMD_STATUS */
+  IX_CONN_READY,       /* configured and idle */
+  IX_CONN_STARTING,    /* sent IX_CMD_START */
+  IX_CONN_STREAMING,   /* data is arriving */
+  IX_CONN_STOPPING,    /* sent IX_CMD_HALT while streaming */
+  IX_CONN_FAILED,      /* gave up until the link comes up again */
+  IX_CONN_N_STATES
+} ix_conn_state;
+
+/*
+ * Connection events. The caller reports link changes and asks for data to
+ * start or stop; responses, packets and timeouts come from the connection
+ * itself.
+ */
+typedef enum {
+  IX_CONN_LINK_UP = 0,
+  IX_CONN_LINK_DOWN,
+  IX_CONN_OK,          /* a response with rc 0 */
+  IX_CONN_ERROR,       /* any other response */
+  IX_CONN_TIMEOUT,     /* no response after all retries, or no data */
+  IX_CONN_PACKET,
+  IX_CONN_START,
+  IX_CONN_STOP,
+  IX_CONN_N_EVENTS
+} ix_conn_event;
+
+/*
+ * Timing, in milliseconds. A command is sent up to IX_CONN_TRIES times,
+ * IX_CONN_RESPONSE_MS apart, before it times out; each retry sends every
+ * command still unanswered.
+ */
+enum {
+  IX_CONN_RESPONSE_MS = 1000u,
+  IX_CONN_TRIES = 3u,
+  IX_CONN_DATA_MS = 2000u,       /* longest wait for data */
+  IX_CONN_KEEPALIVE_MS = 5000u   /* time between keepalives */
+};
+
+/*
+ * Send callback function type: write len bytes of buf to the link. Must not
+ * call back into the connection.
+ */
+typedef void (*ix_conn_send_fn)(const uint8_t* buf, uint32_t len,
+                                void* user_data);
+
+/*
+ * Response callback function type. Called with every response to a command,
+ * before it is acted on, e.g. to read the versions the headset reports.
+ */
+typedef void (*ix_conn_response_fn)(ix_cmd cmd, const ix_response_reader* r,
+                                    void* user_data);
+
+/*
+ * Connection. Fields are private.
+ */
+typedef struct {
+  ix_stream           stream;
+  ix_cmd_queue        cmdq;
+  ix_conn_send_fn     send_f;
+  ix_packet_fn        pac_f;
+  ix_conn_response_fn resp_f;
+  void*               user_data;
+  const uint8_t*      in;       /* the buffer being fed */
+  uint64_t            in_pos;   /* its stream offset */
+  uint64_t            now;
+  uint64_t            deadline;
+  uint64_t            keepalive;
+  ix_conn_state       state;
+  uint8_t             preset;
+  uint8_t             tries;
+} ix_conn;
+
+/*
+ * Initialize a connection, with its link down, for a headset to be set to
+ * the given preset, which sends packets of format fmt. send_f is called with
+ * every command and pac_f, which may be NULL, with every packet; both get
+ * user_data.
+ */
+IX_EXPORT
+void
+ix_conn_init(ix_conn* c, uint8_t preset, const ix_packet_format* fmt,
+             ix_conn_send_fn send_f, ix_packet_fn pac_f, void* user_data);
+
+/*
+ * Set a callback for responses, or NULL for none, the default.
+ */
+IX_EXPORT
+void
+ix_conn_set_response_fn(ix_conn* c, ix_conn_response_fn resp_f);
+
+/*
+ * Handle an event at time now. Returns the new state.
+ */
+IX_EXPORT
+ix_conn_state
+ix_conn_handle(ix_conn* c, ix_conn_event ev, uint64_t now);
+
+/*
+ * Feed bytes from the link, received at time now. Returns the new state.
+ */
+IX_EXPORT
+ix_conn_state
+ix_conn_feed(ix_conn* c, const uint8_t* buf, uint32_t len, uint64_t now);
+
+/*
+ * Fire whatever retries, keepalives and timeouts are due by now. Call at
+ * least every few hundred milliseconds. Returns the new state.
+ */
+IX_EXPORT
+ix_conn_state
+ix_conn_tick(ix_conn* c, uint64_t now);
+
+/*
+ * Return the current state.
+ */
+IX_EXPORT
+ix_conn_state
+ix_conn_get_state(const ix_conn* c);
+
+/*
+ * Return the name of a state, e.g. "streaming", for logging.
+ */
+IX_EXPORT
+const char*
+ix_conn_state_name(ix_conn_state state);
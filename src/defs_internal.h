@@ -8,20 +8,59 @@
 
 #define IX_UNUSED(x) ((void)x)
 
+/*
+ * IX_LOAD_ACQUIRE, IX_STORE_RELEASE and IX_CAS are atomic on aligned uint32_t
+ * only. IX_CAS(p, old, new) sets *p to new if it was old, returns whether it
+ * did, and is a full barrier either way.
+ * IX_LOAD_RELAXED and IX_COUNT work on aligned uint64_t statistics counters;
+ * IX_COUNT is a plain load and store, not a read-modify-write, and so only
+ * safe from the counter's one writer.
+ */
+
 #if defined _MSC_VER
 
+#include <intrin.h>
+
 #define IX_CCALL __cdecl
-#pragma section(".CRT$XCU",read)
-#define IX_INITIALIZER(f) \
-  static void __cdecl f(void); \
-  __declspec(allocate(".CRT$XCU")) void (__cdecl*f##_)(void) = f; \
-  static void __cdecl f(void)
+/* Volatile accesses are acquire loads and release stores under /volatile:ms. */
+#define IX_LOAD_ACQUIRE(p) (*(volatile const uint32_t*)(p))
+#define IX_STORE_RELEASE(p, v) (*(volatile uint32_t*)(p) = (v))
+#define IX_CAS(p, old, new) \
+  (_InterlockedCompareExchange((volatile long*)(p), (long)(new), \
+                               (long)(old)) == (long)(old))
+#define IX_LOAD_RELAXED(p) (*(volatile const uint64_t*)(p))
+#define _IX_COUNT(p, n) (*(volatile uint64_t*)(p) += (n))
 
 #elif defined __GNUC__
 
 #define IX_CCALL
-#define IX_INITIALIZER(f) \
-  static void f(void) __attribute__((constructor)); \
-  static void f()
+#define IX_LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define IX_STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define IX_CAS(p, old, new) __sync_bool_compare_and_swap((p), (old), (new))
+#define IX_LOAD_RELAXED(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define _IX_COUNT(p, n) \
+  __atomic_store_n((p), __atomic_load_n((p), __ATOMIC_RELAXED) + (n), \
+                   __ATOMIC_RELAXED)
+
+#endif
+
+#ifdef IX_NO_STATS
+#define IX_COUNT(p, n) ((void)0)
+#else
+#define IX_COUNT(p, n) _IX_COUNT(p, n)
+#endif
 
+/*
+ * Static tracepoints, in provider muse_core. Built with -DIX_TRACE, they are
+ * USDT probes from <sys/sdt.h> (systemtap-sdt-dev on Debian), which perf and
+ * bpftrace can attach to and which cost a nop each when nothing is attached.
+ * Otherwise they compile to nothing at all.
+ */
+#ifdef IX_TRACE
+#include <sys/sdt.h>
+#define IX_PROBE2(n, a, b) DTRACE_PROBE2(muse_core, n, a, b)
+#define IX_PROBE3(n, a, b, c) DTRACE_PROBE3(muse_core, n, a, b, c)
+#else
+#define IX_PROBE2(n, a, b) ((void)0)
+#define IX_PROBE3(n, a, b, c) ((void)0)
 #endif
@@ -0,0 +1,178 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * Packet encoding.
+ *
+ * The layouts mirror the table decoder in packet.c: a type nibble with flags
+ * in the low nibble, an optional big-endian dropped samples count, and then
+ * either 10-bit samples bit-packed least significant bit first, or fixed
+ * fields.
+ */
+
+#ifndef IX_MUSE_CORE_H_
+#include <stdint.h>
+#include "defs.h"
+#include "packet.h"
+#include "encode.h"
+#endif
+
+#ifndef IX_INTERNAL_H_
+#include "defs_internal.h"
+#endif
+
+#include <string.h>
+
+enum {
+  _DROPPED_FLAG = 0x8,
+  _MAX_SAMPLE = 0x3ff
+};
+
+static inline void
+_be16(uint8_t* b, uint16_t v)
+{
+  b[0] = (uint8_t)(v >> 8);
+  b[1] = (uint8_t)v;
+}
+
+/*
+ * Write the header byte and dropped samples count. Returns its length.
+ */
+static inline uint32_t
+_header(uint8_t* buf, uint8_t type, uint16_t dropped)
+{
+  if (!dropped) {
+    buf[0] = type << 4;
+    return 1;
+  }
+  buf[0] = type << 4 | _DROPPED_FLAG;
+  _be16(buf + 1, dropped);
+  return 3;
+}
+
+static inline uint32_t
+_samples_len(uint8_t n)
+{ return (10u * n + 7) / 8; }
+
+/*
+ * Bit-pack n samples into buf. Returns 0 if any is out of range.
+ */
+static inline int
+_pack(uint8_t* buf, const uint16_t* s, uint8_t n)
+{
+  uint32_t acc = 0, bits = 0;
+  uint8_t  i;
+
+  for (i = 0; i < n; i++) {
+    if (s[i] > _MAX_SAMPLE) return 0;
+  }
+  for (i = 0; i < n; i++) {
+    acc |= (uint32_t)s[i] << bits;
+    for (bits += 10; bits >= 8; bits -= 8, acc >>= 8) {
+      *buf++ = (uint8_t)acc;
+    }
+  }
+  if (bits) *buf = (uint8_t)acc;
+  return 1;
+}
+
+static uint32_t
+_encode_samples(uint8_t* buf, uint32_t len, uint8_t type,
+                const uint16_t* s, uint8_t n, uint16_t dropped)
+{
+  uint32_t need = (dropped ? 3 : 1) + _samples_len(n), off;
+  uint8_t  packed[IX_PAC_MAXCHANNELS * 10 / 8 + 1];
+
+  if (len < need || !_pack(packed, s, n)) return 0;
+  off = _header(buf, type, dropped);
+  memcpy(buf + off, packed, _samples_len(n));
+  return need;
+}
+
+uint32_t
+ix_encode_sync(uint8_t* buf, uint32_t len)
+{
+  if (len < 4) return 0;
+  buf[0] = 0xff;
+  buf[1] = 0xff;
+  buf[2] = 0xaa;
+  buf[3] = 0x55;
+  return 4;
+}
+
+uint32_t
+ix_encode_error(uint8_t* buf, uint32_t len, uint32_t error)
+{
+  uint8_t i;
+
+  if (len < 5) return 0;
+  buf[0] = 0xd0;
+  for (i = 0; i < 4; i++) {
+    buf[1 + i] = (uint8_t)(error >> 8 * i);
+  }
+  return 5;
+}
+
+uint32_t
+ix_encode_battery(uint8_t* buf, uint32_t len, uint16_t percent,
+                  uint16_t fuel_gauge_mv, uint16_t adc_mv, int16_t temp_c)
+{
+  if (len < 9) return 0;
+  buf[0] = 0xb0;
+  _be16(buf + 1, percent);
+  _be16(buf + 3, fuel_gauge_mv);
+  _be16(buf + 5, adc_mv);
+  _be16(buf + 7, (uint16_t)temp_c);
+  return 9;
+}
+
+uint32_t
+ix_encode_drlref(uint8_t* buf, uint32_t len, uint16_t drl, uint16_t ref)
+{
+  uint16_t s[2];
+
+  s[0] = drl;
+  s[1] = ref;
+  return _encode_samples(buf, len, 0x9, s, 2, 0);
+}
+
+uint32_t
+ix_encode_acc(uint8_t* buf, uint32_t len, const uint16_t samples[3],
+              uint16_t dropped)
+{ return _encode_samples(buf, len, 0xa, samples, 3, dropped); }
+
+uint32_t
+ix_encode_eeg(uint8_t* buf, uint32_t len, const uint16_t* samples,
+              uint8_t channels, uint16_t dropped)
+{
+  if (!ix_packet_format_eeg(channels)) return 0;
+  return _encode_samples(buf, len, 0xe, samples, channels, dropped);
+}
+
+uint32_t
+ix_packet_encode(const ix_packet* p, uint8_t* buf, uint32_t len)
+{
+  const uint16_t* s = p->samples_dropped.samples.data;
+
+  switch (p->type) {
+  case IX_PAC_SYNC:
+    return ix_encode_sync(buf, len);
+  case IX_PAC_ERROR:
+    return ix_encode_error(buf, len, p->error);
+  case IX_PAC_BATTERY:
+    return ix_encode_battery(buf, len, s[0], s[1], s[2], (int16_t)s[3]);
+  case IX_PAC_DRLREF:
+    return ix_encode_drlref(buf, len, s[0], s[1]);
+  case IX_PAC_ACCELEROMETER:
+    return ix_encode_acc(buf, len, s, p->samples_dropped.dropped);
+  case IX_PAC_EEG:
+    return ix_encode_eeg(buf, len, s, (uint8_t)p->samples_dropped.samples.n,
+                         p->samples_dropped.dropped);
+  default:
+    return 0;
+  }
+}
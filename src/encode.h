@@ -0,0 +1,64 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * include <stdint.h> for sized ints
+ * include "defs.h" for IX_EXPORT
+ * include "packet.h" for ix_packet
+ */
+
+/*
+ * Packet encoding.
+ *
+ * The inverse of ix_packet_parse: each function writes one packet in wire
+ * format to the start of buf and returns its length, or returns 0 and writes
+ * nothing if the packet doesn't fit in len bytes or can't be sent, e.g.
+ * because a sample is over 1023. IX_PAC_MAXSIZE bytes are always enough.
+ * Parsing what is written gives back exactly the packet encoded.
+ *
+ * Nothing here allocates.
+ */
+
+IX_EXPORT
+uint32_t
+ix_encode_sync(uint8_t* buf, uint32_t len);
+
+IX_EXPORT
+uint32_t
+ix_encode_error(uint8_t* buf, uint32_t len, uint32_t error);
+
+IX_EXPORT
+uint32_t
+ix_encode_battery(uint8_t* buf, uint32_t len, uint16_t percent,
+                  uint16_t fuel_gauge_mv, uint16_t adc_mv, int16_t temp_c);
+
+IX_EXPORT
+uint32_t
+ix_encode_drlref(uint8_t* buf, uint32_t len, uint16_t drl, uint16_t ref);
+
+/*
+ * Sample packets. dropped is the number of samples dropped since the last
+ * packet of the same type; the count is left off the packet if it is 0.
+ * ix_encode_eeg takes 2, 4 or 6 channels, as set by the headset's preset.
+ */
+IX_EXPORT
+uint32_t
+ix_encode_acc(uint8_t* buf, uint32_t len, const uint16_t samples[3],
+              uint16_t dropped);
+
+IX_EXPORT
+uint32_t
+ix_encode_eeg(uint8_t* buf, uint32_t len, const uint16_t* samples,
+              uint8_t channels, uint16_t dropped);
+
+/*
+ * Encode a packet as parsed, e.g. to replay a stream. EEG packets are
+ * encoded with as many channels as they have.
+ */
+IX_EXPORT
+uint32_t
+ix_packet_encode(const ix_packet* p, uint8_t* buf, uint32_t len);
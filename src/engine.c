@@ -0,0 +1,414 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * Multi-stream parsing engine.
+ *
+ * Each worker has a deque of streams that have input waiting. Feeding an idle
+ * stream queues it on its home worker, the last worker that ran it. A worker
+ * takes streams from the front of its own deque, and when that is empty steals
+ * from the back of the others'; the stream's home moves with it.
+ *
+ * A stream is in at most one deque at a time and is only ever run by the
+ * worker that took it out, so no two workers touch the same ix_stream. The
+ * stream lock only guards the ring buffer indices and the state, never the
+ * parse itself: feeding appends behind the bytes being parsed, so the two
+ * never overlap.
+ *
+ * A worker parses at most one buffer's worth of a stream before putting it at
+ * the back of its deque again, so one busy stream can't starve the rest.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#ifndef IX_MUSE_CORE_H_
+#include <stdint.h>
+#include "defs.h"
+#include "packet.h"
+#include "unpack.h"
+#include "resync.h"
+#include "stats.h"
+#include "stream.h"
+#include "engine.h"
+#endif
+
+#ifndef IX_INTERNAL_H_
+#include "defs_internal.h"
+#endif
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef enum {
+  _IDLE = 0,  /* no input, in no deque */
+  _QUEUED,    /* input waiting, in exactly one deque */
+  _RUNNING    /* being parsed by a worker */
+} _stream_state;
+
+struct _ix_engine_stream {
+  ix_engine*      e;
+  pthread_mutex_t lock;
+  ix_stream       parser;
+  uint8_t*        buf;
+  uint32_t        head;  /* ring buffer holds [head, head + len) mod size */
+  uint32_t        len;
+  _stream_state   state;
+  uint32_t        home;
+};
+
+typedef struct {
+  ix_engine*         e;
+  uint32_t           id;
+  pthread_t          thread;
+  pthread_mutex_t    lock;
+  ix_engine_stream** q;     /* deque of max_streams entries */
+  uint32_t           front;
+  uint32_t           n;
+} _worker;
+
+struct _ix_engine {
+  _worker*          workers;
+  uint32_t          n_workers;
+  uint32_t          n_started;
+  ix_engine_stream* streams;
+  uint32_t          max_streams;
+  uint32_t          buf_size;
+  pthread_mutex_t   lock;       /* guards everything below */
+  pthread_cond_t    work_cond;  /* signaled when queued goes up or on stop */
+  pthread_cond_t    idle_cond;  /* signaled when active drops to 0 */
+  uint32_t          n_streams;
+  uint32_t          queued;     /* streams in some deque */
+  uint32_t          active;     /* streams queued or running */
+  bool              stopping;
+  uint64_t          steals;
+};
+
+
+static void
+_push(_worker* w, ix_engine_stream* s)
+{
+  uint32_t cap = w->e->max_streams;
+
+  pthread_mutex_lock(&w->lock);
+  w->q[(w->front + w->n++) % cap] = s;
+  pthread_mutex_unlock(&w->lock);
+}
+
+static ix_engine_stream*
+_pop_front(_worker* w)
+{
+  ix_engine_stream* s = NULL;
+
+  pthread_mutex_lock(&w->lock);
+  if (w->n) {
+    s = w->q[w->front];
+    w->front = (w->front + 1) % w->e->max_streams;
+    w->n--;
+  }
+  pthread_mutex_unlock(&w->lock);
+  return s;
+}
+
+static ix_engine_stream*
+_pop_back(_worker* w)
+{
+  ix_engine_stream* s = NULL;
+
+  pthread_mutex_lock(&w->lock);
+  if (w->n) {
+    s = w->q[(w->front + --w->n) % w->e->max_streams];
+  }
+  pthread_mutex_unlock(&w->lock);
+  return s;
+}
+
+/*
+ * Queue s on worker home. new_work is whether s just went from idle to
+ * queued, as opposed to being requeued by the worker running it. The push
+ * happens under e->lock so that no worker can take s before it is counted.
+ */
+static void
+_enqueue(ix_engine* e, uint32_t home, ix_engine_stream* s, bool new_work)
+{
+  pthread_mutex_lock(&e->lock);
+  e->queued++;
+  if (new_work) e->active++;
+  _push(&e->workers[home], s);
+  pthread_cond_signal(&e->work_cond);
+  pthread_mutex_unlock(&e->lock);
+}
+
+/*
+ * Take a stream, from w's own deque if possible. Returns NULL once the engine
+ * is stopping and nothing is left.
+ */
+static ix_engine_stream*
+_take(_worker* w)
+{
+  ix_engine*        e = w->e;
+  ix_engine_stream* s;
+  uint32_t          i;
+  bool              stolen;
+
+  for (;;) {
+    stolen = false;
+    s = _pop_front(w);
+    for (i = 1; !s && i < e->n_workers; i++) {
+      s = _pop_back(&e->workers[(w->id + i) % e->n_workers]);
+      stolen = s != NULL;
+    }
+    pthread_mutex_lock(&e->lock);
+    if (s) {
+      e->queued--;
+      if (stolen) e->steals++;
+      pthread_mutex_unlock(&e->lock);
+      return s;
+    }
+    while (!e->queued && !e->stopping) {
+      pthread_cond_wait(&e->work_cond, &e->lock);
+    }
+    if (!e->queued) {
+      pthread_mutex_unlock(&e->lock);
+      return NULL;
+    }
+    pthread_mutex_unlock(&e->lock);
+  }
+}
+
+static void
+_run(_worker* w, ix_engine_stream* s)
+{
+  ix_engine* e = w->e;
+  uint32_t   size = e->buf_size, done = 0, span;
+
+  pthread_mutex_lock(&s->lock);
+  s->state = _RUNNING;
+  s->home = w->id;
+  for (;;) {
+    span = s->len < size - s->head ? s->len : size - s->head;
+    if (!span) {
+      s->state = _IDLE;
+      pthread_mutex_unlock(&s->lock);
+      pthread_mutex_lock(&e->lock);
+      if (!--e->active) pthread_cond_broadcast(&e->idle_cond);
+      pthread_mutex_unlock(&e->lock);
+      return;
+    }
+    if (done >= size) {
+      s->state = _QUEUED;
+      pthread_mutex_unlock(&s->lock);
+      _enqueue(e, w->id, s, false);
+      return;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    ix_stream_feed(&s->parser, s->buf + s->head, span);
+    done += span;
+
+    pthread_mutex_lock(&s->lock);
+    s->head = (s->head + span) % size;
+    s->len -= span;
+  }
+}
+
+static void*
+_work(void* arg)
+{
+  _worker*          w = arg;
+  ix_engine_stream* s;
+
+  while ((s = _take(w))) {
+    _run(w, s);
+  }
+  return NULL;
+}
+
+static void
+_stop(ix_engine* e)
+{
+  uint32_t i;
+
+  pthread_mutex_lock(&e->lock);
+  e->stopping = true;
+  pthread_cond_broadcast(&e->work_cond);
+  pthread_mutex_unlock(&e->lock);
+  for (i = 0; i < e->n_started; i++) {
+    pthread_join(e->workers[i].thread, NULL);
+  }
+}
+
+static void
+_free(ix_engine* e)
+{
+  uint32_t i;
+
+  for (i = 0; i < e->n_streams; i++) {
+    pthread_mutex_destroy(&e->streams[i].lock);
+    free(e->streams[i].buf);
+  }
+  for (i = 0; i < e->n_workers; i++) {
+    pthread_mutex_destroy(&e->workers[i].lock);
+    free(e->workers[i].q);
+  }
+  pthread_cond_destroy(&e->idle_cond);
+  pthread_cond_destroy(&e->work_cond);
+  pthread_mutex_destroy(&e->lock);
+  free(e->streams);
+  free(e->workers);
+  free(e);
+}
+
+ix_engine*
+ix_engine_new(uint32_t n_workers, uint32_t max_streams, uint32_t buf_size)
+{
+  ix_engine* e;
+  long       n_cpus;
+  uint32_t   i;
+
+  if (!max_streams || !buf_size) return NULL;
+  if (!n_workers) {
+    n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    n_workers = n_cpus > 0 ? (uint32_t)n_cpus : 1;
+  }
+
+  e = calloc(1, sizeof *e);
+  if (!e) return NULL;
+  pthread_mutex_init(&e->lock, NULL);
+  pthread_cond_init(&e->work_cond, NULL);
+  pthread_cond_init(&e->idle_cond, NULL);
+  e->max_streams = max_streams;
+  e->buf_size = buf_size;
+  e->streams = calloc(max_streams, sizeof *e->streams);
+  e->workers = calloc(n_workers, sizeof *e->workers);
+  if (!e->streams || !e->workers) goto fail;
+
+  for (i = 0; i < n_workers; i++) {
+    e->workers[i].e = e;
+    e->workers[i].id = i;
+    pthread_mutex_init(&e->workers[i].lock, NULL);
+    e->n_workers++;
+    e->workers[i].q = calloc(max_streams, sizeof *e->workers[i].q);
+    if (!e->workers[i].q) goto fail;
+  }
+  for (i = 0; i < n_workers; i++) {
+    if (pthread_create(&e->workers[i].thread, NULL, _work, &e->workers[i])) {
+      goto fail;
+    }
+    e->n_started++;
+  }
+  return e;
+
+fail:
+  _stop(e);
+  _free(e);
+  return NULL;
+}
+
+void
+ix_engine_free(ix_engine* e)
+{
+  _stop(e);
+  _free(e);
+}
+
+ix_engine_stream*
+ix_engine_add_stream(ix_engine* e, const ix_packet_format* fmt,
+                     ix_packet_fn pac_f, ix_corrupt_fn corrupt_f,
+                     void* user_data)
+{
+  ix_engine_stream* s;
+  uint8_t*          buf;
+
+  buf = malloc(e->buf_size);
+  if (!buf) return NULL;
+  pthread_mutex_lock(&e->lock);
+  if (e->n_streams == e->max_streams) {
+    pthread_mutex_unlock(&e->lock);
+    free(buf);
+    return NULL;
+  }
+  s = &e->streams[e->n_streams];
+  s->e = e;
+  pthread_mutex_init(&s->lock, NULL);
+  ix_stream_init(&s->parser, pac_f, corrupt_f, user_data);
+  ix_stream_set_format(&s->parser, fmt);
+  s->buf = buf;
+  s->home = e->n_streams % e->n_workers;
+  e->n_streams++;
+  pthread_mutex_unlock(&e->lock);
+  return s;
+}
+
+uint32_t
+ix_engine_feed(ix_engine_stream* s, const uint8_t* buf, uint32_t len)
+{
+  uint32_t size = s->e->buf_size, tail, n, first, home;
+  bool     wake;
+
+  pthread_mutex_lock(&s->lock);
+  n = size - s->len < len ? size - s->len : len;
+  tail = (s->head + s->len) % size;
+  first = size - tail < n ? size - tail : n;
+  if (n) {
+    memcpy(s->buf + tail, buf, first);
+    memcpy(s->buf, buf + first, n - first);
+  }
+  s->len += n;
+  wake = n && s->state == _IDLE;
+  if (wake) s->state = _QUEUED;
+  home = s->home;
+  pthread_mutex_unlock(&s->lock);
+
+  if (wake) _enqueue(s->e, home, s, true);
+  return n;
+}
+
+void
+ix_engine_drain(ix_engine* e)
+{
+  pthread_mutex_lock(&e->lock);
+  while (e->active) {
+    pthread_cond_wait(&e->idle_cond, &e->lock);
+  }
+  pthread_mutex_unlock(&e->lock);
+}
+
+uint32_t
+ix_engine_workers(const ix_engine* e)
+{ return e->n_workers; }
+
+uint64_t
+ix_engine_steals(ix_engine* e)
+{
+  uint64_t ret;
+
+  pthread_mutex_lock(&e->lock);
+  ret = e->steals;
+  pthread_mutex_unlock(&e->lock);
+  return ret;
+}
+
+void
+ix_engine_stream_stats(const ix_engine_stream* s, ix_stats* out)
+{ ix_stream_stats(&s->parser, out); }
+
+void
+ix_engine_stats(ix_engine* e, ix_stats* out)
+{
+  uint32_t n, i;
+
+  pthread_mutex_lock(&e->lock);
+  n = e->n_streams;
+  pthread_mutex_unlock(&e->lock);
+  memset(out, 0, sizeof *out);
+  for (i = 0; i < n; i++) {
+    ix_stats_add(out, &e->streams[i].parser.stats);
+  }
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * include <stdint.h> for sized ints
+ * include "defs.h" for IX_EXPORT
+ * include "packet.h" for ix_packet_fn, ix_packet_format
+ * include "stats.h" for ix_stats
+ * include "stream.h" for ix_corrupt_fn
+ */
+
+/*
+ * Multi-stream parsing engine.
+ *
+ * An engine parses many independent byte streams, e.g. one per headset, on a
+ * pool of worker threads. Each stream is an ix_stream run by one worker at a
+ * time, so its packets are delivered in order and its callbacks never run
+ * concurrently with each other. Callbacks for different streams do run
+ * concurrently, on the workers.
+ *
+ * A stream stays with the worker that last ran it. Workers that run out of
+ * streams of their own steal whole streams from the others, and keep them.
+ *
+ * Bytes fed to a stream are copied into a ring buffer owned by the stream, so
+ * feeding never waits on parsing. Everything is allocated up front by
+ * ix_engine_new and ix_engine_add_stream.
+ *
+ * Workers are POSIX threads. Apart from ix_split_feed, which parses one large
+ * buffer on all cores, this is the only part of the library that uses threads.
+ */
+
+typedef struct _ix_engine ix_engine;
+typedef struct _ix_engine_stream ix_engine_stream;
+
+/*
+ * Create an engine with n_workers worker threads, or one per online CPU if
+ * n_workers is 0, room for max_streams streams, and buf_size bytes of input
+ * buffer per stream. Returns NULL if anything can't be allocated or started.
+ */
+IX_EXPORT
+ix_engine*
+ix_engine_new(uint32_t n_workers, uint32_t max_streams, uint32_t buf_size);
+
+/*
+ * Finish parsing everything already fed, stop the workers and free the
+ * engine and all its streams.
+ */
+IX_EXPORT
+void
+ix_engine_free(ix_engine* e);
+
+/*
+ * Add a stream of the given packet format. pac_f, corrupt_f and user_data are
+ * as for ix_stream_init. Returns NULL if the engine already has max_streams
+ * streams or the buffer can't be allocated.
+ */
+IX_EXPORT
+ix_engine_stream*
+ix_engine_add_stream(ix_engine* e, const ix_packet_format* fmt,
+                     ix_packet_fn pac_f, ix_corrupt_fn corrupt_f,
+                     void* user_data);
+
+/*
+ * Queue the next chunk of a stream for parsing.
+ *
+ * Copies as much of buf as fits in the stream's buffer and returns how many
+ * bytes that was; the caller retries the rest later. Never blocks on the
+ * workers. Feed any one stream from one thread at a time.
+ */
+IX_EXPORT
+uint32_t
+ix_engine_feed(ix_engine_stream* s, const uint8_t* buf, uint32_t len);
+
+/*
+ * Wait until every byte fed so far has been parsed.
+ */
+IX_EXPORT
+void
+ix_engine_drain(ix_engine* e);
+
+/*
+ * Return the number of worker threads.
+ */
+IX_EXPORT
+uint32_t
+ix_engine_workers(const ix_engine* e);
+
+/*
+ * Return how many times a worker has stolen a stream from another.
+ */
+IX_EXPORT
+uint64_t
+ix_engine_steals(ix_engine* e);
+
+/*
+ * Store a snapshot of one stream's statistics, or the sum over all streams,
+ * in *out. Neither waits on the workers.
+ */
+IX_EXPORT
+void
+ix_engine_stream_stats(const ix_engine_stream* s, ix_stats* out);
+
+IX_EXPORT
+void
+ix_engine_stats(ix_engine* e, ix_stats* out);
@@ -23,6 +23,24 @@ extern "C" {
 
 #include "defs.h"
 #include "packet.h"
+#include "encode.h"
+#include "unpack.h"
+#include "resync.h"
+#include "block.h"
+#include "stats.h"
+#include "stream.h"
+#include "ring.h"
+#include "clock.h"
+#include "command.h"
+#include "conn.h"
+
+/* These need pthreads and mmap, and are only built on POSIX systems. */
+#if !defined _WIN32
+#include "engine.h"
+#include "capture.h"
+#include "split.h"
+#include "session.h"
+#endif
 
 #ifdef __cplusplus
 }
@@ -20,8 +20,42 @@
  * we don't need to make sure that e.g. a DRL/REF packet has 2 sample fields --
  * it's defined to by construction.
  *
- * Given all that, ix_packet_parse is stupidly trivial. The rest of the file is
- * just accessors for use in user callbacks.
+ * Given all that, parsing with hammer is stupidly trivial.
+ *
+ * The grammar is built the first time it is needed, or by ix_packet_init,
+ * not when the library is loaded, so processes that only ever use the table
+ * decoder never pay for it. Each hammer decoder builds its own copy and
+ * compiles it for its backend with h_compile; a backend that rejects the
+ * grammar falls back to the packrat copy, which needs no compiling.
+ *
+ * Since every packet type is fully determined by the high nibble of its first
+ * byte, the grammar is also simple enough to decode by hand. The table-driven
+ * decoder after ix_packet_parse does exactly that, and it is what
+ * ix_packet_parse uses by default. It must accept exactly the same language as
+ * the grammar and build exactly the same packets; the differential tests in
+ * packet_test.cpp hold the two in lockstep.
+ *
+ * The rest of the file is just accessors for use in user callbacks.
+ *
+ * Built with -DIX_TRACE, the parse path has USDT probes in provider
+ * muse_core (see IX_PROBE in defs_internal.h):
+ *
+ *   parse__start(decoder, buf, len)  before decoding one packet
+ *   parse__done(decoder, type, len)  after; type and len are 0 on failure
+ *   parse__corrupt(buf, len, est)    a walk stopped at corrupt data; est is
+ *                                    ix_packet_est_len's answer, so 0 means
+ *                                    it failed there and anything else that
+ *                                    the decoder rejected the packet
+ *   parse__partial(buf, len, est)    a walk stopped at an incomplete packet
+ *   est__len(buf, len, est)          every ix_packet_est_len
+ *   action(type, n)                  a grammar action built n packets
+ *
+ * e.g. to see how long each hammer parse takes:
+ *
+ *   bpftrace -e 'usdt:libmuse_core.so:muse_core:parse__start
+ *                { @t[tid] = nsecs }
+ *                usdt:libmuse_core.so:muse_core:parse__done /@t[tid]/
+ *                { @ns[arg1] = hist(nsecs - @t[tid]); delete(@t[tid]) }'
  */
 
 #ifndef IX_MUSE_CORE_H_
@@ -43,26 +77,10 @@ enum {
   DRLREF_CHANNELS = 2u,
   ACC_CHANNELS = 3u,
   BAT_CHANNELS = 4u,
+  EEG2_CHANNELS = 2u,
   EEG4_CHANNELS = 4u,
-  MAX_CHANNELS = 4u
-};
-
-typedef struct {
-  uint16_t n;
-  uint16_t data[MAX_CHANNELS];
-} ix_samples_n;
-
-struct _samples_dropped {
-  ix_samples_n samples;
-  uint16_t     dropped;
-};
-
-struct _ix_packet {
-  ix_pac_type  type;
-  union {
-    struct _samples_dropped samples_dropped;
-    uint32_t                error;
-  };
+  EEG6_CHANNELS = 6u,
+  MAX_CHANNELS = IX_PAC_MAXCHANNELS
 };
 
 /*
@@ -84,11 +102,39 @@ TT_ix_packet, TT_ix_samples_n;
 #define TT_NEW(N) TT_ ##N = h_allocate_token_type(#N)
 
 /*
- * Top-level packet parser. Exported for use in benchmarking code, but not
- * mentioned in the public API. Clients should never use this directly.
+ * Decoder used by ix_packet_parse. Override with e.g.
+ * -DIX_DEFAULT_DECODER=IX_DECODER_HAMMER to make the grammar the default, or
+ * IX_DECODER_HAMMER_LLK etc. for the grammar on another hammer backend.
+ */
+#ifndef IX_DEFAULT_DECODER
+#define IX_DEFAULT_DECODER IX_DECODER_TABLE
+#endif
+
+/*
+ * Top-level packrat packet parser, once ix_packet_init has built it. Exported
+ * for use in benchmarking code, but not mentioned in the public API. Clients
+ * should never use this directly.
  */
 IX_EXPORT HParser *g_ix_packet;
 
+/*
+ * The hammer decoders, in ix_decoder order from IX_DECODER_HAMMER.
+ */
+enum { N_HAMMER = IX_DECODER_HAMMER_GLR - IX_DECODER_HAMMER + 1 };
+
+static const HParserBackend
+k_backends[N_HAMMER] = { PB_PACKRAT, PB_LLk, PB_LALR, PB_GLR };
+
+/*
+ * Parser for each hammer decoder, and 1 + the decoder it runs as, or 0 until
+ * it is built. Built holding g_compiling, a spinlock taken with IX_CAS; read
+ * without it once g_compiled is set. Threads only spin while another builds a
+ * parser, which happens at most once per decoder.
+ */
+static HParser* g_parsers[N_HAMMER];
+static uint32_t g_compiled[N_HAMMER];
+static uint32_t g_compiling;
+
 
 /*
  * Actions and validation functions.
@@ -139,6 +185,7 @@ _make_packet_word(ix_pac_type type, uint64_t word,
   ix_packet *pac = H_ALLOC(ix_packet);
 
   IX_UNUSED(user_data);
+  IX_PROBE2(action, type, 1);
   pac->type = type;
   pac->error = word;
   return H_MAKE(ix_packet, pac);
@@ -152,6 +199,7 @@ _make_packet_samples(ix_pac_type type,
   ix_packet *pac = H_ALLOC(ix_packet);
 
   IX_UNUSED(user_data);
+  IX_PROBE2(action, type, 1);
   pac->type = type;
   pac->samples_dropped = *samples_dropped;
   return H_MAKE(ix_packet, pac);
@@ -185,16 +233,9 @@ H_ACT_APPLY(act_ix_packet_maybe_dropped, _make_packet_generic,
             &((struct _samples_dropped){*H_FIELD(ix_samples_n, 2),
                                         H_FIELD_UINT(1)}))
 
-IX_INITIALIZER(_ix_packet_init)
+static HParser*
+_ix_packet_grammar(void)
 {
-#ifndef NDEBUG
-  static int inited;
-
-  assert(!inited);
-  inited = 1;
-#endif
-  TT_NEW(ix_packet);
-  TT_NEW(ix_samples_n);
   H_RULE(nibble,
          h_with_endianness(BIT_BIG_ENDIAN, h_bits(4, false)));
   H_RULE(short_,    /* TODO(someday): little endian shorts */
@@ -236,7 +277,7 @@ IX_INITIALIZER(_ix_packet_init)
   H_AVRULE(packet_sync, word);
   _PRULE_D(packet_acc,
            h_sequence(type_acc, prefix_maybe_dropped, samples_acc, NULL));
-  /* TODO(soon): configurable number of EEG channels */
+  /* Only the 4-channel preset; see ix_packet_format_eeg. */
   _PRULE_D(packet_eeg4,
            h_sequence(type_eeg, prefix_maybe_dropped, samples_eeg4, NULL));
   /* TODO(soon): compressed EEG */
@@ -256,59 +297,491 @@ IX_INITIALIZER(_ix_packet_init)
                                     packet_battery,
                                     packet_error,
                                     NULL)));
-  g_ix_packet = packet;
+  return packet;
 }
 
-uint32_t
-ix_packet_parse(const uint8_t* buf, uint32_t len, ix_packet_fn pac_f,
-                void* user_data)
+/*
+ * Build the parser for hammer decoder i. Called holding g_compiling.
+ * Returns the decoder it runs as.
+ */
+static ix_decoder
+_compile_locked(uint32_t i)
+{
+  HParser* p;
+
+  if (g_compiled[i]) return (ix_decoder)(g_compiled[i] - 1);
+  if (!TT_ix_packet) {
+    TT_NEW(ix_packet);
+    TT_NEW(ix_samples_n);
+  }
+  p = _ix_packet_grammar();
+  if (i && h_compile(p, k_backends[i], NULL)) {
+    /* Rejected; p is leaked, since hammer has no way to free a parser. */
+    _compile_locked(0);
+    g_parsers[i] = g_parsers[0];
+    IX_STORE_RELEASE(&g_compiled[i], 1 + IX_DECODER_HAMMER);
+  }
+  else {
+    if (!i) g_ix_packet = p;
+    g_parsers[i] = p;
+    IX_STORE_RELEASE(&g_compiled[i], 1 + IX_DECODER_HAMMER + i);
+  }
+  return (ix_decoder)(g_compiled[i] - 1);
+}
+
+ix_decoder
+ix_packet_compile(ix_decoder decoder)
+{
+  uint32_t   i = decoder - IX_DECODER_HAMMER;
+  uint32_t   r;
+  ix_decoder ret;
+
+  if (i >= N_HAMMER) return IX_DECODER_TABLE;
+  r = IX_LOAD_ACQUIRE(&g_compiled[i]);
+  if (r) return (ix_decoder)(r - 1);
+  while (!IX_CAS(&g_compiling, 0, 1)) {}
+  ret = _compile_locked(i);
+  IX_STORE_RELEASE(&g_compiling, 0);
+  return ret;
+}
+
+void
+ix_packet_init(void)
+{ ix_packet_compile(IX_DECODER_HAMMER); }
+
+/*
+ * Decode with hammer decoder decoder, which ix_packet_compile has returned.
+ */
+static uint32_t
+_ix_decode_hammer(ix_decoder decoder, const uint8_t* buf, uint32_t len,
+                  ix_packet* pac)
 {
-  HParseResult *p = h_parse(g_ix_packet, buf, len);
+  HParseResult *p;
   uint32_t     r;
 
+  assert(decoder != IX_DECODER_TABLE);
+  p = h_parse(g_parsers[decoder - IX_DECODER_HAMMER], buf, len);
   if (p) {
     assert(p->bit_length > 0);
     assert(p->bit_length % 8 == 0);
     r = p->bit_length / 8;
-    pac_f(H_CAST(ix_packet, p->ast), user_data);
+    *pac = *H_CAST(ix_packet, p->ast);
     h_parse_result_free(p);
   }
   else r = 0;
   return r;
 }
 
+
+/*
+ * Table-driven decoder.
+ *
+ * Each decode function is called with a buffer at least as long as the base
+ * length in its table entry, and returns the length of the packet it decoded
+ * into pac, or 0 if the buffer does not start with a valid packet of its type.
+ */
+
+typedef uint32_t (*_ix_decode_fn)(const uint8_t* buf, uint32_t len,
+                                  ix_packet* pac);
+
+static inline uint16_t
+_be16(const uint8_t* b)
+{ return (uint16_t)(b[0] << 8 | b[1]); }
+
+static inline uint32_t
+_le32(const uint8_t* b)
+{ return (uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 |
+         (uint32_t)b[3] << 24; }
+
+/*
+ * Extract the i-th 10-bit sample from a little-endian bitpacked run.
+ */
+static inline uint16_t
+_sample(const uint8_t* b, uint8_t i)
+{
+  uint8_t bit = 10 * i;
+
+  return (b[bit / 8] | b[bit / 8 + 1] << 8) >> bit % 8 & 0x3ff;
+}
+
+/*
+ * Decode the flags nibble and optional dropped samples count. Returns the
+ * length of the prefix, or 0 if it is invalid or incomplete.
+ */
+static inline uint32_t
+_decode_maybe_dropped(const uint8_t* buf, uint32_t len, uint16_t* dropped)
+{
+  switch (*buf & 0xf) {
+  case 0:
+    *dropped = 0;
+    return 1;
+  case 0x8:
+    if (len < 3) return 0;
+    *dropped = _be16(buf + 1);
+    return 3;
+  default:
+    return 0;
+  }
+}
+
+static inline uint32_t
+_decode_samples(const uint8_t* buf, uint32_t len, ix_packet* pac,
+                ix_pac_type type, uint8_t n, uint8_t bytes)
+{
+  uint32_t off = _decode_maybe_dropped(buf, len, &pac->samples_dropped.dropped);
+  uint8_t  i;
+
+  if (!off || len < off + bytes) return 0;
+  pac->type = type;
+  pac->samples_dropped.samples.n = n;
+  for (i = 0; i < n; i++) {
+    pac->samples_dropped.samples.data[i] = _sample(buf + off, i);
+  }
+  return off + bytes;
+}
+
+static uint32_t
+_decode_drlref(const uint8_t* buf, uint32_t len, ix_packet* pac)
+{
+  if (*buf & 0xf) return 0;
+  return _decode_samples(buf, len, pac, IX_PAC_DRLREF, DRLREF_CHANNELS, 3);
+}
+
+static uint32_t
+_decode_acc(const uint8_t* buf, uint32_t len, ix_packet* pac)
+{
+  return _decode_samples(buf, len, pac, IX_PAC_ACCELEROMETER, ACC_CHANNELS, 4);
+}
+
+/*
+ * EEG decoders for each preset. The channel count is a constant in each, so
+ * the sample loops unroll and nothing on the per-packet path branches on it.
+ */
+#define _EEG_BYTES(N) ((10 * (N) + 7) / 8)
+#define _EEG_DECODERS(N)                                                   \
+static uint32_t                                                            \
+_decode_eeg ##N(const uint8_t* buf, uint32_t len, ix_packet* pac)          \
+{ return _decode_samples(buf, len, pac, IX_PAC_EEG, EEG ##N ##_CHANNELS,   \
+                         _EEG_BYTES(N)); }
+
+_EEG_DECODERS(2)
+_EEG_DECODERS(4)
+_EEG_DECODERS(6)
+
+static uint32_t
+_decode_battery(const uint8_t* buf, uint32_t len, ix_packet* pac)
+{
+  uint8_t i;
+
+  IX_UNUSED(len);
+  if (*buf & 0xf) return 0;
+  pac->type = IX_PAC_BATTERY;
+  pac->samples_dropped.samples.n = BAT_CHANNELS;
+  for (i = 0; i < BAT_CHANNELS; i++) {
+    pac->samples_dropped.samples.data[i] = _be16(buf + 1 + 2 * i);
+  }
+  pac->samples_dropped.dropped = 0;
+  return 9;
+}
+
+static uint32_t
+_decode_error(const uint8_t* buf, uint32_t len, ix_packet* pac)
+{
+  IX_UNUSED(len);
+  if (*buf & 0xf) return 0;
+  pac->type = IX_PAC_ERROR;
+  pac->error = _le32(buf + 1);
+  return 5;
+}
+
+static uint32_t
+_decode_sync(const uint8_t* buf, uint32_t len, ix_packet* pac)
+{
+  IX_UNUSED(len);
+  if (_le32(buf) != 0x55aaffff) return 0;
+  pac->type = IX_PAC_SYNC;
+  pac->error = 0;
+  return 4;
+}
+
+/*
+ * Packet layouts keyed on the high nibble of the first byte. len is the
+ * packet length without a dropped samples count; types with dropped set grow
+ * by 2 bytes when flag 0x8 is present. Unused nibbles are left zeroed.
+ *
+ * A format is one such table per EEG preset; only the EEG entries differ.
+ */
+struct _ix_packet_format {
+  struct {
+    uint8_t       len;
+    bool          dropped;
+    _ix_decode_fn decode;
+  } nibbles[16];
+};
+
+#define _FORMAT(N) { {                                                     \
+  [0x9] = { 4, false, _decode_drlref },                                    \
+  [0xa] = { 5, true,  _decode_acc },                                       \
+  [0xb] = { 9, false, _decode_battery },                                   \
+  /* TODO(soon): compressed EEG */                                         \
+  [0xd] = { 5, false, _decode_error },                                     \
+  [0xe] = { 1 + _EEG_BYTES(N), true, _decode_eeg ##N },                    \
+  [0xf] = { 4, false, _decode_sync },                                      \
+} }
+
+static const ix_packet_format
+k_eeg2 = _FORMAT(2),
+k_eeg4 = _FORMAT(4),
+k_eeg6 = _FORMAT(6);
+
+static inline uint32_t
+_ix_decode(const ix_packet_format* fmt, const uint8_t* buf, uint32_t len,
+           ix_packet* pac)
+{
+  uint8_t nib;
+
+  if (len == 0) return 0;
+  nib = *buf >> 4;
+  if (!fmt->nibbles[nib].decode || len < fmt->nibbles[nib].len) return 0;
+  return fmt->nibbles[nib].decode(buf, len, pac);
+}
+
+/*
+ * The grammar only knows k_eeg4, so it is never passed any other format.
+ */
+static inline uint32_t
+_ix_decode_with(ix_decoder decoder, const ix_packet_format* fmt,
+                const uint8_t* buf, uint32_t len, ix_packet* pac)
+{
+  uint32_t r;
+
+  IX_PROBE3(parse__start, decoder, buf, len);
+  /* Unknown decoders come back as IX_DECODER_TABLE. */
+  if (decoder != IX_DECODER_TABLE) decoder = ix_packet_compile(decoder);
+  if (decoder == IX_DECODER_TABLE) r = _ix_decode(fmt, buf, len, pac);
+  else {
+    assert(fmt == &k_eeg4);
+    r = _ix_decode_hammer(decoder, buf, len, pac);
+  }
+  IX_PROBE3(parse__done, decoder, r ? pac->type : 0, r);
+  return r;
+}
+
+static inline ix_decoder
+_fmt_decoder(const ix_packet_format* fmt)
+{ return fmt == &k_eeg4 ? IX_DEFAULT_DECODER : IX_DECODER_TABLE; }
+
+uint32_t
+ix_packet_parse_with(ix_decoder decoder, const uint8_t* buf, uint32_t len,
+                     ix_packet_fn pac_f, void* user_data)
+{
+  ix_packet pac;
+  uint32_t  r = _ix_decode_with(decoder, &k_eeg4, buf, len, &pac);
+
+  if (r) pac_f(&pac, user_data);
+  return r;
+}
+
+uint32_t
+ix_packet_parse(const uint8_t* buf, uint32_t len, ix_packet_fn pac_f,
+                void* user_data)
+{ return ix_packet_parse_with(IX_DEFAULT_DECODER, buf, len, pac_f, user_data); }
+
+/*
+ * Decode consecutive packets from buf + *off into out until the buffer ends,
+ * out fills up, or decoding fails. Advances *off past the packets decoded and
+ * stores their count in *n.
+ */
+static inline ix_parse_status
+_ix_walk(ix_decoder decoder, const ix_packet_format* fmt, const uint8_t* buf,
+         uint32_t len, uint32_t* off, ix_packet* out, uint32_t cap,
+         uint32_t* n)
+{
+  uint32_t i = 0, r, est;
+
+  for (; *off < len; *off += r, i++) {
+    if (i == cap) {
+      *n = i;
+      return IX_PARSE_FULL;
+    }
+    r = _ix_decode_with(decoder, fmt, buf + *off, len - *off, &out[i]);
+    if (!r) {
+      *n = i;
+      est = ix_packet_est_len_fmt(fmt, buf + *off, len - *off);
+      if (est == 0 || est <= len - *off) {
+        IX_PROBE3(parse__corrupt, buf + *off, len - *off, est);
+        return IX_PARSE_CORRUPT;
+      }
+      IX_PROBE3(parse__partial, buf + *off, len - *off, est);
+      return IX_PARSE_PARTIAL;
+    }
+  }
+  *n = i;
+  return IX_PARSE_END;
+}
+
+/*
+ * Shared loop for ix_packet_parse_all and ix_packet_parse_all_batch. Exactly
+ * one of pac_f and pacs_f is non-NULL. Packets are decoded straight into the
+ * batch array, so batched delivery costs no copies.
+ */
+static ix_parse_status
+_ix_parse_all(const ix_packet_format* fmt, const uint8_t* buf, uint32_t len,
+              ix_packet_fn pac_f, ix_packets_fn pacs_f, void* user_data,
+              uint32_t* consumed)
+{
+  ix_packet       batch[IX_PARSE_BATCH];
+  ix_parse_status ret;
+  uint32_t        off = 0, n, i;
+
+  do {
+    ret = _ix_walk(_fmt_decoder(fmt), fmt, buf, len, &off, batch,
+                   IX_PARSE_BATCH, &n);
+    if (pacs_f) {
+      if (n) pacs_f(batch, n, user_data);
+    }
+    else {
+      for (i = 0; i < n; i++) pac_f(&batch[i], user_data);
+    }
+  } while (ret == IX_PARSE_FULL);
+  if (consumed) {
+    *consumed = off;
+  }
+  return ret;
+}
+
+ix_parse_status
+ix_packet_parse_all(const uint8_t* buf, uint32_t len, ix_packet_fn pac_f,
+                    void* user_data, uint32_t* consumed)
+{
+  assert(pac_f);
+  return _ix_parse_all(&k_eeg4, buf, len, pac_f, NULL, user_data, consumed);
+}
+
+ix_parse_status
+ix_packet_parse_all_batch(const uint8_t* buf, uint32_t len,
+                          ix_packets_fn pacs_f, void* user_data,
+                          uint32_t* consumed)
+{
+  assert(pacs_f);
+  return _ix_parse_all(&k_eeg4, buf, len, NULL, pacs_f, user_data, consumed);
+}
+
+ix_parse_status
+ix_packet_parse_into(const uint8_t* buf, uint32_t len, ix_packet* out,
+                     uint32_t cap, uint32_t* n, uint32_t* consumed)
+{ return ix_packet_parse_into_fmt(&k_eeg4, buf, len, out, cap, n, consumed); }
+
 uint32_t
 ix_packet_est_len(const uint8_t* buf, uint32_t len)
+{ return ix_packet_est_len_fmt(&k_eeg4, buf, len); }
+
+const ix_packet_format*
+ix_packet_format_eeg(uint8_t channels)
+{
+  switch (channels) {
+  case EEG2_CHANNELS: return &k_eeg2;
+  case EEG4_CHANNELS: return &k_eeg4;
+  case EEG6_CHANNELS: return &k_eeg6;
+  default: return NULL;
+  }
+}
+
+ix_parse_status
+ix_packet_parse_all_fmt(const ix_packet_format* fmt, const uint8_t* buf,
+                        uint32_t len, ix_packet_fn pac_f, void* user_data,
+                        uint32_t* consumed)
+{
+  assert(fmt && pac_f);
+  return _ix_parse_all(fmt, buf, len, pac_f, NULL, user_data, consumed);
+}
+
+ix_parse_status
+ix_packet_parse_all_batch_fmt(const ix_packet_format* fmt,
+                              const uint8_t* buf, uint32_t len,
+                              ix_packets_fn pacs_f, void* user_data,
+                              uint32_t* consumed)
+{
+  assert(fmt && pacs_f);
+  return _ix_parse_all(fmt, buf, len, NULL, pacs_f, user_data, consumed);
+}
+
+ix_parse_status
+ix_packet_parse_into_fmt(const ix_packet_format* fmt, const uint8_t* buf,
+                         uint32_t len, ix_packet* out, uint32_t cap,
+                         uint32_t* n, uint32_t* consumed)
 {
-  bool     has_dropped;
+  ix_parse_status ret;
+  uint32_t        off = 0;
+
+  assert(fmt && n);
+  ret = _ix_walk(IX_DECODER_TABLE, fmt, buf, len, &off, out, cap, n);
+  if (consumed) {
+    *consumed = off;
+  }
+  return ret;
+}
+
+void
+ix_packet_cursor_init(ix_packet_cursor* c, const uint8_t* buf, uint32_t len)
+{ ix_packet_cursor_init_fmt(c, &k_eeg4, buf, len); }
+
+void
+ix_packet_cursor_init_fmt(ix_packet_cursor* c, const ix_packet_format* fmt,
+                          const uint8_t* buf, uint32_t len)
+{
+  assert(fmt);
+  c->fmt = fmt;
+  c->buf = buf;
+  c->len = len;
+  c->off = 0;
+  c->i = c->n = 0;
+  c->st = IX_PARSE_FULL;
+}
+
+uint32_t
+_ix_packet_cursor_fill(ix_packet_cursor* c)
+{
+  const uint8_t* b = c->off ? c->buf + c->off : c->buf;   /* may be NULL */
+  uint32_t       used;
+
+  if (c->st != IX_PARSE_FULL) return 0;
+  c->st = ix_packet_parse_into_fmt(c->fmt, b, c->len - c->off, c->pacs,
+                                   IX_PARSE_BATCH, &c->n, &used);
+  c->off += used;
+  c->i = 0;
+  return c->n;
+}
+
+uint32_t
+ix_packet_est_len_fmt(const ix_packet_format* fmt, const uint8_t* buf,
+                      uint32_t len)
+{
+  uint8_t  nib;
   uint32_t ret;
 
   if (len == 0) {
-    return 4;
+    ret = 4;
   }
   else {
-    switch (*buf >> 4) {
-    case 0xa: case 0xe: has_dropped = true; break;
-    default: has_dropped = false;
-    }
-    switch (*buf >> 4) {
-    case 0x9: ret = 4; break;
-    case 0xa: ret = 5; break;
-    case 0xb: ret = 9; break;
-    /* TODO(soon): compressed EEG */
-    case 0xd: ret = 5; break;
-    case 0xe: ret = 6; break;
-    case 0xf: ret = 4; break;
-    default: return 0;
+    nib = *buf >> 4;
+    ret = fmt->nibbles[nib].len;
+    if (fmt->nibbles[nib].dropped && (*buf & 0x8)) {
+      ret += 2;
     }
   }
-  if (has_dropped && (*buf & 0x8)) {
-    ret += 2;
-  }
+  IX_PROBE3(est__len, buf, len, ret);
   return ret;
 }
 
 
+/* With NDEBUG, packet.h makes these names expand to its inline copies. */
+#undef ix_packet_type
+#undef ix_packet_channels
+#undef ix_packet_ch
+#undef ix_packet_error
+#undef ix_packet_dropped_samples
+
 ix_pac_type
 ix_packet_type(const ix_packet* p)
 { return p->type; }
@@ -317,6 +790,20 @@ uint32_t
 ix_packet_error(const ix_packet* p)
 { return _ix_assert_type(p, IX_PAC_ERROR)->error; }
 
+uint8_t
+ix_packet_channels(const ix_packet* p)
+{
+  switch (p->type) {
+  case IX_PAC_EEG:
+  case IX_PAC_BATTERY:
+  case IX_PAC_ACCELEROMETER:
+  case IX_PAC_DRLREF:
+    return p->samples_dropped.samples.n;
+  default:
+    return 0;
+  }
+}
+
 uint16_t
 ix_packet_ch(const ix_packet* p, uint8_t channel)
 {
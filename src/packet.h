@@ -23,6 +23,25 @@ typedef enum {
   IX_PAC_DRLREF
 } ix_pac_type;
 
+/*
+ * Packet decoders.
+ *
+ * IX_DECODER_TABLE is a hand-written decoder that dispatches on the first
+ * nibble of the packet. IX_DECODER_HAMMER is the reference hammer grammar,
+ * run by hammer's default packrat backend, and the decoders after it are the
+ * same grammar compiled for other hammer backends. They all accept the same
+ * packets and produce the same results; the table decoder is just faster.
+ * ix_packet_parse uses the table decoder unless the library was built with
+ * IX_DEFAULT_DECODER defined to something else.
+ */
+typedef enum {
+  IX_DECODER_TABLE = 0,
+  IX_DECODER_HAMMER,
+  IX_DECODER_HAMMER_LLK,    /* LL(k) */
+  IX_DECODER_HAMMER_LALR,   /* LALR(1) */
+  IX_DECODER_HAMMER_GLR     /* GLR */
+} ix_decoder;
+
 /*
  * High guess at the maximum valid packet size. Used in ix_packet_est_len.
  * Exposed here for possible use in computing buffer sizes.
@@ -30,16 +49,75 @@ typedef enum {
 enum { IX_PAC_MAXSIZE = 32u };
 
 
+/*
+ * Maximum number of sample channels carried by any one packet.
+ */
+enum { IX_PAC_MAXCHANNELS = 6u };
+
+/*
+ * Most packets that ix_packet_parse_all_batch will deliver in one call.
+ */
+enum { IX_PARSE_BATCH = 64u };
+
+
 /*
  * Generic packet structure.
+ *
+ * The layout is only exposed so that packets can be stored by value, e.g. in
+ * the arrays passed to ix_packets_fn. Treat the fields as private and always
+ * go through the accessors below.
  */
-typedef struct _ix_packet ix_packet;
+typedef struct {
+  uint16_t n;
+  uint16_t data[IX_PAC_MAXCHANNELS];
+} ix_samples_n;
+
+struct _samples_dropped {
+  ix_samples_n samples;
+  uint16_t     dropped;
+};
+
+typedef struct _ix_packet {
+  ix_pac_type  type;
+  union {
+    struct _samples_dropped samples_dropped;
+    uint32_t                error;
+  };
+} ix_packet;
+
+/*
+ * Packet formats.
+ *
+ * Headsets can be configured to send 2, 4 or 6 channels of EEG, which changes
+ * the layout of EEG packets. A format describes one such preset. Each has its
+ * own decoders, specialized for its channel count.
+ *
+ * The functions below that don't take a format assume the 4-channel preset.
+ */
+typedef struct _ix_packet_format ix_packet_format;
 
 /*
  * Packet callback function type.
  */
 typedef void (*ix_packet_fn)(const ix_packet* p, void* user_data);
 
+/*
+ * Packet array callback function type. Called with n >= 1 consecutive
+ * packets, in stream order.
+ */
+typedef void (*ix_packets_fn)(const ix_packet* ps, uint32_t n,
+                              void* user_data);
+
+/*
+ * How a walk over a buffer of packets stopped.
+ */
+typedef enum {
+  IX_PARSE_END = 0,     /* every byte was consumed */
+  IX_PARSE_PARTIAL,     /* the rest may be a partial packet */
+  IX_PARSE_CORRUPT,     /* the rest definitely does not start with a packet */
+  IX_PARSE_FULL         /* ran out of room for packets */
+} ix_parse_status;
+
 
 /*
  * Return the type of the passed packet.
@@ -48,6 +126,14 @@ IX_EXPORT
 ix_pac_type
 ix_packet_type(const ix_packet* p);
 
+/*
+ * Return the number of sample channels in the passed packet: its EEG channels,
+ * accelerometer axes, DRL and REF, or battery fields. 0 for other types.
+ */
+IX_EXPORT
+uint8_t
+ix_packet_channels(const ix_packet* p);
+
 /*
  * Packet channel accessor.
  *
@@ -114,6 +200,8 @@ ix_packet_error(const ix_packet* p);
 #define ix_packet_eeg_ch2(p) ix_packet_eeg_ch(p, 1)
 #define ix_packet_eeg_ch3(p) ix_packet_eeg_ch(p, 2)
 #define ix_packet_eeg_ch4(p) ix_packet_eeg_ch(p, 3)
+#define ix_packet_eeg_ch5(p) ix_packet_eeg_ch(p, 4)
+#define ix_packet_eeg_ch6(p) ix_packet_eeg_ch(p, 5)
 
 /*
  * Return the dropped samples value for this packet.
@@ -130,12 +218,60 @@ IX_EXPORT
 uint16_t
 ix_packet_dropped_samples(const ix_packet* p);
 
+/*
+ * Inline accessors.
+ *
+ * These do what the accessors above do, minus their assertions, so that a
+ * loop over many packets, e.g. with an ix_packet_cursor, compiles down to
+ * plain loads. Built with NDEBUG, when the assertions are gone anyway, the
+ * accessors' names expand to these; write e.g. (ix_packet_ch)(p, i) to call
+ * the library's copy regardless.
+ */
+static inline ix_pac_type
+_ix_packet_type(const ix_packet* p)
+{ return p->type; }
+
+static inline uint8_t
+_ix_packet_channels(const ix_packet* p)
+{
+  switch (p->type) {
+  case IX_PAC_EEG:
+  case IX_PAC_BATTERY:
+  case IX_PAC_ACCELEROMETER:
+  case IX_PAC_DRLREF:
+    return (uint8_t)p->samples_dropped.samples.n;
+  default:
+    return 0;
+  }
+}
+
+static inline uint16_t
+_ix_packet_ch(const ix_packet* p, uint8_t channel)
+{ return p->samples_dropped.samples.data[channel]; }
+
+static inline uint32_t
+_ix_packet_error(const ix_packet* p)
+{ return p->error; }
+
+static inline uint16_t
+_ix_packet_dropped_samples(const ix_packet* p)
+{ return p->samples_dropped.dropped; }
+
+#ifdef NDEBUG
+#define ix_packet_type(p) _ix_packet_type(p)
+#define ix_packet_channels(p) _ix_packet_channels(p)
+#define ix_packet_ch(p, channel) _ix_packet_ch(p, channel)
+#define ix_packet_error(p) _ix_packet_error(p)
+#define ix_packet_dropped_samples(p) _ix_packet_dropped_samples(p)
+#endif
+
 /*
  * Parse a packet from a buffer.
  *
  * Returns the offset of the first unparsed byte on successful parse, or 0 on
- * parse error. If the parse was successful, this will have called pac_f once
- * per packet parsed with the parsed packet and the supplied user_data.
+ * parse error. If the parse was successful, this will have called pac_f
+ * exactly once with the parsed packet and the supplied user_data. To parse
+ * every packet in a buffer, see ix_packet_parse_all.
  *
  * An error could mean either a corrupt data stream or a partial packet at the
  * end of the buffer. Use ix_packet_est_len to disambiguate these two cases.
@@ -147,6 +283,88 @@ uint32_t
 ix_packet_parse(const uint8_t* buf, uint32_t len, ix_packet_fn pac_f,
                 void* user_data);
 
+/*
+ * Build the hammer grammar now, rather than the first time IX_DECODER_HAMMER
+ * is used, e.g. to keep that cost out of a latency-sensitive path. Safe to
+ * call from any number of threads; only the first call does anything. The
+ * table decoder needs no setup.
+ */
+IX_EXPORT
+void
+ix_packet_init(void);
+
+/*
+ * Build the grammar for a hammer decoder and compile it for its backend now,
+ * rather than on first use, as ix_packet_init does for IX_DECODER_HAMMER.
+ *
+ * Returns the decoder that decoder runs as: itself, or IX_DECODER_HAMMER if
+ * its backend rejected the grammar, in which case it runs the packrat
+ * grammar instead. Either way it can be used. Returns IX_DECODER_TABLE for
+ * IX_DECODER_TABLE and for any value that is not an ix_decoder.
+ */
+IX_EXPORT
+ix_decoder
+ix_packet_compile(ix_decoder decoder);
+
+/*
+ * Parse a packet from a buffer using a specific decoder. A value that is not
+ * an ix_decoder falls back to the table decoder.
+ *
+ * Otherwise identical to ix_packet_parse.
+ */
+IX_EXPORT
+uint32_t
+ix_packet_parse_with(ix_decoder decoder, const uint8_t* buf, uint32_t len,
+                     ix_packet_fn pac_f, void* user_data);
+
+/*
+ * Parse every packet in a buffer.
+ *
+ * Calls pac_f with each packet in turn, stopping at the end of the buffer or
+ * at the first thing that isn't a packet. Returns how the walk stopped and, if
+ * consumed is non-NULL, stores the offset of the first unparsed byte there.
+ *
+ * On IX_PARSE_PARTIAL, the bytes from *consumed on may be the start of a
+ * packet: keep them and try again once more data has arrived. On
+ * IX_PARSE_CORRUPT, *consumed is the offset of the corruption. Both are
+ * decided with ix_packet_est_len as described below.
+ *
+ * If buf is NULL, len must be 0.
+ */
+IX_EXPORT
+ix_parse_status
+ix_packet_parse_all(const uint8_t* buf, uint32_t len, ix_packet_fn pac_f,
+                    void* user_data, uint32_t* consumed);
+
+/*
+ * Parse every packet in a buffer, delivering them in arrays.
+ *
+ * Identical to ix_packet_parse_all, except that packets are passed to pacs_f
+ * in runs of up to IX_PARSE_BATCH at a time. The array is only valid for the
+ * duration of the callback.
+ */
+IX_EXPORT
+ix_parse_status
+ix_packet_parse_all_batch(const uint8_t* buf, uint32_t len,
+                          ix_packets_fn pacs_f, void* user_data,
+                          uint32_t* consumed);
+
+/*
+ * Parse packets from a buffer into caller-owned storage.
+ *
+ * Decodes up to cap consecutive packets from buf into out, stores how many it
+ * decoded in *n and, if consumed is non-NULL, the offset of the first
+ * unparsed byte in *consumed. Returns IX_PARSE_FULL if it stopped because out
+ * filled up, and otherwise stops exactly like ix_packet_parse_all.
+ *
+ * This never allocates: it always uses the table decoder, regardless of
+ * IX_DEFAULT_DECODER. Pass cap = 1 to parse a single packet.
+ */
+IX_EXPORT
+ix_parse_status
+ix_packet_parse_into(const uint8_t* buf, uint32_t len, ix_packet* out,
+                     uint32_t cap, uint32_t* n, uint32_t* consumed);
+
 /*
  * Return an estimate of how many bytes are needed for the next full packet.
  *
@@ -182,3 +400,120 @@ ix_packet_parse(const uint8_t* buf, uint32_t len, ix_packet_fn pac_f,
 IX_EXPORT
 uint32_t
 ix_packet_est_len(const uint8_t* buf, uint32_t len);
+
+/*
+ * Return the format for EEG with the given number of channels, or NULL if
+ * there is no such preset.
+ */
+IX_EXPORT
+const ix_packet_format*
+ix_packet_format_eeg(uint8_t channels);
+
+/*
+ * Variants of the functions above for a specific format.
+ *
+ * The hammer grammar only knows the 4-channel preset, so for any other format
+ * these always use the table decoder.
+ */
+IX_EXPORT
+ix_parse_status
+ix_packet_parse_all_fmt(const ix_packet_format* fmt, const uint8_t* buf,
+                        uint32_t len, ix_packet_fn pac_f, void* user_data,
+                        uint32_t* consumed);
+
+IX_EXPORT
+ix_parse_status
+ix_packet_parse_all_batch_fmt(const ix_packet_format* fmt,
+                              const uint8_t* buf, uint32_t len,
+                              ix_packets_fn pacs_f, void* user_data,
+                              uint32_t* consumed);
+
+IX_EXPORT
+ix_parse_status
+ix_packet_parse_into_fmt(const ix_packet_format* fmt, const uint8_t* buf,
+                         uint32_t len, ix_packet* out, uint32_t cap,
+                         uint32_t* n, uint32_t* consumed);
+
+IX_EXPORT
+uint32_t
+ix_packet_est_len_fmt(const ix_packet_format* fmt, const uint8_t* buf,
+                      uint32_t len);
+
+/*
+ * Pull cursor.
+ *
+ * A cursor walks a buffer like ix_packet_parse_all, but instead of calling
+ * back with each packet, hands the next one to its caller by value:
+ *
+ *   ix_packet_cursor c;
+ *   ix_packet        p;
+ *
+ *   ix_packet_cursor_init(&c, buf, len);
+ *   while (ix_packet_cursor_next(&c, &p) == IX_PARSE_FULL) {
+ *     ... ix_packet_type(&p) ...
+ *   }
+ *
+ * Packets are decoded IX_PARSE_BATCH at a time with ix_packet_parse_into, and
+ * ix_packet_cursor_next is inline, so there is no call per packet at all, and
+ * the compiler sees both ends of the loop. Like ix_packet_parse_into, it never
+ * allocates and always uses the table decoder.
+ */
+
+/*
+ * Cursor. Fields are private.
+ */
+typedef struct {
+  const ix_packet_format* fmt;
+  const uint8_t*          buf;
+  uint32_t                len;
+  uint32_t                off;      /* bytes decoded into pacs so far */
+  uint32_t                i;        /* next packet in pacs */
+  uint32_t                n;        /* packets in pacs */
+  ix_parse_status         st;       /* how the last batch stopped */
+  ix_packet               pacs[IX_PARSE_BATCH];
+} ix_packet_cursor;
+
+/*
+ * Start a cursor at the beginning of buf, which must outlive it. If buf is
+ * NULL, len must be 0.
+ */
+IX_EXPORT
+void
+ix_packet_cursor_init(ix_packet_cursor* c, const uint8_t* buf, uint32_t len);
+
+IX_EXPORT
+void
+ix_packet_cursor_init_fmt(ix_packet_cursor* c, const ix_packet_format* fmt,
+                          const uint8_t* buf, uint32_t len);
+
+/*
+ * Decode the next batch, and return how many packets it holds. Called by
+ * ix_packet_cursor_next; not for direct use.
+ */
+IX_EXPORT
+uint32_t
+_ix_packet_cursor_fill(ix_packet_cursor* c);
+
+/*
+ * Copy the next packet to *out and return IX_PARSE_FULL, or, at the end of the
+ * walk, return how it stopped, exactly as ix_packet_parse_all would, and
+ * leave *out alone. Every call after that returns the same.
+ */
+static inline ix_parse_status
+ix_packet_cursor_next(ix_packet_cursor* c, ix_packet* out)
+{
+  if (c->i == c->n && !_ix_packet_cursor_fill(c)) {
+    /* Never IX_PARSE_FULL here, but the compiler can't know that. */
+    return c->st == IX_PARSE_FULL ? IX_PARSE_END : c->st;
+  }
+  *out = c->pacs[c->i++];
+  return IX_PARSE_FULL;
+}
+
+/*
+ * Once ix_packet_cursor_next has stopped, return the offset of the first
+ * unparsed byte, as ix_packet_parse_all stores in *consumed.
+ */
+static inline uint32_t
+ix_packet_cursor_offset(const ix_packet_cursor* c)
+{ return c->off; }
@@ -0,0 +1,233 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * Resynchronization scans.
+ *
+ * The sync scan compares 16 or 32 consecutive offsets at once against each
+ * byte of the sync word by loading the input at offsets 0 through 3 and
+ * ANDing the four byte-equality masks together; the first set bit of the
+ * result is the first match.
+ *
+ * The headers scan uses a byte shuffle as a 16-entry lookup table, indexed
+ * by each byte's high nibble, to find every byte that could start a packet.
+ * Only those candidates are handed to the packet parser. The table is built
+ * with ix_packet_est_len, so it can never disagree with the parser about
+ * which nibbles are packet types.
+ *
+ * Both fall back to scalar loops for the tail of the buffer, which is also
+ * where partial matches are found.
+ */
+
+#ifndef IX_MUSE_CORE_H_
+#include <stdint.h>
+#include "defs.h"
+#include "packet.h"
+#include "unpack.h"
+#include "resync.h"
+#endif
+
+#ifndef IX_INTERNAL_H_
+#include "defs_internal.h"
+#endif
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+# define IX_RESYNC_X86 1
+# include <immintrin.h>
+# define IX_TARGET(t) __attribute__((target(t)))
+#endif
+
+/*
+ * The sync packet, 0x55aaffff little-endian.
+ */
+static const uint8_t k_sync[4] = { 0xff, 0xff, 0xaa, 0x55 };
+
+static uint32_t
+_sync_scalar(const uint8_t* buf, uint32_t len, uint32_t i)
+{
+  uint32_t k;
+
+  for (; i < len; i++) {
+    for (k = 0; k < 4 && i + k < len && buf[i + k] == k_sync[k]; k++) ;
+    if (k == 4 || i + k == len) return i;
+  }
+  return len;
+}
+
+/*
+ * Could a packet start here? Anything but a definite parse failure counts.
+ */
+static inline int
+_run_at(const ix_packet_format* fmt, const uint8_t* buf, uint32_t len)
+{
+  ix_packet pacs[IX_RESYNC_RUN];
+  uint32_t  n;
+
+  return ix_packet_parse_into_fmt(fmt, buf, len, pacs, IX_RESYNC_RUN, &n,
+                                  NULL) != IX_PARSE_CORRUPT;
+}
+
+static uint32_t
+_headers_scalar(const ix_packet_format* fmt, const uint8_t* buf,
+                uint32_t len, uint32_t i)
+{
+  for (; i < len; i++) {
+    if (ix_packet_est_len_fmt(fmt, buf + i, len - i) &&
+        _run_at(fmt, buf + i, len - i)) {
+      return i;
+    }
+  }
+  return len;
+}
+
+/*
+ * 0xff for every high nibble that starts a packet type, 0 otherwise.
+ */
+static void
+_header_table(const ix_packet_format* fmt, uint8_t table[16])
+{
+  uint8_t nib, b;
+
+  for (nib = 0; nib < 16; nib++) {
+    b = nib << 4;
+    table[nib] = ix_packet_est_len_fmt(fmt, &b, 1) ? 0xff : 0;
+  }
+}
+
+
+#ifdef IX_RESYNC_X86
+
+#define _LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define _LOAD256(p) _mm256_loadu_si256((const __m256i*)(p))
+
+IX_TARGET("ssse3,sse4.1") static uint32_t
+_sync_sse4(const uint8_t* buf, uint32_t len, uint32_t i)
+{
+  const __m128i s0 = _mm_set1_epi8((char)k_sync[0]);
+  const __m128i s2 = _mm_set1_epi8((char)k_sync[2]);
+  const __m128i s3 = _mm_set1_epi8((char)k_sync[3]);
+  const uint8_t *p;
+  int           m;
+
+  for (; i + 19 <= len; i += 16) {
+    p = buf + i;
+    m = _mm_movemask_epi8(_mm_and_si128(
+        _mm_and_si128(_mm_cmpeq_epi8(_LOAD(p), s0),
+                      _mm_cmpeq_epi8(_LOAD(p + 1), s0)),
+        _mm_and_si128(_mm_cmpeq_epi8(_LOAD(p + 2), s2),
+                      _mm_cmpeq_epi8(_LOAD(p + 3), s3))));
+    if (m) return i + __builtin_ctz(m);
+  }
+  return _sync_scalar(buf, len, i);
+}
+
+IX_TARGET("avx2") static uint32_t
+_sync_avx2(const uint8_t* buf, uint32_t len)
+{
+  const __m256i s0 = _mm256_set1_epi8((char)k_sync[0]);
+  const __m256i s2 = _mm256_set1_epi8((char)k_sync[2]);
+  const __m256i s3 = _mm256_set1_epi8((char)k_sync[3]);
+  const uint8_t *p;
+  uint32_t      i = 0, m;
+
+  for (; i + 35 <= len; i += 32) {
+    p = buf + i;
+    m = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(
+        _mm256_and_si256(_mm256_cmpeq_epi8(_LOAD256(p), s0),
+                         _mm256_cmpeq_epi8(_LOAD256(p + 1), s0)),
+        _mm256_and_si256(_mm256_cmpeq_epi8(_LOAD256(p + 2), s2),
+                         _mm256_cmpeq_epi8(_LOAD256(p + 3), s3))));
+    if (m) return i + __builtin_ctz(m);
+  }
+  return _sync_sse4(buf, len, i);
+}
+
+IX_TARGET("ssse3,sse4.1") static uint32_t
+_headers_sse4(const ix_packet_format* fmt, const uint8_t* buf, uint32_t len,
+              uint32_t i)
+{
+  uint8_t       table[16];
+  const __m128i lo4 = _mm_set1_epi8(0x0f);
+  __m128i       valid;
+  uint32_t      m, k;
+
+  _header_table(fmt, table);
+  valid = _LOAD(table);
+  for (; i + 16 <= len; i += 16) {
+    m = (uint32_t)_mm_movemask_epi8(_mm_shuffle_epi8(
+        valid, _mm_and_si128(_mm_srli_epi16(_LOAD(buf + i), 4), lo4)));
+    for (; m; m &= m - 1) {
+      k = i + __builtin_ctz(m);
+      if (_run_at(fmt, buf + k, len - k)) return k;
+    }
+  }
+  return _headers_scalar(fmt, buf, len, i);
+}
+
+IX_TARGET("avx2") static uint32_t
+_headers_avx2(const ix_packet_format* fmt, const uint8_t* buf, uint32_t len)
+{
+  uint8_t       table[16];
+  const __m256i lo4 = _mm256_set1_epi8(0x0f);
+  __m256i       valid;
+  uint32_t      i = 0, m, k;
+
+  _header_table(fmt, table);
+  valid = _mm256_broadcastsi128_si256(_LOAD(table));
+  for (; i + 32 <= len; i += 32) {
+    m = (uint32_t)_mm256_movemask_epi8(_mm256_shuffle_epi8(
+        valid, _mm256_and_si256(_mm256_srli_epi16(_LOAD256(buf + i), 4),
+                                lo4)));
+    for (; m; m &= m - 1) {
+      k = i + __builtin_ctz(m);
+      if (_run_at(fmt, buf + k, len - k)) return k;
+    }
+  }
+  return _headers_sse4(fmt, buf, len, i);
+}
+
+#endif  /* IX_RESYNC_X86 */
+
+
+static uint32_t
+_resync(ix_simd simd, const ix_packet_format* fmt, ix_resync_mode mode,
+        const uint8_t* buf, uint32_t len)
+{
+  ix_simd best = ix_simd_detect();
+
+  if (simd > best) simd = best;
+  if (mode == IX_RESYNC_HEADERS) {
+    switch (simd) {
+#ifdef IX_RESYNC_X86
+    case IX_SIMD_AVX2: return _headers_avx2(fmt, buf, len);
+    case IX_SIMD_SSE4: return _headers_sse4(fmt, buf, len, 0);
+#endif
+    default: return _headers_scalar(fmt, buf, len, 0);
+    }
+  }
+  switch (simd) {
+#ifdef IX_RESYNC_X86
+  case IX_SIMD_AVX2: return _sync_avx2(buf, len);
+  case IX_SIMD_SSE4: return _sync_sse4(buf, len, 0);
+#endif
+  default: return _sync_scalar(buf, len, 0);
+  }
+}
+
+uint32_t
+ix_resync_with(ix_simd simd, ix_resync_mode mode, const uint8_t* buf,
+               uint32_t len)
+{ return _resync(simd, ix_packet_format_eeg(4), mode, buf, len); }
+
+uint32_t
+ix_resync(ix_resync_mode mode, const uint8_t* buf, uint32_t len)
+{ return _resync(ix_simd_detect(), ix_packet_format_eeg(4), mode, buf, len); }
+
+uint32_t
+ix_resync_fmt(const ix_packet_format* fmt, ix_resync_mode mode,
+              const uint8_t* buf, uint32_t len)
+{ return _resync(ix_simd_detect(), fmt, mode, buf, len); }
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * include <stdint.h> for sized ints
+ * include "defs.h" for IX_EXPORT
+ * include "packet.h" for ix_packet_format
+ * include "unpack.h" for ix_simd
+ */
+
+/*
+ * Resynchronization after stream corruption.
+ *
+ * Once a stream is known to be corrupt there is no telling where the next
+ * packet starts. These functions scan ahead for a place to resume parsing,
+ * many bytes at a time, instead of retrying the parser at every offset.
+ */
+
+/*
+ * Resynchronization strategies.
+ *
+ * IX_RESYNC_SYNC resumes at the next sync packet. It is the only fully
+ * reliable anchor, but everything before the next sync packet is lost.
+ *
+ * IX_RESYNC_HEADERS resumes at the next offset where IX_RESYNC_RUN packets in
+ * a row parse, or where packets parse up to the end of the buffer. It loses
+ * less data, at the risk of locking on to packet-like garbage for a while.
+ */
+typedef enum {
+  IX_RESYNC_SYNC = 0,
+  IX_RESYNC_HEADERS
+} ix_resync_mode;
+
+enum { IX_RESYNC_RUN = 3u };
+
+/*
+ * Scan for a place to resume parsing.
+ *
+ * Returns the number of bytes at the start of buf to skip, which is len if
+ * there is nowhere to resume in buf. A return value less than len is either a
+ * place to resume, or the start of a tail that might become one once more
+ * data arrives (e.g. the first 3 bytes of a sync packet), in which case
+ * parsing from there reports a partial packet.
+ *
+ * buf[0] is a candidate like any other byte, so callers that know buf[0] to be
+ * corrupt should skip it first. If buf is NULL, len must be 0.
+ */
+IX_EXPORT
+uint32_t
+ix_resync(ix_resync_mode mode, const uint8_t* buf, uint32_t len);
+
+/*
+ * Scan with a specific instruction set level, clamped to ix_simd_detect().
+ */
+IX_EXPORT
+uint32_t
+ix_resync_with(ix_simd simd, ix_resync_mode mode, const uint8_t* buf,
+               uint32_t len);
+
+/*
+ * Scan for packets of a specific format. Only IX_RESYNC_HEADERS depends on
+ * the format.
+ */
+IX_EXPORT
+uint32_t
+ix_resync_fmt(const ix_packet_format* fmt, ix_resync_mode mode,
+              const uint8_t* buf, uint32_t len);
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * Single-producer, single-consumer byte ring.
+ *
+ * write and read only ever increase, and write - read is the number of bytes
+ * readable, so the producer owns [write, read + size) and the consumer owns
+ * [read, write). Each side publishes its own position with a release store
+ * once it is done with the bytes, and reads the other's with an acquire load
+ * only when its cached copy says there isn't enough room to fill the span it
+ * was asked for.
+ *
+ * Bytes written to the first IX_RING_SLACK bytes of the buffer are copied to
+ * just past its end before they are published. The producer can't overwrite
+ * either copy until the consumer has moved read past them.
+ */
+
+#ifndef IX_MUSE_CORE_H_
+#include <stdint.h>
+#include "defs.h"
+#include "packet.h"
+#include "unpack.h"
+#include "resync.h"
+#include "stats.h"
+#include "stream.h"
+#include "ring.h"
+#endif
+
+#ifndef IX_INTERNAL_H_
+#include "defs_internal.h"
+#endif
+
+#include <assert.h>
+#include <string.h>
+
+#define _MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/*
+ * Copy the part of [off, off + n) that falls in the slack to its mirror.
+ */
+static inline void
+_mirror(ix_ring* r, uint32_t off, uint32_t n)
+{
+  if (off < IX_RING_SLACK) {
+    memcpy(r->buf + r->size + off, r->buf + off,
+           _MIN(n, IX_RING_SLACK - off));
+  }
+}
+
+void
+ix_ring_init(ix_ring* r, uint8_t* buf, uint32_t size)
+{
+  assert(buf);
+  assert(size >= IX_RING_SLACK && size <= 0x80000000u);
+  assert(!(size & (size - 1)));
+  memset(r, 0, sizeof *r);
+  r->buf = buf;
+  r->size = size;
+}
+
+uint8_t*
+ix_ring_write_span(ix_ring* r, uint32_t* len)
+{
+  uint32_t off = r->write & (r->size - 1), room = r->size - off, free;
+
+  free = r->size - (r->write - r->read_seen);
+  if (free < room) {
+    r->read_seen = IX_LOAD_ACQUIRE(&r->read);
+    free = r->size - (r->write - r->read_seen);
+  }
+  *len = _MIN(free, room);
+  return r->buf + off;
+}
+
+void
+ix_ring_commit(ix_ring* r, uint32_t n)
+{
+  uint32_t off = r->write & (r->size - 1);
+
+  assert(n <= r->size - off);
+  assert(r->write - r->read_seen + n <= r->size);
+  _mirror(r, off, n);
+  IX_STORE_RELEASE(&r->write, r->write + n);
+}
+
+uint32_t
+ix_ring_write(ix_ring* r, const uint8_t* buf, uint32_t len)
+{
+  uint32_t off = r->write & (r->size - 1), free, n, first;
+
+  free = r->size - (r->write - r->read_seen);
+  if (free < len) {
+    r->read_seen = IX_LOAD_ACQUIRE(&r->read);
+    free = r->size - (r->write - r->read_seen);
+  }
+  n = _MIN(free, len);
+  if (!n) return 0;
+  first = _MIN(n, r->size - off);
+  memcpy(r->buf + off, buf, first);
+  _mirror(r, off, first);
+  if (n > first) {
+    memcpy(r->buf, buf + first, n - first);
+    _mirror(r, 0, n - first);
+  }
+  IX_STORE_RELEASE(&r->write, r->write + n);
+  return n;
+}
+
+const uint8_t*
+ix_ring_read_span(ix_ring* r, uint32_t* len)
+{
+  uint32_t off = r->read & (r->size - 1), room, avail;
+
+  room = r->size - off + IX_RING_SLACK;
+  avail = r->write_seen - r->read;
+  if (avail < room) {
+    r->write_seen = IX_LOAD_ACQUIRE(&r->write);
+    avail = r->write_seen - r->read;
+  }
+  *len = _MIN(avail, room);
+  return r->buf + off;
+}
+
+void
+ix_ring_consume(ix_ring* r, uint32_t n)
+{
+  assert(n <= r->write_seen - r->read);
+  IX_STORE_RELEASE(&r->read, r->read + n);
+}
+
+uint32_t
+ix_ring_drain(ix_ring* r, ix_stream* s)
+{
+  const uint8_t* p;
+  uint32_t       n, total = 0;
+
+  for (;;) {
+    p = ix_ring_read_span(r, &n);
+    if (!n) return total;
+    ix_stream_feed(s, p, n);
+    ix_ring_consume(r, n);
+    total += n;
+  }
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * include <stdint.h> for sized ints
+ * include "defs.h" for IX_EXPORT
+ * include "packet.h" for IX_PAC_MAXSIZE
+ * include "stream.h" for ix_stream
+ */
+
+/*
+ * Single-producer, single-consumer byte ring.
+ *
+ * An ix_ring hands bytes from the thread reading the link to the thread
+ * parsing them without locks. The reader writes straight into the ring and
+ * the parser reads straight out of it; each side costs one atomic load and
+ * at most one atomic store per chunk, and neither ever waits on the other.
+ * When the ring is full, writes come up short rather than block.
+ *
+ * The buffer has IX_RING_SLACK bytes past its end that mirror its start, so
+ * every readable span is contiguous even where it wraps around, and a packet
+ * straddling the end of the ring can be parsed in place.
+ *
+ * One thread may write and one other thread may read at a time; the ring
+ * never allocates.
+ */
+
+enum {
+  IX_RING_CACHELINE = 64u,
+  IX_RING_SLACK = IX_PAC_MAXSIZE
+};
+
+/*
+ * Bytes of buffer to allocate for a ring of the given size.
+ */
+#define IX_RING_BUFSIZE(size) ((size) + IX_RING_SLACK)
+
+/*
+ * Ring state. Fields are private.
+ *
+ * Positions count bytes since init, modulo 2^32. Each side's fields sit on
+ * their own cache line.
+ */
+typedef struct {
+  uint8_t* buf;
+  uint32_t size;
+  uint8_t  _pad0[IX_RING_CACHELINE - sizeof(uint8_t*) - sizeof(uint32_t)];
+
+  uint32_t write;       /* written by the producer */
+  uint32_t read_seen;   /* the producer's last look at read */
+  uint8_t  _pad1[IX_RING_CACHELINE - 2 * sizeof(uint32_t)];
+
+  uint32_t read;        /* written by the consumer */
+  uint32_t write_seen;  /* the consumer's last look at write */
+  uint8_t  _pad2[IX_RING_CACHELINE - 2 * sizeof(uint32_t)];
+} ix_ring;
+
+/*
+ * Initialize an empty ring over buf, which must hold IX_RING_BUFSIZE(size)
+ * bytes. size must be a power of two no less than IX_RING_SLACK and no more
+ * than 2^31.
+ */
+IX_EXPORT
+void
+ix_ring_init(ix_ring* r, uint8_t* buf, uint32_t size);
+
+/*
+ * Producer: return where to write the next bytes, and in *len how many bytes
+ * can be written there, which is 0 if the ring is full. Nothing is visible
+ * to the consumer until committed.
+ */
+IX_EXPORT
+uint8_t*
+ix_ring_write_span(ix_ring* r, uint32_t* len);
+
+/*
+ * Producer: publish the first n bytes of the last write span.
+ */
+IX_EXPORT
+void
+ix_ring_commit(ix_ring* r, uint32_t n);
+
+/*
+ * Producer: copy as much of buf into the ring as fits and publish it.
+ * Returns the number of bytes written.
+ */
+IX_EXPORT
+uint32_t
+ix_ring_write(ix_ring* r, const uint8_t* buf, uint32_t len);
+
+/*
+ * Consumer: return the next bytes to read, and in *len how many there are,
+ * which is 0 if the ring is empty. The span is contiguous across the end of
+ * the ring for up to IX_RING_SLACK bytes. It stays valid until consumed.
+ */
+IX_EXPORT
+const uint8_t*
+ix_ring_read_span(ix_ring* r, uint32_t* len);
+
+/*
+ * Consumer: release the first n bytes of the last read span to the producer.
+ */
+IX_EXPORT
+void
+ix_ring_consume(ix_ring* r, uint32_t n);
+
+/*
+ * Consumer: feed everything readable to s and consume it. Returns the number
+ * of bytes fed.
+ */
+IX_EXPORT
+uint32_t
+ix_ring_drain(ix_ring* r, ix_stream* s);
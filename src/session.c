@@ -0,0 +1,516 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * Columnar session files.
+ *
+ * Layout, all little-endian:
+ *
+ *   header   "MUSESESS", version, EEG channels, 6 zero bytes
+ *   blocks   bit-packed, in the order they filled up
+ *   index    one _ENTRY-byte entry per block, grouped by column, in order
+ *   columns  per column: first index entry, number of entries, values
+ *   footer   offset of the index, number of columns, 4 zero bytes,
+ *            "MUSESESS"
+ *
+ * An index entry is the block's offset, the column position of its first
+ * value, its first value, how many values it holds, the bit width of its
+ * deltas and its column. The block itself is just the zigzagged deltas
+ * between consecutive values, each in width bits, least significant bit
+ * first, so it is (n - 1) * width bits long. Everything needed to find and
+ * size a block is in the index, so opening a file checks every block
+ * without reading any of them.
+ *
+ * Values are at most 32 bits, so deltas are at most 33.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+
+#ifndef IX_MUSE_CORE_H_
+#include <stdint.h>
+#include "defs.h"
+#include "packet.h"
+#include "unpack.h"
+#include "resync.h"
+#include "stats.h"
+#include "stream.h"
+#include "capture.h"
+#include "session.h"
+#endif
+
+#ifndef IX_INTERNAL_H_
+#include "defs_internal.h"
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t k_magic[8] = { 'M', 'U', 'S', 'E', 'S', 'E', 'S', 'S' };
+
+enum {
+  _VERSION = 1,
+  _HEADER = 16,
+  _ENTRY = 24,
+  _COLUMN = 24,
+  _FOOTER = 24,
+  _MAX_WIDTH = 33,
+  _MAX_BLOCK_BYTES = ((IX_SESSION_BLOCK - 1) * _MAX_WIDTH + 7) / 8
+};
+
+typedef struct {
+  uint64_t offset;
+  uint64_t first;
+  uint32_t first_value;
+  uint16_t n;
+  uint8_t  width;
+  uint8_t  col;
+} _entry;
+
+struct _ix_session_writer {
+  FILE*    f;
+  int      err;
+  uint64_t off;
+  uint8_t  eeg_channels;
+  uint32_t vals[IX_N_COLS][IX_SESSION_BLOCK];
+  uint32_t n[IX_N_COLS];
+  uint64_t total[IX_N_COLS];
+  _entry*  entries;
+  uint64_t n_entries;
+  uint64_t cap_entries;
+  uint8_t  packed[_MAX_BLOCK_BYTES];
+};
+
+
+static inline void
+_put16(uint8_t* p, uint16_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void
+_put32(uint8_t* p, uint32_t v)
+{
+  _put16(p, (uint16_t)v);
+  _put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static inline void
+_put64(uint8_t* p, uint64_t v)
+{
+  _put32(p, (uint32_t)v);
+  _put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static inline uint16_t
+_get16(const uint8_t* p)
+{ return (uint16_t)(p[0] | p[1] << 8); }
+
+static inline uint32_t
+_get32(const uint8_t* p)
+{ return _get16(p) | (uint32_t)_get16(p + 2) << 16; }
+
+static inline uint64_t
+_get64(const uint8_t* p)
+{ return _get32(p) | (uint64_t)_get32(p + 4) << 32; }
+
+static inline uint64_t
+_zigzag(int64_t d)
+{ return (uint64_t)d << 1 ^ (uint64_t)(d >> 63); }
+
+static inline int64_t
+_unzigzag(uint64_t z)
+{ return (int64_t)(z >> 1) ^ -(int64_t)(z & 1); }
+
+static inline uint32_t
+_block_bytes(uint32_t n, uint8_t width)
+{ return ((n - 1) * width + 7) / 8; }
+
+static void
+_entry_get(const uint8_t* p, _entry* e)
+{
+  e->offset = _get64(p);
+  e->first = _get64(p + 8);
+  e->first_value = _get32(p + 16);
+  e->n = _get16(p + 20);
+  e->width = p[22];
+  e->col = p[23];
+}
+
+
+/*
+ * Writer.
+ */
+
+static void
+_write(ix_session_writer* w, const void* buf, size_t len)
+{
+  if (w->err) return;
+  if (fwrite(buf, 1, len, w->f) != len) {
+    w->err = errno ? errno : EIO;
+    return;
+  }
+  w->off += len;
+}
+
+/*
+ * Pack the deltas of n values, n >= 1, into w->packed. Returns their width.
+ */
+static uint8_t
+_pack(ix_session_writer* w, const uint32_t* v, uint32_t n)
+{
+  uint64_t max = 0, z, acc = 0;
+  uint32_t i, bits = 0, k = 0;
+  uint8_t  width = 0;
+
+  for (i = 1; i < n; i++) {
+    z = _zigzag((int64_t)v[i] - v[i - 1]);
+    if (z > max) max = z;
+  }
+  while (max >> width) width++;
+  for (i = 1; i < n; i++) {
+    acc |= _zigzag((int64_t)v[i] - v[i - 1]) << bits;
+    for (bits += width; bits >= 8; bits -= 8, acc >>= 8) {
+      w->packed[k++] = (uint8_t)acc;
+    }
+  }
+  if (bits) w->packed[k++] = (uint8_t)acc;
+  assert(k == _block_bytes(n, width));
+  return width;
+}
+
+static void
+_flush_col(ix_session_writer* w, uint8_t col)
+{
+  _entry*  e;
+  uint64_t cap;
+  uint32_t n = w->n[col];
+
+  if (!n) return;
+  w->n[col] = 0;
+  if (w->n_entries == w->cap_entries) {
+    cap = w->cap_entries ? 2 * w->cap_entries : 256;
+    e = realloc(w->entries, cap * sizeof *e);
+    if (!e) {
+      if (!w->err) w->err = ENOMEM;
+      return;
+    }
+    w->entries = e;
+    w->cap_entries = cap;
+  }
+  e = &w->entries[w->n_entries++];
+  e->offset = w->off;
+  e->first = w->total[col] - n;
+  e->first_value = w->vals[col][0];
+  e->n = (uint16_t)n;
+  e->col = col;
+  e->width = _pack(w, w->vals[col], n);
+  _write(w, w->packed, _block_bytes(n, e->width));
+}
+
+static inline void
+_push(ix_session_writer* w, uint8_t col, uint32_t v)
+{
+  w->vals[col][w->n[col]++] = v;
+  w->total[col]++;
+  if (w->n[col] == IX_SESSION_BLOCK) _flush_col(w, col);
+}
+
+ix_session_writer*
+ix_session_writer_new(const char* path, uint8_t eeg_channels)
+{
+  ix_session_writer* w;
+  uint8_t            header[_HEADER] = { 0 };
+
+  if (!ix_packet_format_eeg(eeg_channels)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  w = calloc(1, sizeof *w);
+  if (!w) return NULL;
+  w->f = fopen(path, "wb");
+  if (!w->f) {
+    free(w);
+    return NULL;
+  }
+  w->eeg_channels = eeg_channels;
+  memcpy(header, k_magic, sizeof k_magic);
+  header[8] = _VERSION;
+  header[9] = eeg_channels;
+  _write(w, header, sizeof header);
+  return w;
+}
+
+void
+ix_session_write(ix_session_writer* w, const ix_packet* p)
+{
+  const ix_samples_n* s = &p->samples_dropped.samples;
+  uint16_t            dropped = p->samples_dropped.dropped;
+  uint8_t             c;
+
+  switch (p->type) {
+  case IX_PAC_EEG:
+    if (dropped) {
+      _push(w, IX_COL_EEG_GAP_AT, (uint32_t)w->total[IX_COL_EEG1]);
+      _push(w, IX_COL_EEG_GAP_LEN, dropped);
+    }
+    for (c = 0; c < w->eeg_channels; c++) {
+      _push(w, IX_COL_EEG1 + c, c < s->n ? s->data[c] : 0);
+    }
+    break;
+  case IX_PAC_ACCELEROMETER:
+    if (dropped) {
+      _push(w, IX_COL_ACC_GAP_AT, (uint32_t)w->total[IX_COL_ACC1]);
+      _push(w, IX_COL_ACC_GAP_LEN, dropped);
+    }
+    for (c = 0; c < 3; c++) {
+      _push(w, IX_COL_ACC1 + c, s->data[c]);
+    }
+    break;
+  case IX_PAC_DRLREF:
+    _push(w, IX_COL_DRL, s->data[0]);
+    _push(w, IX_COL_REF, s->data[1]);
+    break;
+  case IX_PAC_BATTERY:
+    for (c = 0; c < 4; c++) {
+      _push(w, IX_COL_BATTERY_PERCENT + c, s->data[c]);
+    }
+    break;
+  case IX_PAC_SYNC:
+    _push(w, IX_COL_SYNC_AT, (uint32_t)w->total[IX_COL_EEG1]);
+    break;
+  default:
+    break;
+  }
+}
+
+void
+ix_session_writer_fn(const ix_packet* p, void* w)
+{ ix_session_write(w, p); }
+
+int
+ix_session_writer_free(ix_session_writer* w)
+{
+  uint8_t  buf[_ENTRY > _FOOTER ? _ENTRY : _FOOTER];
+  uint64_t index_off, first[IX_N_COLS], count[IX_N_COLS], i, k = 0;
+  uint8_t  col;
+  _entry*  e;
+  int      err;
+
+  for (col = 0; col < IX_N_COLS; col++) {
+    _flush_col(w, col);
+  }
+  index_off = w->off;
+  for (col = 0; col < IX_N_COLS; col++) {
+    first[col] = k;
+    count[col] = 0;
+    for (i = 0; i < w->n_entries; i++) {
+      e = &w->entries[i];
+      if (e->col != col) continue;
+      _put64(buf, e->offset);
+      _put64(buf + 8, e->first);
+      _put32(buf + 16, e->first_value);
+      _put16(buf + 20, e->n);
+      buf[22] = e->width;
+      buf[23] = e->col;
+      _write(w, buf, _ENTRY);
+      count[col]++;
+      k++;
+    }
+  }
+  for (col = 0; col < IX_N_COLS; col++) {
+    _put64(buf, first[col]);
+    _put64(buf + 8, count[col]);
+    _put64(buf + 16, w->total[col]);
+    _write(w, buf, _COLUMN);
+  }
+  _put64(buf, index_off);
+  _put32(buf + 8, IX_N_COLS);
+  _put32(buf + 12, 0);
+  memcpy(buf + 16, k_magic, sizeof k_magic);
+  _write(w, buf, _FOOTER);
+
+  if (fclose(w->f) && !w->err) w->err = errno ? errno : EIO;
+  err = w->err;
+  free(w->entries);
+  free(w);
+  return err;
+}
+
+
+/*
+ * Reader.
+ */
+
+/*
+ * Check a column's index entries against each other and the file.
+ */
+static bool
+_check_column(uint8_t col, const uint8_t* entries, uint64_t n_entries,
+              uint64_t len, uint64_t index_off)
+{
+  _entry   e;
+  uint64_t i, pos = 0;
+
+  for (i = 0; i < n_entries; i++) {
+    _entry_get(entries + i * _ENTRY, &e);
+    if (e.col != col || e.first != pos || !e.n || e.n > IX_SESSION_BLOCK ||
+        e.width > _MAX_WIDTH || e.offset < _HEADER || e.offset > index_off ||
+        _block_bytes(e.n, e.width) > index_off - e.offset) {
+      return false;
+    }
+    pos += e.n;
+  }
+  return pos == len;
+}
+
+int
+ix_session_open(ix_session* s, const char* path)
+{
+  const uint8_t* data;
+  const uint8_t* p;
+  uint64_t       len, index_off, cols_off, n_entries, first, count;
+  uint32_t       n_cols, col;
+  int            err;
+
+  memset(s, 0, sizeof *s);
+  err = ix_capture_open(&s->file, path);
+  if (err) return err;
+  data = ix_capture_data(&s->file);
+  len = ix_capture_len(&s->file);
+  if (len < _HEADER + _FOOTER || memcmp(data, k_magic, sizeof k_magic) ||
+      data[8] != _VERSION || !ix_packet_format_eeg(data[9]) ||
+      memcmp(data + len - sizeof k_magic, k_magic, sizeof k_magic)) {
+    goto invalid;
+  }
+  p = data + len - _FOOTER;
+  index_off = _get64(p);
+  n_cols = _get32(p + 8);
+  if (n_cols > (len - _HEADER - _FOOTER) / _COLUMN) goto invalid;
+  cols_off = len - _FOOTER - (uint64_t)n_cols * _COLUMN;
+  if (index_off < _HEADER || index_off > cols_off ||
+      (cols_off - index_off) % _ENTRY) {
+    goto invalid;
+  }
+  n_entries = (cols_off - index_off) / _ENTRY;
+
+  s->index = data + index_off;
+  s->cols = data + cols_off;
+  s->n_cols = n_cols < IX_N_COLS ? n_cols : IX_N_COLS;
+  s->eeg_channels = data[9];
+  for (col = 0; col < s->n_cols; col++) {
+    p = s->cols + col * _COLUMN;
+    first = _get64(p);
+    count = _get64(p + 8);
+    if (first > n_entries || count > n_entries - first ||
+        !_check_column((uint8_t)col, s->index + first * _ENTRY, count,
+                       _get64(p + 16), index_off)) {
+      goto invalid;
+    }
+  }
+  return 0;
+
+invalid:
+  ix_session_close(s);
+  return EINVAL;
+}
+
+void
+ix_session_close(ix_session* s)
+{
+  ix_capture_close(&s->file);
+  s->index = NULL;
+  s->cols = NULL;
+  s->n_cols = 0;
+}
+
+uint8_t
+ix_session_eeg_channels(const ix_session* s)
+{ return s->eeg_channels; }
+
+void
+ix_session_get_column(const ix_session* s, ix_session_col col,
+                      ix_session_column* c)
+{
+  const uint8_t* p;
+
+  c->data = ix_capture_data(&s->file);
+  if ((uint32_t)col >= s->n_cols) {
+    c->blocks = NULL;
+    c->n_blocks = 0;
+    c->len = 0;
+    return;
+  }
+  p = s->cols + col * _COLUMN;
+  c->blocks = s->index + _get64(p) * _ENTRY;
+  c->n_blocks = _get64(p + 8);
+  c->len = _get64(p + 16);
+}
+
+uint64_t
+ix_session_column_len(const ix_session_column* c)
+{ return c->len; }
+
+/*
+ * Decode a whole block into out.
+ */
+static void
+_unpack(const uint8_t* data, const _entry* e, uint32_t* out)
+{
+  const uint8_t* p = data + e->offset;
+  uint64_t       acc = 0, mask = ((uint64_t)1 << e->width) - 1;
+  uint32_t       i, bits = 0, v = e->first_value;
+
+  out[0] = v;
+  for (i = 1; i < e->n; i++) {
+    while (bits < e->width) {
+      acc |= (uint64_t)*p++ << bits;
+      bits += 8;
+    }
+    v = (uint32_t)(v + _unzigzag(acc & mask));
+    acc >>= e->width;
+    bits -= e->width;
+    out[i] = v;
+  }
+}
+
+uint32_t
+ix_session_column_read(const ix_session_column* c, uint64_t first,
+                       uint32_t n, uint32_t* out)
+{
+  uint32_t tmp[IX_SESSION_BLOCK], done = 0, skip, k;
+  uint64_t lo = 0, hi = c->n_blocks, mid;
+  _entry   e;
+
+  if (first >= c->len) return 0;
+  if (n > c->len - first) n = (uint32_t)(c->len - first);
+  /* Last block starting at or before first. */
+  while (hi - lo > 1) {
+    mid = lo + (hi - lo) / 2;
+    if (_get64(c->blocks + mid * _ENTRY + 8) <= first) lo = mid;
+    else hi = mid;
+  }
+  for (; done < n; lo++) {
+    _entry_get(c->blocks + lo * _ENTRY, &e);
+    skip = (uint32_t)(first + done - e.first);
+    k = e.n - skip < n - done ? e.n - skip : n - done;
+    if (!skip && k == e.n) {
+      _unpack(c->data, &e, out + done);
+    }
+    else {
+      _unpack(c->data, &e, tmp);
+      memcpy(out + done, tmp + skip, k * sizeof *out);
+    }
+    done += k;
+  }
+  return n;
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * include <stdint.h> for sized ints
+ * include "defs.h" for IX_EXPORT
+ * include "packet.h" for ix_packet
+ * include "capture.h" for ix_capture
+ */
+
+/*
+ * Columnar session files.
+ *
+ * A session file holds the parsed contents of one headset stream with every
+ * channel stored as its own column: each EEG channel, each accelerometer
+ * axis, DRL, REF and each battery field, plus where samples were dropped and
+ * where sync packets arrived. Columns are cut into blocks of up to
+ * IX_SESSION_BLOCK values, each stored as its first value and the
+ * differences from there on, bit-packed at the narrowest width that fits
+ * them. For slowly varying 10-bit EEG this is around half the size of the
+ * uncompressed packets it came from.
+ *
+ * An index at the end of the file records where every block is, so a
+ * reader can pick out a few channels, or a stretch of time, and decode only
+ * the blocks those cover. Everything is little-endian.
+ *
+ * POSIX only.
+ */
+
+/*
+ * Values per block.
+ */
+enum { IX_SESSION_BLOCK = 1024u };
+
+/*
+ * Columns.
+ *
+ * IX_COL_EEG_GAP_AT holds, for each run of dropped EEG samples, how many EEG
+ * samples came before it, and IX_COL_EEG_GAP_LEN how many were dropped;
+ * likewise for the accelerometer. IX_COL_SYNC_AT holds how many EEG samples
+ * came before each sync packet. EEG columns beyond the session's channel
+ * count are empty. Values are as ix_packet_ch returns them, so the battery
+ * temperature is an int16_t stored as its bit pattern.
+ */
+typedef enum {
+  IX_COL_EEG1 = 0,
+  IX_COL_EEG2,
+  IX_COL_EEG3,
+  IX_COL_EEG4,
+  IX_COL_EEG5,
+  IX_COL_EEG6,
+  IX_COL_EEG_GAP_AT,
+  IX_COL_EEG_GAP_LEN,
+  IX_COL_ACC1,
+  IX_COL_ACC2,
+  IX_COL_ACC3,
+  IX_COL_ACC_GAP_AT,
+  IX_COL_ACC_GAP_LEN,
+  IX_COL_DRL,
+  IX_COL_REF,
+  IX_COL_BATTERY_PERCENT,
+  IX_COL_BATTERY_FUEL_GAUGE_MV,
+  IX_COL_BATTERY_ADC_MV,
+  IX_COL_BATTERY_TEMP_C,
+  IX_COL_SYNC_AT,
+  IX_N_COLS
+} ix_session_col;
+
+typedef struct _ix_session_writer ix_session_writer;
+
+/*
+ * Create a session file at path for a headset sending eeg_channels channels
+ * of EEG. Returns NULL, with errno set, if the file can't be created.
+ */
+IX_EXPORT
+ix_session_writer*
+ix_session_writer_new(const char* path, uint8_t eeg_channels);
+
+/*
+ * Append a packet to the session. Error packets are not stored.
+ */
+IX_EXPORT
+void
+ix_session_write(ix_session_writer* w, const ix_packet* p);
+
+/*
+ * ix_packet_fn that appends packets to the ix_session_writer passed as
+ * user_data, e.g. to write everything a stream parses.
+ */
+IX_EXPORT
+void
+ix_session_writer_fn(const ix_packet* p, void* w);
+
+/*
+ * Write out the rest of the session and its index, close the file and free
+ * the writer. Returns 0, or the errno value of the first write that failed.
+ */
+IX_EXPORT
+int
+ix_session_writer_free(ix_session_writer* w);
+
+/*
+ * Open session file. Fields are private.
+ */
+typedef struct {
+  ix_capture     file;
+  const uint8_t* index;
+  const uint8_t* cols;
+  uint32_t       n_cols;
+  uint8_t        eeg_channels;
+} ix_session;
+
+/*
+ * One column of an open session. Fields are private.
+ */
+typedef struct {
+  const uint8_t* data;
+  const uint8_t* blocks;
+  uint64_t       n_blocks;
+  uint64_t       len;
+} ix_session_column;
+
+/*
+ * Map the session file at path and check its index. Returns 0 on success, or
+ * an errno value, EINVAL if it isn't a well-formed session file, in which
+ * case s is left closed.
+ */
+IX_EXPORT
+int
+ix_session_open(ix_session* s, const char* path);
+
+/*
+ * Unmap the file. Closing a closed session does nothing.
+ */
+IX_EXPORT
+void
+ix_session_close(ix_session* s);
+
+/*
+ * Return the number of EEG channels in the session.
+ */
+IX_EXPORT
+uint8_t
+ix_session_eeg_channels(const ix_session* s);
+
+/*
+ * Look up a column. The column stays valid until the session is closed.
+ */
+IX_EXPORT
+void
+ix_session_get_column(const ix_session* s, ix_session_col col,
+                      ix_session_column* c);
+
+/*
+ * Return the number of values in a column.
+ */
+IX_EXPORT
+uint64_t
+ix_session_column_len(const ix_session_column* c);
+
+/*
+ * Decode up to n values of a column, starting at value first, into out.
+ * Only the blocks that hold them are touched. Returns the number of values
+ * decoded, which is less than n only at the end of the column.
+ */
+IX_EXPORT
+uint32_t
+ix_session_column_read(const ix_session_column* c, uint64_t first,
+                       uint32_t n, uint32_t* out);
@@ -0,0 +1,471 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * Parallel parsing of large buffers.
+ *
+ * Chunk k nominally covers [k * size, (k + 1) * size), and really runs from
+ * the first sync word at or after its nominal start to the first one at or
+ * after the next chunk's. Workers claim chunks in order and parse each one as
+ * a stream would that was in step at its start, into the chunk's slot. The
+ * calling thread delivers slots in chunk order; at most n_slots chunks are
+ * parsed ahead of delivery, which bounds memory.
+ *
+ * A stream's state between packets is nothing but its position, as long as
+ * everything after that position is in view: there is no carry-over, and it
+ * is only resyncing if it has run off the end. So chunks are parsed with all
+ * of the rest of the buffer in view, and stop at the first packet boundary or
+ * resume point at or past their end. A chunk's output is right exactly when
+ * the chunk before it stopped at its start. Otherwise the calling thread
+ * parses the chunk again itself, from wherever the one before really stopped.
+ *
+ * Within a chunk, this is ix_stream_feed unrolled: ix_packet_parse_into
+ * decodes straight into the slot, and corrupt data is skipped with ix_resync
+ * exactly as the stream would.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#ifndef IX_MUSE_CORE_H_
+#include <stdint.h>
+#include "defs.h"
+#include "packet.h"
+#include "unpack.h"
+#include "resync.h"
+#include "stats.h"
+#include "stream.h"
+#include "split.h"
+#endif
+
+#ifndef IX_INTERNAL_H_
+#include "defs_internal.h"
+#endif
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Most bytes handed to the parse and resync functions at once.
+ */
+enum { _WINDOW = 1u << 30 };
+
+/*
+ * First packet buffer size of a slot; it doubles as needed.
+ */
+enum { _FIRST_CAP = 4096u };
+
+/*
+ * A skipped stretch, to be reported before packet number at of its output.
+ */
+typedef struct {
+  uint64_t offset;
+  uint32_t skipped;
+  uint32_t at;
+} _skip_rec;
+
+/*
+ * Where a range's packets and skips go. Buffered outputs grow to hold
+ * everything until delivered; direct ones hand everything to the stream's
+ * callbacks as soon as they fill up. Parse failures are tallied alongside,
+ * and only reach the stream's statistics when the rest is delivered.
+ */
+typedef struct {
+  ix_stream*  s;
+  bool        direct;
+  bool        failed;  /* out of memory; contents are incomplete */
+  ix_packet*  pacs;
+  uint32_t    n_pacs;
+  uint32_t    cap_pacs;
+  _skip_rec*  skips;
+  uint32_t    n_skips;
+  uint32_t    cap_skips;
+  uint64_t    corrupt;
+  uint64_t    bad_len;
+} _out;
+
+typedef struct {
+  _out     out;
+  uint64_t start;
+  uint64_t stop;
+  uint64_t end;        /* where parsing the chunk stopped */
+  bool     resyncing;  /* it stopped skipping off the end of buf */
+  bool     done;
+} _slot;
+
+typedef struct {
+  ix_stream*       s;
+  const uint8_t*   buf;
+  uint64_t         len;
+  uint64_t         size;
+  uint64_t         n_chunks;
+  _slot*           slots;
+  uint32_t         n_slots;
+  pthread_t*       threads;
+  uint32_t         n_started;
+  pthread_mutex_t  lock;       /* guards everything below, and slot done */
+  pthread_cond_t   done_cond;  /* signaled when a slot is done */
+  pthread_cond_t   free_cond;  /* signaled when a slot is delivered */
+  uint64_t         next;       /* next chunk to claim */
+  uint64_t         delivered;  /* chunks delivered */
+} _split;
+
+
+static inline uint32_t
+_view(uint64_t n)
+{ return n < _WINDOW ? (uint32_t)n : _WINDOW; }
+
+/*
+ * Offset of the first whole sync word in buf at or after from, or len.
+ */
+static uint64_t
+_next_sync(const uint8_t* buf, uint64_t len, uint64_t from)
+{
+  uint32_t view, k;
+
+  while (from < len) {
+    view = _view(len - from);
+    k = ix_resync(IX_RESYNC_SYNC, buf + from, view);
+    if (k + 4 <= view) return from + k;
+    if (from + view == len) break;
+    /* Rescan a partial match at the end of the window. */
+    from += k;
+  }
+  return len;
+}
+
+static void
+_flush(_out* o)
+{
+  ix_stream* s = o->s;
+  uint32_t   i, k = 0;
+
+  ix_stats_count(&s->stats, o->pacs, o->n_pacs);
+  IX_COUNT(&s->stats.corrupt, o->corrupt);
+  IX_COUNT(&s->stats.bad_len, o->bad_len);
+  for (i = 0; i <= o->n_pacs; i++) {
+    for (; k < o->n_skips && o->skips[k].at == i; k++) {
+      if (s->corrupt_f) {
+        s->corrupt_f(o->skips[k].offset, o->skips[k].skipped, s->user_data);
+      }
+      IX_COUNT(&s->stats.skipped, o->skips[k].skipped);
+    }
+    if (i < o->n_pacs) s->pac_f(&o->pacs[i], s->user_data);
+  }
+  o->n_pacs = 0;
+  o->n_skips = 0;
+  o->corrupt = 0;
+  o->bad_len = 0;
+}
+
+/*
+ * Make room for at least one more packet.
+ */
+static bool
+_room(_out* o)
+{
+  ix_packet* p;
+  uint32_t   cap;
+
+  if (o->n_pacs < o->cap_pacs) return true;
+  if (o->direct) {
+    _flush(o);
+    return true;
+  }
+  cap = o->cap_pacs ? 2 * o->cap_pacs : _FIRST_CAP;
+  p = realloc(o->pacs, cap * sizeof *p);
+  if (!p) {
+    o->failed = true;
+    return false;
+  }
+  o->pacs = p;
+  o->cap_pacs = cap;
+  return true;
+}
+
+static bool
+_skip(_out* o, uint64_t off, uint32_t n)
+{
+  _skip_rec* p;
+  uint32_t   cap;
+
+  if (o->n_skips == o->cap_skips) {
+    if (o->direct) _flush(o);
+    else {
+      cap = o->cap_skips ? 2 * o->cap_skips : 16;
+      p = realloc(o->skips, cap * sizeof *p);
+      if (!p) {
+        o->failed = true;
+        return false;
+      }
+      o->skips = p;
+      o->cap_skips = cap;
+    }
+  }
+  p = &o->skips[o->n_skips++];
+  p->offset = o->s->pos + off;
+  p->skipped = n;
+  p->at = o->n_pacs;
+  return true;
+}
+
+/*
+ * Skip corrupt data at off, resyncing from from on, and return where parsing
+ * resumes. Sets *resyncing if nowhere turns up before the end of buf.
+ */
+static uint64_t
+_skip_corrupt(_out* o, const uint8_t* buf, uint64_t len, uint64_t off,
+              uint64_t from, bool* resyncing)
+{
+  const ix_stream* s = o->s;
+  uint32_t         view, k;
+
+  for (;;) {
+    view = _view(len - from);
+    k = ix_resync_fmt(s->fmt, s->resync, buf + from, view);
+    from += k;
+    if (k < view || from == len) break;
+  }
+  *resyncing = from == len;
+  while (off < from) {
+    if (!_skip(o, off, _view(from - off))) break;
+    off += _view(from - off);
+  }
+  return from;
+}
+
+/*
+ * Parse buf from off, where a stream would be in step, up to stop. Returns
+ * where the stream carries on from: stop, if a packet or resume point falls
+ * exactly there; past stop, if a packet or corrupt stretch runs over it; or
+ * before stop if the rest of buf is only the start of a packet. Sets
+ * *resyncing if it ends skipping off the end of buf.
+ */
+static uint64_t
+_parse_range(_out* o, const uint8_t* buf, uint64_t len, uint64_t off,
+             uint64_t stop, bool* resyncing)
+{
+  const ix_stream* s = o->s;
+  ix_parse_status  st;
+  uint64_t         end;
+  uint32_t         n, used;
+
+  while (off < stop) {
+    *resyncing = false;
+    if (!_room(o)) return off;
+    end = off + _view(stop - off);
+    st = ix_packet_parse_into_fmt(s->fmt, buf + off, (uint32_t)(end - off),
+                                  o->pacs + o->n_pacs,
+                                  o->cap_pacs - o->n_pacs, &n, &used);
+    o->n_pacs += n;
+    off += used;
+    if (st == IX_PARSE_END || st == IX_PARSE_FULL) continue;
+    if (st == IX_PARSE_PARTIAL) {
+      if (end < stop) continue;
+      if (end == len) return off;
+      /* Cut off by stop, not the end of buf: look past it. */
+      if (!_room(o)) return off;
+      end = off + _view(len - off < 2 * IX_PAC_MAXSIZE ?
+                        len - off : 2 * IX_PAC_MAXSIZE);
+      st = ix_packet_parse_into_fmt(s->fmt, buf + off, (uint32_t)(end - off),
+                                    o->pacs + o->n_pacs, 1, &n, &used);
+      if (n) {
+        o->n_pacs += n;
+        return off + used;
+      }
+      if (st == IX_PARSE_PARTIAL) {
+        assert(end == len);
+        return off;
+      }
+    }
+#ifndef IX_NO_STATS
+    o->corrupt++;
+    o->bad_len += !ix_packet_est_len_fmt(s->fmt, buf + off, _view(len - off));
+#endif
+    off = _skip_corrupt(o, buf, len, off, off + 1, resyncing);
+    if (o->failed) return off;
+  }
+  return off;
+}
+
+static void
+_parse_chunk(_split* sp, _slot* sl, uint64_t k)
+{
+  sl->start = k ? _next_sync(sp->buf, sp->len, k * sp->size) : 0;
+  sl->stop = k + 1 < sp->n_chunks ?
+             _next_sync(sp->buf, sp->len, (k + 1) * sp->size) : sp->len;
+  sl->out.n_pacs = 0;
+  sl->out.n_skips = 0;
+  sl->out.corrupt = 0;
+  sl->out.bad_len = 0;
+  sl->out.failed = false;
+  sl->resyncing = false;
+  sl->end = _parse_range(&sl->out, sp->buf, sp->len, sl->start, sl->stop,
+                         &sl->resyncing);
+}
+
+static void*
+_work(void* arg)
+{
+  _split*  sp = arg;
+  _slot*   sl;
+  uint64_t k;
+
+  pthread_mutex_lock(&sp->lock);
+  for (;;) {
+    while (sp->next < sp->n_chunks &&
+           sp->next >= sp->delivered + sp->n_slots) {
+      pthread_cond_wait(&sp->free_cond, &sp->lock);
+    }
+    if (sp->next == sp->n_chunks) break;
+    k = sp->next++;
+    pthread_mutex_unlock(&sp->lock);
+
+    sl = &sp->slots[k % sp->n_slots];
+    _parse_chunk(sp, sl, k);
+
+    pthread_mutex_lock(&sp->lock);
+    sl->done = true;
+    pthread_cond_broadcast(&sp->done_cond);
+  }
+  pthread_mutex_unlock(&sp->lock);
+  return NULL;
+}
+
+static void
+_free(_split* sp)
+{
+  uint32_t i;
+
+  for (i = 0; i < sp->n_started; i++) {
+    pthread_join(sp->threads[i], NULL);
+  }
+  for (i = 0; sp->slots && i < sp->n_slots; i++) {
+    free(sp->slots[i].out.pacs);
+    free(sp->slots[i].out.skips);
+  }
+  pthread_cond_destroy(&sp->free_cond);
+  pthread_cond_destroy(&sp->done_cond);
+  pthread_mutex_destroy(&sp->lock);
+  free(sp->slots);
+  free(sp->threads);
+}
+
+/*
+ * Start the workers. False if none could be started.
+ */
+static bool
+_start(_split* sp, uint32_t n_workers)
+{
+  uint32_t i;
+
+  pthread_mutex_init(&sp->lock, NULL);
+  pthread_cond_init(&sp->done_cond, NULL);
+  pthread_cond_init(&sp->free_cond, NULL);
+  sp->n_slots = 2 * n_workers;
+  sp->slots = calloc(sp->n_slots, sizeof *sp->slots);
+  sp->threads = calloc(n_workers, sizeof *sp->threads);
+  if (!sp->slots || !sp->threads) goto fail;
+  for (i = 0; i < sp->n_slots; i++) {
+    sp->slots[i].out.s = sp->s;
+  }
+  for (i = 0; i < n_workers; i++) {
+    if (pthread_create(&sp->threads[i], NULL, _work, sp)) break;
+    sp->n_started++;
+  }
+  if (sp->n_started) return true;
+
+fail:
+  _free(sp);
+  return false;
+}
+
+uint64_t
+ix_split_feed(ix_stream* s, const uint8_t* buf, uint64_t len,
+              uint32_t n_workers, uint32_t chunk_size)
+{
+  _split    sp;
+  _slot*    sl;
+  _out      direct;
+  ix_packet batch[IX_PARSE_BATCH];
+  _skip_rec skip;
+  uint64_t  pos = 0, redone = 0, k;
+  long      n_cpus;
+  bool      resyncing;
+
+  assert(!s->carry_len);
+  if (!len) return 0;
+  IX_COUNT(&s->stats.bytes, len);
+  if (!n_workers) {
+    n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    n_workers = n_cpus > 0 ? (uint32_t)n_cpus : 1;
+  }
+  memset(&sp, 0, sizeof sp);
+  sp.s = s;
+  sp.buf = buf;
+  sp.len = len;
+  sp.size = chunk_size ? chunk_size : IX_SPLIT_CHUNK;
+  sp.n_chunks = (len + sp.size - 1) / sp.size;
+  if (n_workers > sp.n_chunks) n_workers = (uint32_t)sp.n_chunks;
+
+  memset(&direct, 0, sizeof direct);
+  direct.s = s;
+  direct.direct = true;
+  direct.pacs = batch;
+  direct.cap_pacs = IX_PARSE_BATCH;
+  direct.skips = &skip;
+  direct.cap_skips = 1;
+
+  resyncing = s->resyncing;
+  if (resyncing) pos = _skip_corrupt(&direct, buf, len, 0, 0, &resyncing);
+
+  if (n_workers > 1 && _start(&sp, n_workers)) {
+    for (k = 0; k < sp.n_chunks; k++) {
+      sl = &sp.slots[k % sp.n_slots];
+      pthread_mutex_lock(&sp.lock);
+      while (!sl->done) {
+        pthread_cond_wait(&sp.done_cond, &sp.lock);
+      }
+      pthread_mutex_unlock(&sp.lock);
+
+      if (sl->start < sl->stop && pos >= sl->start && pos < sl->stop) {
+        if (pos == sl->start && !sl->out.failed) {
+          _flush(&direct);
+          _flush(&sl->out);
+          pos = sl->end;
+          resyncing = sl->resyncing;
+        }
+        else {
+          redone += pos != sl->start;
+          pos = _parse_range(&direct, buf, len, pos, sl->stop, &resyncing);
+        }
+      }
+
+      pthread_mutex_lock(&sp.lock);
+      sl->done = false;
+      sp.delivered++;
+      pthread_cond_broadcast(&sp.free_cond);
+      pthread_mutex_unlock(&sp.lock);
+    }
+    _free(&sp);
+  }
+  else {
+    pos = _parse_range(&direct, buf, len, pos, len, &resyncing);
+  }
+  _flush(&direct);
+
+  /* Leave s as ix_stream_feed64 would have. */
+  assert(len - pos < IX_PAC_MAXSIZE);
+  memcpy(s->carry, buf + pos, (size_t)(len - pos));
+  s->carry_len = (uint32_t)(len - pos);
+  s->pos += pos;
+  s->resyncing = resyncing;
+  return redone;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * include <stdint.h> for sized ints
+ * include "defs.h" for IX_EXPORT
+ * include "stream.h" for ix_stream
+ */
+
+/*
+ * Parallel parsing of large buffers.
+ *
+ * Where a packet starts is normally only known once everything before it has
+ * been parsed, but sync packets make good guesses. ix_split_feed cuts a
+ * buffer, e.g. a whole mapped capture file, into chunks that start at sync
+ * words, parses the chunks on a pool of threads, and delivers the results in
+ * order. A sync word can also turn up inside some other packet, so every
+ * chunk boundary is checked against where parsing the chunk before it
+ * actually ended; a chunk that turns out to start mid-packet is parsed again
+ * from the right place.
+ *
+ * The result is exactly that of feeding the whole buffer to the stream with
+ * ix_stream_feed64: the same packets and corrupt stretches, in the same order,
+ * and the same stream state afterwards. All callbacks run on the calling
+ * thread.
+ *
+ * Unlike the stream itself this allocates: room for each chunk's packets
+ * until they are delivered. POSIX only.
+ */
+
+/*
+ * Default nominal chunk size in bytes.
+ */
+enum { IX_SPLIT_CHUNK = 1u << 20 };
+
+/*
+ * Feed buf to s, parsing on n_workers threads, or one per online CPU if
+ * n_workers is 0, in chunks of about chunk_size bytes, or IX_SPLIT_CHUNK if
+ * chunk_size is 0.
+ *
+ * s must have nothing pending; see ix_stream_pending. Parses serially on the
+ * calling thread if there is only one chunk or worker, or if the threads or
+ * their memory can't be had.
+ *
+ * Returns how many chunks were found not to start on a packet boundary and
+ * were parsed again.
+ */
+IX_EXPORT
+uint64_t
+ix_split_feed(ix_stream* s, const uint8_t* buf, uint64_t len,
+              uint32_t n_workers, uint32_t chunk_size);
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * Parser statistics.
+ *
+ * ix_stats_count tallies a batch in locals and stores each counter once, so
+ * what it costs per packet is an increment and a compare.
+ */
+
+#ifndef IX_MUSE_CORE_H_
+#include <stdint.h>
+#include "defs.h"
+#include "packet.h"
+#include "stats.h"
+#endif
+
+#ifndef IX_INTERNAL_H_
+#include "defs_internal.h"
+#endif
+
+#include <string.h>
+
+void
+ix_stats_count(ix_stats* st, const ix_packet* ps, uint32_t n)
+{
+#ifdef IX_NO_STATS
+  IX_UNUSED(st);
+  IX_UNUSED(ps);
+  IX_UNUSED(n);
+#else
+  uint32_t packets[IX_PAC_DRLREF + 1];
+  uint64_t eeg_dropped = 0, acc_dropped = 0;
+  uint32_t i;
+
+  memset(packets, 0, sizeof packets);
+  for (i = 0; i < n; i++) {
+    packets[ps[i].type]++;
+    if (ps[i].type == IX_PAC_EEG) {
+      eeg_dropped += ps[i].samples_dropped.dropped;
+    }
+    else if (ps[i].type == IX_PAC_ACCELEROMETER) {
+      acc_dropped += ps[i].samples_dropped.dropped;
+    }
+  }
+  for (i = 0; i <= IX_PAC_DRLREF; i++) {
+    if (packets[i]) IX_COUNT(&st->packets[i], packets[i]);
+  }
+  if (eeg_dropped) IX_COUNT(&st->eeg_dropped, eeg_dropped);
+  if (acc_dropped) IX_COUNT(&st->acc_dropped, acc_dropped);
+#endif
+}
+
+void
+ix_stats_add(ix_stats* total, const ix_stats* st)
+{
+  uint32_t i;
+
+  total->bytes += IX_LOAD_RELAXED(&st->bytes);
+  for (i = 0; i <= IX_PAC_DRLREF; i++) {
+    total->packets[i] += IX_LOAD_RELAXED(&st->packets[i]);
+  }
+  total->corrupt += IX_LOAD_RELAXED(&st->corrupt);
+  total->bad_len += IX_LOAD_RELAXED(&st->bad_len);
+  total->skipped += IX_LOAD_RELAXED(&st->skipped);
+  total->eeg_dropped += IX_LOAD_RELAXED(&st->eeg_dropped);
+  total->acc_dropped += IX_LOAD_RELAXED(&st->acc_dropped);
+}
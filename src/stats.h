@@ -0,0 +1,58 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * include <stdint.h> for sized ints
+ * include "defs.h" for IX_EXPORT
+ * include "packet.h" for ix_packet, IX_PAC_DRLREF
+ */
+
+/*
+ * Parser statistics.
+ *
+ * Every ix_stream keeps counters of what it has parsed, and ix_stream_stats
+ * and ix_engine_stats take snapshots of them. Counters are only ever written
+ * by the thread parsing their stream, with plain relaxed stores, so keeping
+ * them costs a handful of uncontended adds per batch of packets, and a
+ * snapshot can be taken from any thread at any time without stopping the
+ * parser. A snapshot taken while parsing is underway may be a batch behind
+ * on some counters and not others.
+ *
+ * Building the library with -DIX_NO_STATS compiles the counters out
+ * entirely; snapshots are then all zero.
+ */
+
+/*
+ * Counters. packets is indexed by packet type, e.g. packets[IX_PAC_EEG].
+ * corrupt counts the times parsing failed, bad_len the failures where
+ * ix_packet_est_len could not even give a length, and skipped the bytes
+ * skipped over as a result.
+ */
+typedef struct {
+  uint64_t bytes;
+  uint64_t packets[IX_PAC_DRLREF + 1];
+  uint64_t corrupt;
+  uint64_t bad_len;
+  uint64_t skipped;
+  uint64_t eeg_dropped;
+  uint64_t acc_dropped;
+} ix_stats;
+
+/*
+ * Count n parsed packets in st. Only the thread that owns st may call this.
+ */
+IX_EXPORT
+void
+ix_stats_count(ix_stats* st, const ix_packet* ps, uint32_t n);
+
+/*
+ * Add a snapshot of st, which may be being counted on another thread, to
+ * total.
+ */
+IX_EXPORT
+void
+ix_stats_add(ix_stats* total, const ix_stats* st);
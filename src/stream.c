@@ -0,0 +1,258 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * Incremental packet stream.
+ *
+ * s->pos is the stream offset of the first byte not yet consumed, which is
+ * carry[0] whenever carry_len is nonzero. A chunk is handled in two phases:
+ * first, bytes from the front of the chunk are appended to the carry-over
+ * until the packet in it either completes or turns out to be corrupt; then the
+ * rest of the chunk is parsed in place with ix_packet_parse_all, and any
+ * partial packet at its end becomes the new carry-over.
+ *
+ * After corrupt data the stream skips ahead with ix_resync. If no place to
+ * resume turns up before the end of a chunk, s->resyncing carries the search
+ * over into the next one.
+ *
+ * Packets parsed in place come in batches, which are counted in s->stats
+ * before being handed to pac_f one by one.
+ */
+
+#ifndef IX_MUSE_CORE_H_
+#include <stdint.h>
+#include "defs.h"
+#include "packet.h"
+#include "unpack.h"
+#include "resync.h"
+#include "stats.h"
+#include "stream.h"
+#endif
+
+#ifndef IX_INTERNAL_H_
+#include "defs_internal.h"
+#endif
+
+#include <assert.h>
+#include <string.h>
+
+/*
+ * Largest piece ix_stream_feed64 hands to ix_stream_feed. Only a packet split
+ * between pieces is ever copied, so any size this large costs nothing.
+ */
+enum { IX_STREAM_MAXFEED = 1u << 30 };
+
+/*
+ * Number of bytes to skip at the start of buf, which is known to be corrupt:
+ * the first byte, and then everything up to where the stream's resync mode
+ * says to resume. Counts the parse failure.
+ */
+static uint32_t
+_skip_len(ix_stream* s, const uint8_t* buf, uint32_t len)
+{
+  IX_COUNT(&s->stats.corrupt, 1);
+#ifndef IX_NO_STATS
+  if (!ix_packet_est_len_fmt(s->fmt, buf, len)) {
+    IX_COUNT(&s->stats.bad_len, 1);
+  }
+#endif
+  return 1 + ix_resync_fmt(s->fmt, s->resync, buf + 1, len - 1);
+}
+
+static void
+_skip(ix_stream* s, uint32_t n)
+{
+  if (s->corrupt_f) {
+    s->corrupt_f(s->pos, n, s->user_data);
+  }
+  IX_COUNT(&s->stats.skipped, n);
+  s->pos += n;
+}
+
+static void
+_deliver(const ix_packet* ps, uint32_t n, void* user_data)
+{
+  ix_stream* s = user_data;
+  uint32_t   i;
+
+  ix_stats_count(&s->stats, ps, n);
+  for (i = 0; i < n; i++) s->pac_f(&ps[i], s->user_data);
+}
+
+static ix_parse_status
+_parse_all(ix_stream* s, const uint8_t* buf, uint32_t len, uint32_t* used)
+{
+#ifdef IX_NO_STATS
+  return ix_packet_parse_all_fmt(s->fmt, buf, len, s->pac_f, s->user_data,
+                                 used);
+#else
+  return ix_packet_parse_all_batch_fmt(s->fmt, buf, len, _deliver, s, used);
+#endif
+}
+
+void
+ix_stream_init(ix_stream* s, ix_packet_fn pac_f, ix_corrupt_fn corrupt_f,
+               void* user_data)
+{
+  assert(pac_f);
+  s->pac_f = pac_f;
+  s->corrupt_f = corrupt_f;
+  s->user_data = user_data;
+  s->fmt = ix_packet_format_eeg(4);
+  s->resync = IX_RESYNC_HEADERS;
+  s->resyncing = 0;
+  s->pos = 0;
+  s->carry_len = 0;
+  memset(&s->stats, 0, sizeof s->stats);
+}
+
+/*
+ * Try to complete the carried over packet with bytes from the front of buf.
+ * Returns the number of bytes of buf used up, or len if they all went into
+ * the carry-over and it still holds a partial packet. Leaves the stream
+ * resyncing if the corrupt stretch runs on past the carry-over into buf.
+ */
+static uint32_t
+_finish_carry(ix_stream* s, const uint8_t* buf, uint32_t len)
+{
+  ix_parse_status st;
+  ix_packet       pac;
+  uint32_t        take, n, used, k;
+
+  while (s->carry_len) {
+    take = IX_PAC_MAXSIZE - s->carry_len;
+    if (take > len) take = len;
+    memcpy(s->carry + s->carry_len, buf, take);
+    st = ix_packet_parse_into_fmt(s->fmt, s->carry, s->carry_len + take,
+                                  &pac, 1, &n, &used);
+    if (n) {
+      _deliver(&pac, 1, s);
+      s->pos += used;
+      if (used >= s->carry_len) {
+        k = used - s->carry_len;
+        s->carry_len = 0;
+        return k;
+      }
+      /* Only possible after skipping corrupt bytes at the front. */
+      s->carry_len -= used;
+      memmove(s->carry, s->carry + used, s->carry_len);
+      continue;
+    }
+    if (st == IX_PARSE_PARTIAL) {
+      assert(take == len);
+      s->carry_len += take;
+      return len;
+    }
+    /*
+     * Corrupt: skip from the front of the carry-over only. Any bytes of buf
+     * that are skipped will be reported by the in-place phase.
+     */
+    k = _skip_len(s, s->carry, s->carry_len + take);
+    if (k >= s->carry_len) {
+      s->resyncing = k > s->carry_len;
+      _skip(s, s->carry_len);
+      s->carry_len = 0;
+      break;
+    }
+    _skip(s, k);
+    s->carry_len -= k;
+    memmove(s->carry, s->carry + k, s->carry_len);
+  }
+  return 0;
+}
+
+void
+ix_stream_feed(ix_stream* s, const uint8_t* buf, uint32_t len)
+{
+  ix_parse_status st;
+  uint32_t        used;
+
+  if (len == 0) return;
+  IX_COUNT(&s->stats.bytes, len);
+  used = _finish_carry(s, buf, len);
+  if (used == len) return;
+  buf += used;
+  len -= used;
+  if (s->resyncing) {
+    used = ix_resync_fmt(s->fmt, s->resync, buf, len);
+    s->resyncing = used == len;
+    if (used) {
+      _skip(s, used);
+      buf += used;
+      len -= used;
+    }
+  }
+  for (;;) {
+    st = _parse_all(s, buf, len, &used);
+    s->pos += used;
+    buf += used;
+    len -= used;
+    switch (st) {
+    case IX_PARSE_PARTIAL:
+      assert(len < IX_PAC_MAXSIZE);
+      memcpy(s->carry, buf, len);
+      s->carry_len = len;
+      return;
+    case IX_PARSE_CORRUPT:
+      used = _skip_len(s, buf, len);
+      s->resyncing = used == len;
+      _skip(s, used);
+      buf += used;
+      len -= used;
+      break;
+    default:
+      return;
+    }
+  }
+}
+
+void
+ix_stream_feed64(ix_stream* s, const uint8_t* buf, uint64_t len)
+{
+  uint32_t n;
+
+  while (len) {
+    n = len < IX_STREAM_MAXFEED ? (uint32_t)len : IX_STREAM_MAXFEED;
+    ix_stream_feed(s, buf, n);
+    buf += n;
+    len -= n;
+  }
+}
+
+void
+ix_stream_set_format(ix_stream* s, const ix_packet_format* fmt)
+{
+  assert(fmt);
+  s->fmt = fmt;
+}
+
+void
+ix_stream_set_resync(ix_stream* s, ix_resync_mode mode)
+{ s->resync = mode; }
+
+uint32_t
+ix_stream_pending(const ix_stream* s)
+{ return s->carry_len; }
+
+uint64_t
+ix_stream_offset(const ix_stream* s)
+{ return s->pos + s->carry_len; }
+
+void
+ix_stream_reset(ix_stream* s)
+{
+  s->pos += s->carry_len;
+  s->carry_len = 0;
+  s->resyncing = 0;
+}
+
+void
+ix_stream_stats(const ix_stream* s, ix_stats* out)
+{
+  memset(out, 0, sizeof *out);
+  ix_stats_add(out, &s->stats);
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * include <stdint.h> for sized ints
+ * include "defs.h" for IX_EXPORT
+ * include "packet.h" for ix_packet_fn, ix_packet_format, IX_PAC_MAXSIZE
+ * include "resync.h" for ix_resync_mode
+ * include "stats.h" for ix_stats
+ */
+
+/*
+ * Incremental packet stream.
+ *
+ * An ix_stream turns a byte stream delivered in arbitrarily sized chunks, as
+ * it comes off a link, into packets. Complete packets are parsed in place out
+ * of each chunk; only a packet split across two chunks is ever copied, into a
+ * fixed carry-over buffer of at most IX_PAC_MAXSIZE bytes. Corrupt data is
+ * skipped and reported.
+ *
+ * A stream never allocates, and is exactly as reentrant as its callbacks.
+ */
+
+/*
+ * Corruption callback function type.
+ *
+ * Called when the stream skips skipped bytes of corrupt data starting at
+ * offset bytes from the start of the stream. One corrupt stretch may be
+ * reported in several consecutive pieces.
+ */
+typedef void (*ix_corrupt_fn)(uint64_t offset, uint32_t skipped,
+                              void* user_data);
+
+/*
+ * Stream state. Fields are private.
+ */
+typedef struct {
+  ix_packet_fn            pac_f;
+  ix_corrupt_fn           corrupt_f;
+  void*                   user_data;
+  const ix_packet_format* fmt;
+  ix_resync_mode          resync;
+  uint8_t                 resyncing;
+  uint64_t                pos;
+  uint32_t                carry_len;
+  uint8_t                 carry[IX_PAC_MAXSIZE];
+  ix_stats                stats;
+} ix_stream;
+
+/*
+ * Initialize a stream.
+ *
+ * pac_f is called with every packet and corrupt_f, which may be NULL, with
+ * every stretch of skipped data. Both get user_data. The stream expects the
+ * 4-channel EEG preset and resyncs with IX_RESYNC_HEADERS until told
+ * otherwise.
+ */
+IX_EXPORT
+void
+ix_stream_init(ix_stream* s, ix_packet_fn pac_f, ix_corrupt_fn corrupt_f,
+               void* user_data);
+
+/*
+ * Set the packet format of the stream, e.g. ix_packet_format_eeg(6) for a
+ * headset sending 6 channels of EEG.
+ */
+IX_EXPORT
+void
+ix_stream_set_format(ix_stream* s, const ix_packet_format* fmt);
+
+/*
+ * Choose how the stream resumes after corrupt data. See ix_resync_mode.
+ */
+IX_EXPORT
+void
+ix_stream_set_resync(ix_stream* s, ix_resync_mode mode);
+
+/*
+ * Feed the next chunk of the byte stream.
+ *
+ * Calls the stream's callbacks for every packet completed and every stretch
+ * of corrupt data skipped by this chunk. Whatever is left over at the end of
+ * the chunk is kept for the next call. If buf is NULL, len must be 0.
+ */
+IX_EXPORT
+void
+ix_stream_feed(ix_stream* s, const uint8_t* buf, uint32_t len);
+
+/*
+ * Feed a chunk that may be longer than fits in a uint32_t, e.g. a whole
+ * mapped capture file. Otherwise identical to ix_stream_feed.
+ */
+IX_EXPORT
+void
+ix_stream_feed64(ix_stream* s, const uint8_t* buf, uint64_t len);
+
+/*
+ * Return the number of bytes currently held over waiting for the rest of a
+ * packet. Always less than IX_PAC_MAXSIZE.
+ */
+IX_EXPORT
+uint32_t
+ix_stream_pending(const ix_stream* s);
+
+/*
+ * Return the total number of bytes fed to the stream so far.
+ */
+IX_EXPORT
+uint64_t
+ix_stream_offset(const ix_stream* s);
+
+/*
+ * Discard any held over bytes, e.g. after reconnecting. Offsets keep counting
+ * from where they were.
+ */
+IX_EXPORT
+void
+ix_stream_reset(ix_stream* s);
+
+/*
+ * Store a snapshot of the stream's statistics in *out. May be called from any
+ * thread, even while the stream is being fed on another.
+ */
+IX_EXPORT
+void
+ix_stream_stats(const ix_stream* s, ix_stats* out);
@@ -0,0 +1,290 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * Bulk sample unpacking kernels.
+ *
+ * A 4-channel EEG packet without a dropped samples count is the header byte
+ * 0xe0 followed by 40 bits of samples; an accelerometer packet is 0xa0
+ * followed by 30 bits of samples and 2 bits of padding. Sample c starts at
+ * bit 10 * c of the payload, so it always lies within the 16-bit little-endian
+ * word at byte 10 * c / 8, shifted right by 10 * c % 8 = 0, 2, 4 or 6 bits.
+ *
+ * The SIMD kernels gather those words into 16-bit lanes with a byte shuffle,
+ * ordered so that the same channel of consecutive packets lands in adjacent
+ * lanes. There is no per-lane variable shift for 16-bit lanes before AVX-512,
+ * so instead each lane is multiplied by 1 << (6 - shift), which drops the bits
+ * above the sample, and then everything is shifted right by 6. A couple of
+ * 32-bit unpacks then leave each channel contiguous for the stores.
+ *
+ * Packet headers are checked before each group of packets and a kernel falls
+ * through to the scalar loop as soon as a group doesn't match, so runs always
+ * end at exactly the same place regardless of instruction set.
+ */
+
+#ifndef IX_MUSE_CORE_H_
+#include <stdint.h>
+#include "defs.h"
+#include "unpack.h"
+#endif
+
+#ifndef IX_INTERNAL_H_
+#include "defs_internal.h"
+#include "unpack_internal.h"
+#endif
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+# define IX_UNPACK_X86 1
+# include <immintrin.h>
+# define IX_TARGET(t) __attribute__((target(t)))
+#endif
+
+static inline uint16_t
+_sample(const uint8_t* b, uint8_t i)
+{
+  uint8_t bit = 10 * i;
+
+  return (b[bit / 8] | b[bit / 8 + 1] << 8) >> bit % 8 & 0x3ff;
+}
+
+static uint32_t
+_unpack_scalar(const uint8_t* buf, uint32_t len, uint16_t* const ch[],
+               uint8_t n, uint8_t header, uint8_t stride, uint32_t i,
+               uint32_t max)
+{
+  const uint8_t *p;
+  uint8_t       c;
+
+  for (; i < max && (i + 1) * stride <= len; i++) {
+    p = buf + i * stride;
+    if (*p != header) break;
+    for (c = 0; c < n; c++) {
+      ch[c][i] = _sample(p + 1, c);
+    }
+  }
+  return i;
+}
+
+
+#ifdef IX_UNPACK_X86
+
+/*
+ * Shuffles gathering the sample words of the packets at byte 0 and byte
+ * stride of a 16-byte load, as [c0 c0 c1 c1 c2 c2 c3 c3] with packets
+ * alternating.
+ */
+#define _W(pk, c, stride) \
+  (char)((pk) * (stride) + 1 + (c) * 10 / 8), \
+  (char)((pk) * (stride) + 2 + (c) * 10 / 8)
+#define _EEG4_SHUF \
+  _W(0, 0, 6), _W(1, 0, 6), _W(0, 1, 6), _W(1, 1, 6), \
+  _W(0, 2, 6), _W(1, 2, 6), _W(0, 3, 6), _W(1, 3, 6)
+#define _ACC_SHUF \
+  _W(0, 0, 5), _W(1, 0, 5), _W(0, 1, 5), _W(1, 1, 5), \
+  _W(0, 2, 5), _W(1, 2, 5), -1, -1, -1, -1
+#define _MULS 64, 64, 16, 16, 4, 4, 1, 1
+
+static inline int
+_headers_match(const uint8_t* p, uint8_t header, uint8_t stride, uint8_t n)
+{
+  uint8_t k;
+
+  for (k = 0; k < n; k++) {
+    if (p[k * stride] != header) return 0;
+  }
+  return 1;
+}
+
+IX_TARGET("ssse3,sse4.1") static inline __m128i
+_sse4_words(const uint8_t* p, __m128i shuf, __m128i muls)
+{
+  __m128i v = _mm_loadu_si128((const __m128i*)p);
+
+  v = _mm_shuffle_epi8(v, shuf);
+  return _mm_srli_epi16(_mm_mullo_epi16(v, muls), 6);
+}
+
+IX_TARGET("ssse3,sse4.1") static uint32_t
+_unpack_eeg4_sse4(const uint8_t* buf, uint32_t len, uint16_t* const ch[4],
+                  uint32_t max)
+{
+  const __m128i shuf = _mm_setr_epi8(_EEG4_SHUF);
+  const __m128i muls = _mm_setr_epi16(_MULS);
+  const uint8_t *p;
+  __m128i       a, b, lo, hi;
+  uint32_t      i = 0;
+
+  /* 4 packets per iteration; the second load reads 16 bytes from byte 12. */
+  for (; i + 4 <= max && i * EEG4_STRIDE + 28 <= len; i += 4) {
+    p = buf + i * EEG4_STRIDE;
+    if (!_headers_match(p, EEG4_HEADER, EEG4_STRIDE, 4)) break;
+    a = _sse4_words(p, shuf, muls);
+    b = _sse4_words(p + 2 * EEG4_STRIDE, shuf, muls);
+    lo = _mm_unpacklo_epi32(a, b);
+    hi = _mm_unpackhi_epi32(a, b);
+    _mm_storel_epi64((__m128i*)(ch[0] + i), lo);
+    _mm_storel_epi64((__m128i*)(ch[1] + i), _mm_srli_si128(lo, 8));
+    _mm_storel_epi64((__m128i*)(ch[2] + i), hi);
+    _mm_storel_epi64((__m128i*)(ch[3] + i), _mm_srli_si128(hi, 8));
+  }
+  return _unpack_scalar(buf, len, ch, 4, EEG4_HEADER, EEG4_STRIDE, i, max);
+}
+
+IX_TARGET("ssse3,sse4.1") static uint32_t
+_unpack_acc_sse4(const uint8_t* buf, uint32_t len, uint16_t* const ch[3],
+                 uint32_t max)
+{
+  const __m128i shuf = _mm_setr_epi8(_ACC_SHUF);
+  const __m128i muls = _mm_setr_epi16(_MULS);
+  const uint8_t *p;
+  __m128i       a, b, lo, hi;
+  uint32_t      i = 0;
+
+  for (; i + 4 <= max && i * ACC_STRIDE + 26 <= len; i += 4) {
+    p = buf + i * ACC_STRIDE;
+    if (!_headers_match(p, ACC_HEADER, ACC_STRIDE, 4)) break;
+    a = _sse4_words(p, shuf, muls);
+    b = _sse4_words(p + 2 * ACC_STRIDE, shuf, muls);
+    lo = _mm_unpacklo_epi32(a, b);
+    hi = _mm_unpackhi_epi32(a, b);
+    _mm_storel_epi64((__m128i*)(ch[0] + i), lo);
+    _mm_storel_epi64((__m128i*)(ch[1] + i), _mm_srli_si128(lo, 8));
+    _mm_storel_epi64((__m128i*)(ch[2] + i), hi);
+  }
+  return _unpack_scalar(buf, len, ch, 3, ACC_HEADER, ACC_STRIDE, i, max);
+}
+
+/*
+ * The AVX2 kernels handle 8 packets at a time. Byte shuffles only work within
+ * 128-bit lanes, so packets 0-1 and 4-5 share one register and 2-3 and 6-7
+ * another; after the 32-bit unpacks each lane holds 4 consecutive samples of
+ * a channel, and a 64-bit permute puts the two halves of each channel back
+ * together.
+ */
+IX_TARGET("avx2") static inline __m256i
+_avx2_words(const uint8_t* lo, const uint8_t* hi, __m256i shuf, __m256i muls)
+{
+  __m256i v = _mm256_inserti128_si256(
+      _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)lo)),
+      _mm_loadu_si128((const __m128i*)hi), 1);
+
+  v = _mm256_shuffle_epi8(v, shuf);
+  return _mm256_srli_epi16(_mm256_mullo_epi16(v, muls), 6);
+}
+
+#define _SPLIT 0xd8 /* 64-bit lanes 0, 2, 1, 3 */
+
+IX_TARGET("avx2") static uint32_t
+_unpack_eeg4_avx2(const uint8_t* buf, uint32_t len, uint16_t* const ch[4],
+                  uint32_t max)
+{
+  const __m256i shuf = _mm256_setr_epi8(_EEG4_SHUF, _EEG4_SHUF);
+  const __m256i muls = _mm256_setr_epi16(_MULS, _MULS);
+  const uint8_t *p;
+  __m256i       a, b, lo, hi;
+  uint32_t      i = 0;
+
+  for (; i + 8 <= max && i * EEG4_STRIDE + 52 <= len; i += 8) {
+    p = buf + i * EEG4_STRIDE;
+    if (!_headers_match(p, EEG4_HEADER, EEG4_STRIDE, 8)) break;
+    a = _avx2_words(p, p + 4 * EEG4_STRIDE, shuf, muls);
+    b = _avx2_words(p + 2 * EEG4_STRIDE, p + 6 * EEG4_STRIDE, shuf, muls);
+    lo = _mm256_permute4x64_epi64(_mm256_unpacklo_epi32(a, b), _SPLIT);
+    hi = _mm256_permute4x64_epi64(_mm256_unpackhi_epi32(a, b), _SPLIT);
+    _mm_storeu_si128((__m128i*)(ch[0] + i), _mm256_castsi256_si128(lo));
+    _mm_storeu_si128((__m128i*)(ch[1] + i), _mm256_extracti128_si256(lo, 1));
+    _mm_storeu_si128((__m128i*)(ch[2] + i), _mm256_castsi256_si128(hi));
+    _mm_storeu_si128((__m128i*)(ch[3] + i), _mm256_extracti128_si256(hi, 1));
+  }
+  return _unpack_eeg4_sse4(buf + i * EEG4_STRIDE, len - i * EEG4_STRIDE,
+                           (uint16_t* const[]){ch[0] + i, ch[1] + i,
+                                               ch[2] + i, ch[3] + i},
+                           max - i) + i;
+}
+
+IX_TARGET("avx2") static uint32_t
+_unpack_acc_avx2(const uint8_t* buf, uint32_t len, uint16_t* const ch[3],
+                 uint32_t max)
+{
+  const __m256i shuf = _mm256_setr_epi8(_ACC_SHUF, _ACC_SHUF);
+  const __m256i muls = _mm256_setr_epi16(_MULS, _MULS);
+  const uint8_t *p;
+  __m256i       a, b, lo, hi;
+  uint32_t      i = 0;
+
+  for (; i + 8 <= max && i * ACC_STRIDE + 46 <= len; i += 8) {
+    p = buf + i * ACC_STRIDE;
+    if (!_headers_match(p, ACC_HEADER, ACC_STRIDE, 8)) break;
+    a = _avx2_words(p, p + 4 * ACC_STRIDE, shuf, muls);
+    b = _avx2_words(p + 2 * ACC_STRIDE, p + 6 * ACC_STRIDE, shuf, muls);
+    lo = _mm256_permute4x64_epi64(_mm256_unpacklo_epi32(a, b), _SPLIT);
+    hi = _mm256_permute4x64_epi64(_mm256_unpackhi_epi32(a, b), _SPLIT);
+    _mm_storeu_si128((__m128i*)(ch[0] + i), _mm256_castsi256_si128(lo));
+    _mm_storeu_si128((__m128i*)(ch[1] + i), _mm256_extracti128_si256(lo, 1));
+    _mm_storeu_si128((__m128i*)(ch[2] + i), _mm256_castsi256_si128(hi));
+  }
+  return _unpack_acc_sse4(buf + i * ACC_STRIDE, len - i * ACC_STRIDE,
+                          (uint16_t* const[]){ch[0] + i, ch[1] + i, ch[2] + i},
+                          max - i) + i;
+}
+
+#endif  /* IX_UNPACK_X86 */
+
+
+ix_simd
+ix_simd_detect(void)
+{
+#ifdef IX_UNPACK_X86
+  if (__builtin_cpu_supports("avx2")) return IX_SIMD_AVX2;
+  if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3")) {
+    return IX_SIMD_SSE4;
+  }
+#endif
+  return IX_SIMD_SCALAR;
+}
+
+uint32_t
+ix_unpack_eeg4_with(ix_simd simd, const uint8_t* buf, uint32_t len,
+                    uint16_t* const ch[4], uint32_t max)
+{
+  ix_simd best = ix_simd_detect();
+
+  switch (simd < best ? simd : best) {
+#ifdef IX_UNPACK_X86
+  case IX_SIMD_AVX2: return _unpack_eeg4_avx2(buf, len, ch, max);
+  case IX_SIMD_SSE4: return _unpack_eeg4_sse4(buf, len, ch, max);
+#endif
+  default:
+    return _unpack_scalar(buf, len, ch, 4, EEG4_HEADER, EEG4_STRIDE, 0, max);
+  }
+}
+
+uint32_t
+ix_unpack_acc_with(ix_simd simd, const uint8_t* buf, uint32_t len,
+                   uint16_t* const ch[3], uint32_t max)
+{
+  ix_simd best = ix_simd_detect();
+
+  switch (simd < best ? simd : best) {
+#ifdef IX_UNPACK_X86
+  case IX_SIMD_AVX2: return _unpack_acc_avx2(buf, len, ch, max);
+  case IX_SIMD_SSE4: return _unpack_acc_sse4(buf, len, ch, max);
+#endif
+  default:
+    return _unpack_scalar(buf, len, ch, 3, ACC_HEADER, ACC_STRIDE, 0, max);
+  }
+}
+
+uint32_t
+ix_unpack_eeg4(const uint8_t* buf, uint32_t len, uint16_t* const ch[4],
+               uint32_t max)
+{ return ix_unpack_eeg4_with(ix_simd_detect(), buf, len, ch, max); }
+
+uint32_t
+ix_unpack_acc(const uint8_t* buf, uint32_t len, uint16_t* const ch[3],
+              uint32_t max)
+{ return ix_unpack_acc_with(ix_simd_detect(), buf, len, ch, max); }
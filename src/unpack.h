@@ -0,0 +1,82 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * include <stdint.h> for sized ints
+ * include "defs.h" for IX_EXPORT
+ */
+
+/*
+ * Bulk sample unpacking.
+ *
+ * EEG and accelerometer packets carry their samples as little-endian runs of
+ * 10-bit fields. When a link is healthy they arrive back to back in long runs
+ * with no dropped samples counts, so each run is just a fixed-stride array of
+ * packed samples. These functions unpack such runs directly into per-channel
+ * uint16_t arrays, several packets at a time with SIMD where the CPU has it.
+ */
+
+/*
+ * Instruction set levels for the unpacking kernels.
+ */
+typedef enum {
+  IX_SIMD_SCALAR = 0,
+  IX_SIMD_SSE4,
+  IX_SIMD_AVX2
+} ix_simd;
+
+/*
+ * Return the best instruction set level supported by this CPU.
+ */
+IX_EXPORT
+ix_simd
+ix_simd_detect(void);
+
+/*
+ * Unpack a run of EEG packets.
+ *
+ * Decodes consecutive 4-channel EEG packets without a dropped samples count
+ * starting at buf, stopping at the first byte that does not start one, at the
+ * end of the buffer, or after max packets. Sample i of channel c is written
+ * to ch[c][i]. Returns the number of packets unpacked, which occupy the first
+ * 6 bytes each of buf.
+ *
+ * The results are exactly those ix_packet_parse would produce, packet by
+ * packet.
+ */
+IX_EXPORT
+uint32_t
+ix_unpack_eeg4(const uint8_t* buf, uint32_t len, uint16_t* const ch[4],
+               uint32_t max);
+
+/*
+ * Unpack a run of accelerometer packets.
+ *
+ * Like ix_unpack_eeg4, but for 3-channel accelerometer packets, which occupy 5
+ * bytes each.
+ */
+IX_EXPORT
+uint32_t
+ix_unpack_acc(const uint8_t* buf, uint32_t len, uint16_t* const ch[3],
+              uint32_t max);
+
+/*
+ * Unpack runs with a specific instruction set level.
+ *
+ * Levels higher than ix_simd_detect() are clamped to it. These are mostly
+ * useful for testing and benchmarking; the variants above pick the best level
+ * automatically.
+ */
+IX_EXPORT
+uint32_t
+ix_unpack_eeg4_with(ix_simd simd, const uint8_t* buf, uint32_t len,
+                    uint16_t* const ch[4], uint32_t max);
+
+IX_EXPORT
+uint32_t
+ix_unpack_acc_with(ix_simd simd, const uint8_t* buf, uint32_t len,
+                   uint16_t* const ch[3], uint32_t max);
@@ -0,0 +1,17 @@
+/*
+ * Copyright 2015 Steven Dee.
+ *
+ * Redistributable under the terms of the GNU General Public License,
+ * version 2. No warranty is implied by this distribution.
+ */
+
+/*
+ * First bytes and lengths of EEG and accelerometer packets without dropped
+ * samples counts, which is what ix_unpack_eeg4 and ix_unpack_acc handle.
+ */
+enum {
+  EEG4_HEADER = 0xe0,
+  EEG4_STRIDE = 6,
+  ACC_HEADER = 0xa0,
+  ACC_STRIDE = 5
+};
@@ -0,0 +1,59 @@
+// Copyright 2015 Steven Dee.
+
+// Deliberately includes nothing that declares malloc, so the definitions below
+// don't have to match the system's exception specifications.
+#include <cstdint>
+
+#include "alloc_count.h"
+
+namespace {
+
+// Per thread, so that other threads allocating, e.g. engine workers left
+// over from an earlier case, neither race with nor add to the count.
+thread_local bool counting = false;
+thread_local size_t count = 0;
+
+}  // namespace
+
+void alloc_count_start() {
+  count = 0;
+  counting = true;
+}
+
+size_t alloc_count_stop() {
+  counting = false;
+  return count;
+}
+
+#ifdef __GLIBC__
+
+extern "C" {
+
+void* __libc_malloc(size_t n);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t n);
+
+void* malloc(size_t n) {
+  count += counting;
+  return __libc_malloc(n);
+}
+
+void* calloc(size_t n, size_t size) {
+  count += counting;
+  return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t n) {
+  count += counting;
+  return __libc_realloc(p, n);
+}
+
+}  // extern "C"
+
+bool alloc_count_supported() { return true; }
+
+#else
+
+bool alloc_count_supported() { return false; }
+
+#endif
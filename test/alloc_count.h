@@ -0,0 +1,16 @@
+// Copyright 2015 Steven Dee.
+
+// Heap allocation counting for benchmarks.
+//
+// Counts calls to malloc, calloc and realloc made between alloc_count_start
+// and alloc_count_stop on the calling thread, from any library. Only
+// implemented on glibc; elsewhere alloc_count_supported returns false and the
+// counts are always zero.
+
+#pragma once
+
+#include <cstddef>
+
+bool alloc_count_supported();
+void alloc_count_start();
+size_t alloc_count_stop();
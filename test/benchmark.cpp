@@ -0,0 +1,123 @@
+// Copyright 2015 Steven Dee.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "alloc_count.h"
+#include "benchmark.h"
+
+namespace {
+
+// Minimum total time per case.
+const auto k_min_secs = 0.2;
+
+bool g_json = false;
+bool g_first = true;
+const char* g_filter = "";
+
+double now() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void report(std::string const& name, uint64_t packets, uint64_t bytes,
+            double secs, double allocs) {
+  auto ns = packets ? secs * 1e9 / packets : 0.0;
+  auto mbps = secs > 0 ? bytes / secs / 1e6 : 0.0;
+  auto pps = secs > 0 ? packets / secs : 0.0;
+  if (g_json) {
+    printf("%s\n  {\"name\": \"%s\", \"packets\": %llu, \"bytes\": %llu, "
+           "\"ns_per_packet\": %.2f, \"packets_per_sec\": %.0f, "
+           "\"mb_per_sec\": %.2f, \"allocs_per_packet\": ",
+           g_first ? "" : ",", name.c_str(),
+           static_cast<unsigned long long>(packets),
+           static_cast<unsigned long long>(bytes), ns, pps, mbps);
+    if (std::isnan(allocs)) {
+      printf("null}");
+    } else {
+      printf("%.3f}", allocs);
+    }
+  } else {
+    printf("%s,%llu,%llu,%.2f,%.0f,%.2f,", name.c_str(),
+           static_cast<unsigned long long>(packets),
+           static_cast<unsigned long long>(bytes), ns, pps, mbps);
+    if (!std::isnan(allocs)) {
+      printf("%.3f", allocs);
+    }
+    printf("\n");
+  }
+  g_first = false;
+  fflush(stdout);
+}
+
+bool selected(std::string const& name) {
+  return name.find(g_filter) != std::string::npos;
+}
+
+}  // namespace
+
+void bench_run(std::string const& name, uint64_t packets, uint64_t bytes,
+               std::function<void()> const& f) {
+  if (!selected(name)) {
+    return;
+  }
+  f();  // Warm up.
+  auto reps = uint64_t{1};
+  for (;;) {
+    alloc_count_start();
+    auto start = now();
+    for (auto i = 0u; i < reps; ++i) {
+      f();
+    }
+    auto secs = now() - start;
+    auto allocs = alloc_count_stop();
+    if (secs >= k_min_secs) {
+      report(name, packets, bytes, secs / reps,
+             alloc_count_supported() && packets ?
+             double(allocs) / (reps * packets) : NAN);
+      return;
+    }
+    reps = static_cast<uint64_t>(reps * (secs > 0 ?
+        std::min(100.0, std::ceil(1.5 * k_min_secs / secs)) : 100.0));
+  }
+}
+
+void bench_record(std::string const& name, uint64_t packets, uint64_t bytes,
+                  double secs) {
+  if (selected(name)) {
+    report(name, packets, bytes, secs, NAN);
+  }
+}
+
+// Usage: benchmark [--json|--csv] [filter]
+// Runs every case whose name contains filter.
+int main(int argc, char** argv) {
+  for (auto i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--json")) {
+      g_json = true;
+    } else if (!strcmp(argv[i], "--csv")) {
+      g_json = false;
+    } else {
+      g_filter = argv[i];
+    }
+  }
+  if (g_json) {
+    printf("[");
+  } else {
+    printf("name,packets,bytes,ns_per_packet,packets_per_sec,mb_per_sec,"
+           "allocs_per_packet\n");
+  }
+  packet_benchmarks();
+#if !defined _WIN32
+  engine_benchmarks();
+#endif
+  conn_benchmarks();
+  if (g_json) {
+    printf("\n]\n");
+  }
+  return 0;
+}
@@ -0,0 +1,30 @@
+// Copyright 2015 Steven Dee.
+
+// Benchmark harness.
+//
+// Each benchmark case times a function that handles a known number of packets
+// and bytes, repeating it until the timing settles, and becomes one row of
+// results: ns/packet, MB/s and heap allocations per packet. Rows are printed
+// as CSV, or as a JSON array with --json, with the same fields in the same
+// order every run so that results can be diffed across releases.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Times f, which handles packets packets in bytes bytes per call.
+void bench_run(std::string const& name, uint64_t packets, uint64_t bytes,
+               std::function<void()> const& f);
+
+// Records a case timed elsewhere, e.g. across threads, where allocations
+// can't be counted.
+void bench_record(std::string const& name, uint64_t packets, uint64_t bytes,
+                  double secs);
+
+// The suites; see packet_benchmark.cpp, engine_benchmark.cpp and
+// conn_benchmark.cpp.
+void packet_benchmarks();
+void engine_benchmarks();
+void conn_benchmarks();
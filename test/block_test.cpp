@@ -0,0 +1,252 @@
+#include <cstdint>
+
+extern "C" {
+#include <muse_core/defs.h>
+#include <muse_core/packet.h>
+#include <muse_core/unpack.h>
+#include <muse_core/block.h>
+}
+
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+#include "packet_builders.h"
+
+using std::mt19937;
+using std::vector;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test fixtures
+////////////////////////////////////////////////////////////////////////////////
+
+// Samples and dropped counts of one channel type, in packet order.
+struct Series {
+  vector<vector<uint16_t>> ch;
+  vector<uint16_t> dropped;
+
+  bool operator==(Series const& o) const {
+    return ch == o.ch && dropped == o.dropped;
+  }
+};
+
+const uint32_t kCap = 37;
+
+class BlockTest : public ::testing::Test {
+protected:
+  BlockTest(): rng(0), eeg_storage(IX_EEG_BLOCK_STORAGE(kCap)),
+               acc_storage(IX_ACC_BLOCK_STORAGE(kCap)) {
+    ix_eeg_block_init(&eeg, eeg_storage.data(), kCap);
+    ix_acc_block_init(&acc, acc_storage.data(), kCap);
+    sink.eeg = &eeg;
+    sink.acc = &acc;
+    sink.other_f = [](const ix_packet* p, void* user_data) {
+      static_cast<vector<ix_pac_type>*>(user_data)->push_back(
+          ix_packet_type(p));
+    };
+    sink.other_data = &others;
+  }
+
+  uint16_t sample() { return rng() % 1024; }
+
+  // A mixed stream of mostly uncompressed EEG, with some of everything else.
+  parse_input stream(size_t n) {
+    auto ret = parse_input();
+    for (auto i = 0u; i < n; ++i) {
+      switch (rng() % 16) {
+      case 0: ret = ret + sync_packet(); break;
+      case 1: ret = ret + battery_packet(1, 2, 3, 4); break;
+      case 2: ret = ret + drlref_packet(sample(), sample()); break;
+      case 3: ret = ret + eeg_packet(rng() % 9, sample(), sample(), sample(),
+                                     sample()); break;
+      case 4: ret = ret + acc_packet(rng() % 9, sample(), sample(), sample());
+              break;
+      case 5: case 6: case 7:
+        ret = ret + acc_packet(sample(), sample(), sample());
+        break;
+      default:
+        ret = ret + eeg_packet(sample(), sample(), sample(), sample());
+      }
+    }
+    return ret;
+  }
+
+  // What the blocks should contain, according to ix_packet_parse_all.
+  static void expected(parse_input const& buf, Series* eeg, Series* acc,
+                       vector<ix_pac_type>* others) {
+    struct Out { Series* eeg; Series* acc; vector<ix_pac_type>* others; }
+      out = {eeg, acc, others};
+    eeg->ch.resize(4);
+    acc->ch.resize(3);
+    ix_packet_fn pac_f = [](const ix_packet* p, void* user_data) {
+      auto out = static_cast<Out*>(user_data);
+      auto t = ix_packet_type(p);
+      auto s = t == IX_PAC_EEG ? out->eeg :
+               t == IX_PAC_ACCELEROMETER ? out->acc : nullptr;
+      if (!s) {
+        out->others->push_back(t);
+        return;
+      }
+      for (auto c = 0u; c < s->ch.size(); ++c) {
+        s->ch[c].push_back(ix_packet_ch(p, c));
+      }
+      s->dropped.push_back(ix_packet_dropped_samples(p));
+    };
+    ASSERT_EQ(IX_PARSE_END, ix_packet_parse_all(buf.data(), buf.size(), pac_f,
+                                                &out, NULL));
+  }
+
+  // Moves the contents of the blocks to the end of eeg_got and acc_got.
+  void drain() {
+    eeg_got.ch.resize(4);
+    acc_got.ch.resize(3);
+    for (auto c = 0u; c < 4; ++c) {
+      eeg_got.ch[c].insert(eeg_got.ch[c].end(), eeg.ch[c], eeg.ch[c] + eeg.n);
+    }
+    eeg_got.dropped.insert(eeg_got.dropped.end(), eeg.dropped,
+                           eeg.dropped + eeg.n);
+    for (auto c = 0u; c < 3; ++c) {
+      acc_got.ch[c].insert(acc_got.ch[c].end(), acc.ch[c], acc.ch[c] + acc.n);
+    }
+    acc_got.dropped.insert(acc_got.dropped.end(), acc.dropped,
+                           acc.dropped + acc.n);
+    eeg.n = acc.n = 0;
+  }
+
+  mt19937 rng;
+  vector<uint16_t> eeg_storage;
+  vector<uint16_t> acc_storage;
+  ix_eeg_block eeg;
+  ix_acc_block acc;
+  ix_block_sink sink;
+  vector<ix_pac_type> others;
+  Series eeg_got;
+  Series acc_got;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test suite proper
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_F(BlockTest, Init) {
+  EXPECT_EQ(kCap, eeg.cap);
+  EXPECT_EQ(0u, eeg.n);
+  EXPECT_EQ(eeg_storage.data() + kCap, eeg.ch[1]);
+  EXPECT_EQ(eeg_storage.data() + 4 * kCap, eeg.dropped);
+  EXPECT_EQ(acc_storage.data() + 2 * kCap, acc.ch[2]);
+  EXPECT_EQ(acc_storage.data() + 3 * kCap, acc.dropped);
+}
+
+TEST_F(BlockTest, Append) {
+  auto buf = eeg_packet(7u, 1u, 2u, 3u, 4u);
+  ix_packet p;
+  uint32_t n;
+  ASSERT_EQ(IX_PARSE_END, ix_packet_parse_into(buf.data(), buf.size(), &p, 1,
+                                               &n, NULL));
+  for (auto i = 0u; i < kCap; ++i) {
+    EXPECT_EQ(1, ix_eeg_block_append(&eeg, &p));
+  }
+  EXPECT_EQ(0, ix_eeg_block_append(&eeg, &p));
+  EXPECT_EQ(kCap, eeg.n);
+  EXPECT_EQ(3u, eeg.ch[2][kCap - 1]);
+  EXPECT_EQ(7u, eeg.dropped[0]);
+}
+
+// EEG blocks hold 4 channels, and won't take packets with any other count.
+TEST_F(BlockTest, AppendOtherChannelCounts) {
+  for (auto ch : {2u, 6u}) {
+    auto buf = eeg_packet_n(vector<uint16_t>(ch, 1));
+    ix_packet p;
+    uint32_t n;
+    ASSERT_EQ(IX_PARSE_END, ix_packet_parse_into_fmt(
+        ix_packet_format_eeg(ch), buf.data(), buf.size(), &p, 1, &n, NULL));
+    EXPECT_DEBUG_DEATH(ix_eeg_block_append(&eeg, &p), "") << ch;
+  }
+}
+
+TEST_F(BlockTest, SinkFn) {
+  auto buf = sync_packet() + eeg_packet(1, 2, 3, 4) + acc_packet(3u, 5u, 6u, 7u)
+             + error_packet(1);
+  ASSERT_EQ(IX_PARSE_END, ix_packet_parse_all(buf.data(), buf.size(),
+                                              ix_block_sink_fn, &sink, NULL));
+  ASSERT_EQ(1u, eeg.n);
+  EXPECT_EQ(4u, eeg.ch[3][0]);
+  ASSERT_EQ(1u, acc.n);
+  EXPECT_EQ(3u, acc.dropped[0]);
+  EXPECT_EQ(6u, acc.ch[1][0]);
+  ASSERT_EQ(2u, others.size());
+  EXPECT_EQ(IX_PAC_SYNC, others[0]);
+  EXPECT_EQ(IX_PAC_ERROR, others[1]);
+}
+
+TEST_F(BlockTest, SinkParseMatchesParseAll) {
+  for (auto i = 0; i < 20; ++i) {
+    auto buf = stream(rng() % 300);
+    Series eeg_want, acc_want;
+    vector<ix_pac_type> others_want;
+    expected(buf, &eeg_want, &acc_want, &others_want);
+
+    eeg_got = acc_got = Series();
+    others.clear();
+    auto off = 0u;
+    for (;;) {
+      uint32_t consumed;
+      auto r = ix_block_sink_parse(&sink, buf.data() + off, buf.size() - off,
+                                   &consumed);
+      off += consumed;
+      drain();
+      if (r != IX_PARSE_FULL) {
+        EXPECT_EQ(IX_PARSE_END, r);
+        break;
+      }
+    }
+    EXPECT_EQ(buf.size(), off);
+    EXPECT_TRUE(eeg_want == eeg_got);
+    EXPECT_TRUE(acc_want == acc_got);
+    EXPECT_EQ(others_want, others);
+  }
+}
+
+TEST_F(BlockTest, SinkParseStopsWhenFull) {
+  auto buf = parse_input();
+  for (auto i = 0u; i < kCap + 3; ++i) {
+    buf = buf + eeg_packet(i % 1024, 0u, 0u, 0u);
+  }
+  uint32_t consumed;
+  EXPECT_EQ(IX_PARSE_FULL, ix_block_sink_parse(&sink, buf.data(), buf.size(),
+                                               &consumed));
+  EXPECT_EQ(kCap * 6, consumed);
+  EXPECT_EQ(kCap, eeg.n);
+  EXPECT_EQ(kCap - 1, eeg.ch[0][kCap - 1]);
+}
+
+TEST_F(BlockTest, SinkParsePartialAndCorrupt) {
+  auto whole = eeg_packet(1, 2, 3, 4) + acc_packet(1, 2, 3);
+  auto buf = whole + parse_input(1, 0xe0);
+  uint32_t consumed;
+  EXPECT_EQ(IX_PARSE_PARTIAL, ix_block_sink_parse(&sink, buf.data(),
+                                                  buf.size(), &consumed));
+  EXPECT_EQ(whole.size(), consumed);
+
+  eeg.n = acc.n = 0;
+  buf = whole + parse_input(1, 0x00);
+  EXPECT_EQ(IX_PARSE_CORRUPT, ix_block_sink_parse(&sink, buf.data(),
+                                                  buf.size(), &consumed));
+  EXPECT_EQ(whole.size(), consumed);
+  EXPECT_EQ(1u, eeg.n);
+  EXPECT_EQ(1u, acc.n);
+}
+
+TEST_F(BlockTest, NullBlocksGoToOther) {
+  sink.eeg = nullptr;
+  auto buf = eeg_packet(1, 2, 3, 4) + acc_packet(1, 2, 3);
+  ASSERT_EQ(IX_PARSE_END, ix_block_sink_parse(&sink, buf.data(), buf.size(),
+                                              NULL));
+  ASSERT_EQ(1u, others.size());
+  EXPECT_EQ(IX_PAC_EEG, others[0]);
+  EXPECT_EQ(1u, acc.n);
+}
+
+}  // namespace
@@ -0,0 +1,119 @@
+#include <cstdint>
+
+extern "C" {
+#include <muse_core/defs.h>
+#include <muse_core/packet.h>
+#include <muse_core/unpack.h>
+#include <muse_core/resync.h>
+#include <muse_core/stats.h>
+#include <muse_core/stream.h>
+#include <muse_core/capture.h>
+}
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "packet_builders.h"
+#include "stream_generator.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test fixtures
+////////////////////////////////////////////////////////////////////////////////
+
+class CaptureTest : public ::testing::Test {
+protected:
+  CaptureTest() {
+    char tmpl[] = "/tmp/ix_capture_test.XXXXXX";
+    auto fd = mkstemp(tmpl);
+    EXPECT_LE(0, fd);
+    close(fd);
+    path = tmpl;
+    c.data = NULL;
+    c.len = 0;
+  }
+
+  ~CaptureTest() {
+    ix_capture_close(&c);
+    unlink(path.c_str());
+  }
+
+  void write_file(parse_input const& bytes) {
+    auto f = fopen(path.c_str(), "wb");
+    ASSERT_TRUE(f != NULL);
+    EXPECT_EQ(bytes.size(), fwrite(bytes.data(), 1, bytes.size(), f));
+    fclose(f);
+  }
+
+  static void pac_f(const ix_packet* p, void* user_data) {
+    static_cast<vector<uint32_t>*>(user_data)->push_back(ix_packet_type(p));
+  }
+
+  static vector<uint32_t> parse(const uint8_t* buf, uint64_t len) {
+    auto ret = vector<uint32_t>();
+    ix_stream s;
+    ix_stream_init(&s, pac_f, NULL, &ret);
+    ix_stream_feed64(&s, buf, len);
+    return ret;
+  }
+
+  string path;
+  ix_capture c;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test suite proper
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_F(CaptureTest, Missing) {
+  EXPECT_EQ(ENOENT, ix_capture_open(&c, "/nonexistent/capture"));
+  EXPECT_EQ(NULL, ix_capture_data(&c));
+  EXPECT_EQ(0u, ix_capture_len(&c));
+  EXPECT_EQ(EINVAL, ix_capture_open(&c, "/tmp"));
+}
+
+TEST_F(CaptureTest, Empty) {
+  ASSERT_EQ(0, ix_capture_open(&c, path.c_str()));
+  EXPECT_EQ(0u, ix_capture_len(&c));
+  ix_stream s;
+  ix_stream_init(&s, pac_f, NULL, NULL);
+  EXPECT_EQ(0u, ix_capture_feed(&c, &s, 0, 100));
+  ix_capture_close(&c);
+  ix_capture_close(&c);
+}
+
+TEST_F(CaptureTest, ParsesInPlace) {
+  auto bytes = parse_input(100000);
+  stream_generator(headset_profile::eeg_220hz(), 0).fill(bytes.data(),
+                                                          bytes.size());
+  write_file(bytes);
+  ASSERT_EQ(0, ix_capture_open(&c, path.c_str()));
+  ASSERT_EQ(bytes.size(), ix_capture_len(&c));
+  EXPECT_EQ(bytes, parse_input(ix_capture_data(&c),
+                               ix_capture_data(&c) + ix_capture_len(&c)));
+
+  auto want = parse(bytes.data(), bytes.size());
+  auto got = vector<uint32_t>();
+  ix_stream s;
+  ix_stream_init(&s, pac_f, NULL, &got);
+  // In uneven pieces, running off the end.
+  auto off = uint64_t{0};
+  for (auto n = 1u; off < bytes.size(); n = n * 3 + 1) {
+    off += ix_capture_feed(&c, &s, off, n);
+  }
+  EXPECT_EQ(bytes.size(), off);
+  EXPECT_EQ(0u, ix_capture_feed(&c, &s, off, 1));
+  EXPECT_EQ(want, got);
+  EXPECT_EQ(bytes.size(), ix_stream_offset(&s));
+}
+
+}  // namespace
@@ -0,0 +1,146 @@
+#include <cstdint>
+
+extern "C" {
+#include <muse_core/defs.h>
+#include <muse_core/packet.h>
+#include <muse_core/clock.h>
+}
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+#include "packet_builders.h"
+#include "stream_generator.h"
+
+using std::mt19937;
+using std::vector;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test fixtures
+////////////////////////////////////////////////////////////////////////////////
+
+vector<ix_packet> parse(const ix_packet_format* fmt, parse_input const& buf) {
+  auto ret = vector<ix_packet>(buf.size());
+  uint32_t n, used;
+  ix_packet_parse_into_fmt(fmt, buf.data(), buf.size(), ret.data(),
+                           ret.size(), &n, &used);
+  ret.resize(n);
+  return ret;
+}
+
+class ClockTest : public ::testing::Test {
+protected:
+  ClockTest() { ix_clock_init(&c); }
+
+  uint64_t clock(parse_input const& buf) {
+    auto pacs = parse(ix_packet_format_eeg(4), buf);
+    EXPECT_EQ(1u, pacs.size());
+    return ix_clock_packet(&c, &pacs[0], &gap);
+  }
+
+  ix_clock c;
+  ix_clock_gap gap;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test suite proper
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_F(ClockTest, Indices) {
+  EXPECT_EQ(0u, clock(sync_packet()));
+  EXPECT_EQ(0u, clock(eeg_packet(1, 2, 3, 4)));
+  EXPECT_EQ(0u, gap.len);
+  EXPECT_EQ(1u, clock(eeg_packet(5, 6, 7, 8)));
+  EXPECT_EQ(0u, clock(acc_packet(1, 2, 3)));
+  EXPECT_EQ(5u, clock(eeg_packet(3, 9, 10, 11, 12)));
+  EXPECT_EQ(IX_PAC_EEG, gap.type);
+  EXPECT_EQ(2u, gap.at);
+  EXPECT_EQ(3u, gap.len);
+  EXPECT_EQ(4u, gap.channels);
+  EXPECT_EQ(vector<uint16_t>({5, 6, 7, 8}),
+            vector<uint16_t>(gap.from, gap.from + 4));
+  EXPECT_EQ(vector<uint16_t>({9, 10, 11, 12}),
+            vector<uint16_t>(gap.to, gap.to + 4));
+  EXPECT_EQ(6u, clock(sync_packet()));
+  EXPECT_EQ(6u, ix_clock_sync_at(&c));
+  EXPECT_EQ(6u, clock(battery_packet(1, 2, 3, 4)));
+  EXPECT_EQ(0u, gap.len);
+  EXPECT_EQ(3u, clock(acc_packet(2, 4, 5, 6)));
+  EXPECT_EQ(IX_PAC_ACCELEROMETER, gap.type);
+  EXPECT_EQ(1u, gap.at);
+  EXPECT_EQ(3u, gap.channels);
+  EXPECT_EQ(6u, ix_clock_eeg_samples(&c));
+  EXPECT_EQ(4u, ix_clock_acc_samples(&c));
+  EXPECT_EQ(3u, ix_clock_eeg_dropped(&c));
+  EXPECT_EQ(2u, ix_clock_acc_dropped(&c));
+}
+
+TEST_F(ClockTest, GapAtStart) {
+  EXPECT_EQ(7u, clock(eeg_packet(7, 100, 200, 300, 400)));
+  EXPECT_EQ(0u, gap.at);
+  EXPECT_EQ(vector<uint16_t>(gap.to, gap.to + 4),
+            vector<uint16_t>(gap.from, gap.from + 4));
+}
+
+TEST_F(ClockTest, MatchesGenerator) {
+  // Indices count every sample the generator made, sent or not.
+  for (auto ch : {2u, 4u, 6u}) {
+    auto p = headset_profile::eeg_256hz();
+    p.eeg_channels = ch;
+    p.drop_rate = 0.05;
+    auto buf = parse_input(50000);
+    stream_generator(p, ch).fill(buf.data(), buf.size());
+    ix_clock_init(&c);
+    uint64_t eeg = 0, acc = 0, dropped = 0, gaps = 0;
+    for (auto const& pac : parse(ix_packet_format_eeg(ch), buf)) {
+      auto t = ix_packet_type(&pac);
+      auto i = ix_clock_packet(&c, &pac, &gap);
+      if (t != IX_PAC_EEG && t != IX_PAC_ACCELEROMETER) {
+        EXPECT_EQ(0u, gap.len);
+        continue;
+      }
+      auto& next = t == IX_PAC_EEG ? eeg : acc;
+      EXPECT_EQ(ix_packet_dropped_samples(&pac), gap.len);
+      if (gap.len) {
+        EXPECT_EQ(next, gap.at);
+        EXPECT_EQ(ix_packet_channels(&pac), gap.channels);
+        ++gaps;
+      }
+      next += ix_packet_dropped_samples(&pac);
+      if (t == IX_PAC_EEG) dropped += ix_packet_dropped_samples(&pac);
+      EXPECT_EQ(next++, i);
+    }
+    EXPECT_LT(0u, gaps);
+    EXPECT_EQ(eeg, ix_clock_eeg_samples(&c));
+    EXPECT_EQ(acc, ix_clock_acc_samples(&c));
+    EXPECT_EQ(dropped, ix_clock_eeg_dropped(&c));
+  }
+}
+
+TEST_F(ClockTest, Fill) {
+  clock(eeg_packet(100, 1000, 0, 7));
+  clock(eeg_packet(3, 200, 0, 1000, 7));
+  float storage[4][3];
+  float* out[4] = {storage[0], storage[1], storage[2], storage[3]};
+
+  ix_clock_gap_fill(&gap, IX_FILL_NAN, out);
+  for (auto ch = 0u; ch < 4; ++ch) {
+    for (auto i = 0u; i < 3; ++i) {
+      EXPECT_TRUE(std::isnan(out[ch][i]));
+    }
+  }
+  ix_clock_gap_fill(&gap, IX_FILL_HOLD, out);
+  EXPECT_EQ(vector<float>({100, 100, 100}), vector<float>(out[0], out[0] + 3));
+  EXPECT_EQ(vector<float>({7, 7, 7}), vector<float>(out[3], out[3] + 3));
+  ix_clock_gap_fill(&gap, IX_FILL_LINEAR, out);
+  EXPECT_EQ(vector<float>({125, 150, 175}), vector<float>(out[0], out[0] + 3));
+  EXPECT_EQ(vector<float>({750, 500, 250}), vector<float>(out[1], out[1] + 3));
+  EXPECT_EQ(vector<float>({250, 500, 750}), vector<float>(out[2], out[2] + 3));
+  EXPECT_EQ(vector<float>({7, 7, 7}), vector<float>(out[3], out[3] + 3));
+}
+
+}  // namespace
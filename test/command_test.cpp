@@ -0,0 +1,190 @@
+#include <cstdint>
+
+extern "C" {
+#include <muse_core/defs.h>
+#include <muse_core/command.h>
+}
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+
+using std::mt19937;
+using std::string;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test fixtures
+////////////////////////////////////////////////////////////////////////////////
+
+string encode(ix_cmd cmd, uint8_t arg = 0) {
+  uint8_t buf[IX_CMD_MAXSIZE];
+  auto n = ix_cmd_encode(cmd, arg, buf, sizeof buf);
+  return string(buf, buf + n);
+}
+
+class ResponseTest : public ::testing::Test {
+protected:
+  ResponseTest(): rng(0) { ix_response_init(&r); }
+
+  // Feeds s in random pieces, and returns how much of it was read when the
+  // response ended, or s.size() + 1 if it didn't.
+  size_t feed(string const& s) {
+    for (size_t off = 0; off < s.size();) {
+      auto n = std::min<size_t>(rng() % 8, s.size() - off);
+      int done;
+      off += ix_response_feed(&r, reinterpret_cast<const uint8_t*>(s.data()) +
+                              off, n, &done);
+      if (done) return off;
+    }
+    return s.size() + 1;
+  }
+
+  string text() {
+    uint32_t len;
+    auto p = ix_response_text(&r, &len);
+    return string(p, len);
+  }
+
+  ix_response_reader r;
+  mt19937 rng;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test suite proper
+////////////////////////////////////////////////////////////////////////////////
+
+TEST(CommandTest, Encode) {
+  EXPECT_EQ("h\n", encode(IX_CMD_HALT));
+  EXPECT_EQ("v\n", encode(IX_CMD_VERSION, 21));
+  EXPECT_EQ("k\n", encode(IX_CMD_KEEPALIVE));
+  EXPECT_EQ("%0\n", encode(IX_CMD_PRESET, 0));
+  EXPECT_EQ("%21\n", encode(IX_CMD_PRESET, 21));
+  EXPECT_EQ("%255\n", encode(IX_CMD_PRESET, 255));
+
+  uint8_t buf[4] = {'x', 'x', 'x', 'x'};
+  EXPECT_EQ(0u, ix_cmd_encode(IX_CMD_PRESET, 100, buf, 4));
+  EXPECT_EQ('x', buf[0]);
+  EXPECT_EQ(4u, ix_cmd_encode(IX_CMD_PRESET, 99, buf, 4));
+
+  EXPECT_TRUE(ix_cmd_has_response(IX_CMD_STATUS));
+  EXPECT_FALSE(ix_cmd_has_response(IX_CMD_KEEPALIVE));
+}
+
+TEST_F(ResponseTest, Reads) {
+  auto s = string("\r\n{\"fw\": \"1.2.13\", \"hw\": \"3.1\", \"rc\": 0}");
+  EXPECT_EQ(s.size(), feed(s + "{\"rc\":1}"));
+  EXPECT_EQ(s.substr(2), text());
+  int32_t rc = -1;
+  EXPECT_TRUE(ix_response_rc(&r, &rc));
+  EXPECT_EQ(0, rc);
+}
+
+TEST_F(ResponseTest, Strings) {
+  auto s = string("{\"msg\": \"}{ \\\"rc\\\": 1\", \"rc\":-3, \"x\":{}}");
+  EXPECT_EQ(s.size(), feed(s));
+  int32_t rc;
+  EXPECT_TRUE(ix_response_rc(&r, &rc));
+  EXPECT_EQ(-3, rc);
+
+  ix_response_init(&r);
+  feed("{\"k\": \"rc\", \"v\": 2}");
+  EXPECT_FALSE(ix_response_rc(&r, &rc));
+
+  ix_response_init(&r);
+  feed("{\"rc\": 1234567890}");
+  EXPECT_FALSE(ix_response_rc(&r, &rc));
+}
+
+TEST_F(ResponseTest, Unfinished) {
+  EXPECT_EQ(5u, feed("junk"));
+  EXPECT_EQ("", text());
+  EXPECT_EQ(9u, feed("{\"rc\": 0"));
+  int32_t rc;
+  EXPECT_TRUE(ix_response_rc(&r, &rc));
+  EXPECT_EQ(1u, feed("}"));
+  EXPECT_EQ("{\"rc\": 0}", text());
+}
+
+TEST_F(ResponseTest, Overflow) {
+  auto s = "{\"rc\": 0, \"pad\": \"" + string(IX_RESPONSE_MAXSIZE, 'x') + "\"}";
+  EXPECT_EQ(s.size(), feed(s));
+  EXPECT_EQ(IX_RESPONSE_MAXSIZE, text().size());
+  int32_t rc;
+  EXPECT_FALSE(ix_response_rc(&r, &rc));
+}
+
+TEST(CmdQueueTest, Pipelines) {
+  ix_cmd_queue q;
+  ix_cmdq_init(&q);
+  EXPECT_TRUE(ix_cmdq_push(&q, IX_CMD_HALT, 0));
+  EXPECT_TRUE(ix_cmdq_push(&q, IX_CMD_PRESET, 21));
+  EXPECT_FALSE(ix_cmdq_push(&q, IX_CMD_KEEPALIVE, 0));
+  EXPECT_TRUE(ix_cmdq_push(&q, IX_CMD_STATUS, 0));
+  EXPECT_EQ(3u, ix_cmdq_len(&q));
+  EXPECT_EQ(0u, ix_cmdq_in_flight(&q));
+
+  // Nothing is owed a response until it is sent.
+  auto ok = string("{\"rc\":0}");
+  int done;
+  EXPECT_EQ(ok.size(), ix_cmdq_feed(&q, reinterpret_cast<const uint8_t*>(
+      ok.data()), ok.size(), &done));
+  EXPECT_FALSE(done);
+
+  // Flushes as much as fits.
+  uint8_t buf[IX_CMDQ_MAXSIZE * IX_CMD_MAXSIZE];
+  auto n = ix_cmdq_flush(&q, buf, 6);
+  EXPECT_EQ("h\n%21\n", string(buf, buf + n));
+  EXPECT_EQ(2u, ix_cmdq_in_flight(&q));
+  n = ix_cmdq_flush(&q, buf, sizeof buf);
+  EXPECT_EQ("s\n", string(buf, buf + n));
+
+  auto in = "junk" + ok + "{\"rc\":2}{\"rc\":0, \"bp\": 80}";
+  auto p = reinterpret_cast<const uint8_t*>(in.data());
+  auto len = static_cast<uint32_t>(in.size());
+  auto got = string();
+  while (len) {
+    auto used = ix_cmdq_feed(&q, p, len, &done);
+    p += used;
+    len -= used;
+    if (!done) break;
+    int32_t rc;
+    ASSERT_TRUE(ix_response_rc(ix_cmdq_response(&q), &rc));
+    got += static_cast<char>(ix_cmdq_front(&q)) + std::to_string(rc);
+    ix_cmdq_pop(&q);
+  }
+  EXPECT_EQ("h0%2s0", got);
+  EXPECT_EQ(0u, ix_cmdq_len(&q));
+}
+
+TEST(CmdQueueTest, Resend) {
+  ix_cmd_queue q;
+  ix_cmdq_init(&q);
+  uint8_t buf[IX_CMDQ_MAXSIZE * IX_CMD_MAXSIZE];
+  // Wraps around a few times.
+  for (auto i = 0; i < 100; ++i) {
+    ix_cmdq_push(&q, IX_CMD_VERSION, 0);
+    ix_cmdq_push(&q, IX_CMD_STATUS, 0);
+    ix_cmdq_flush(&q, buf, sizeof buf);
+    int done;
+    ix_cmdq_feed(&q, reinterpret_cast<const uint8_t*>("{}"), 2, &done);
+    ASSERT_TRUE(done);
+    ASSERT_EQ(IX_CMD_VERSION, ix_cmdq_front(&q));
+    ix_cmdq_pop(&q);
+    ix_cmdq_pop(&q);
+  }
+  for (auto i = 0u; i < IX_CMDQ_MAXSIZE; ++i) {
+    EXPECT_TRUE(ix_cmdq_push(&q, IX_CMD_HALT, 0));
+  }
+  EXPECT_FALSE(ix_cmdq_push(&q, IX_CMD_HALT, 0));
+  EXPECT_EQ(2u * IX_CMDQ_MAXSIZE, ix_cmdq_flush(&q, buf, sizeof buf));
+  EXPECT_EQ(0u, ix_cmdq_flush(&q, buf, sizeof buf));
+  ix_cmdq_pop(&q);
+  ix_cmdq_resend(&q);
+  EXPECT_EQ(IX_CMDQ_MAXSIZE - 1u, ix_cmdq_len(&q));
+  EXPECT_EQ(0u, ix_cmdq_in_flight(&q));
+  EXPECT_EQ(2u * (IX_CMDQ_MAXSIZE - 1), ix_cmdq_flush(&q, buf, sizeof buf));
+}
+
+}  // namespace
@@ -0,0 +1,114 @@
+// Copyright 2015 Steven Dee.
+
+// Connection benchmarks.
+//
+// k_links simulated headsets, all driven from this thread the way one event
+// loop would drive real ones: each answers every command with a response and
+// sends a chunk of packets every k_chunk_ms while started. One call brings
+// every connection up, streams k_rounds chunks through each, and stops it
+// again, so the row's cost per packet includes the handshakes and timers.
+
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include <muse_core/muse_core.h>
+
+#include "benchmark.h"
+#include "packet_builders.h"
+
+using std::vector;
+
+namespace {
+
+const auto k_links = 4096u;
+const auto k_rounds = 20u;
+const auto k_chunk_ms = 100u;
+const uint8_t k_ok[] = {'{', '"', 'r', 'c', '"', ':', '0', '}', '\r', '\n'};
+
+// About what a 220Hz headset sends in k_chunk_ms.
+parse_input chunk() {
+  auto ret = sync_packet();
+  for (auto i = 0u; i < 22; ++i) {
+    ret = ret + eeg_packet(512 + i, 512 - i, 500, 524);
+    if (i % 4 == 0) ret = ret + acc_packet(1, 2, 3);
+  }
+  return ret + drlref_packet(100, 200);
+}
+
+struct sim {
+  // Takes any number of commands, each ending in a newline.
+  static void send_f(const uint8_t* buf, uint32_t len, void* user_data) {
+    auto s = static_cast<sim*>(user_data);
+    for (auto cmd_start = true; len; ++buf, --len) {
+      if (cmd_start) {
+        auto cmd = static_cast<ix_cmd>(buf[0]);
+        if (cmd == IX_CMD_START) s->streaming = true;
+        if (cmd == IX_CMD_HALT) s->streaming = false;
+        if (ix_cmd_has_response(cmd)) ++s->pending;
+      }
+      cmd_start = buf[0] == '\n';
+    }
+  }
+
+  // Sends whatever the headset has to send by now.
+  void step(parse_input const& data, uint64_t now) {
+    for (; pending; --pending) {
+      ix_conn_feed(&c, k_ok, sizeof k_ok, now);
+    }
+    if (streaming) ix_conn_feed(&c, data.data(), data.size(), now);
+    else ix_conn_tick(&c, now);
+  }
+
+  ix_conn c;
+  uint32_t pending;
+  bool streaming;
+};
+
+}  // namespace
+
+void conn_benchmarks() {
+  auto data = chunk();
+  auto per_chunk = 0u;
+  {
+    ix_stream s;
+    ix_stream_init(&s, [](const ix_packet*, void* user_data) {
+      ++*static_cast<unsigned*>(user_data);
+    }, NULL, &per_chunk);
+    ix_stream_feed(&s, data.data(), data.size());
+  }
+  auto sims = vector<sim>(k_links);
+  // Six responses each, four to get ready and one each to start and stop,
+  // and k_rounds chunks.
+  auto bytes = uint64_t{k_links} * (6 * sizeof k_ok + k_rounds * data.size());
+
+  bench_run("conn/" + std::to_string(k_links) + "_links",
+            uint64_t{k_links} * k_rounds * per_chunk, bytes, [&] {
+    auto now = uint64_t{0};
+    for (auto& s : sims) {
+      s.pending = 0;
+      s.streaming = false;
+      ix_conn_init(&s.c, 21, ix_packet_format_eeg(4), sim::send_f, NULL, &s);
+      ix_conn_handle(&s.c, IX_CONN_LINK_UP, now);
+    }
+    // The configuration is pipelined, so one round trip gets to READY.
+    now += k_chunk_ms;
+    for (auto& s : sims) {
+      s.step(data, now);
+    }
+    for (auto& s : sims) {
+      ix_conn_handle(&s.c, IX_CONN_START, now);
+    }
+    for (auto i = 0u; i < k_rounds; ++i) {
+      now += k_chunk_ms;
+      for (auto& s : sims) {
+        s.step(data, now);
+      }
+    }
+    for (auto& s : sims) {
+      ix_conn_handle(&s.c, IX_CONN_STOP, now);
+      s.step(data, now + k_chunk_ms);
+      assert(ix_conn_get_state(&s.c) == IX_CONN_READY);
+    }
+  });
+}
@@ -0,0 +1,236 @@
+#include <cstdint>
+
+extern "C" {
+#include <muse_core/defs.h>
+#include <muse_core/packet.h>
+#include <muse_core/unpack.h>
+#include <muse_core/resync.h>
+#include <muse_core/stats.h>
+#include <muse_core/stream.h>
+#include <muse_core/command.h>
+#include <muse_core/conn.h>
+}
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "packet_builders.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test fixtures
+////////////////////////////////////////////////////////////////////////////////
+
+const auto k_ok = string("{\"rc\":0}");
+
+parse_input bytes(string const& s) {
+  return parse_input(s.begin(), s.end());
+}
+
+class ConnTest : public ::testing::Test {
+protected:
+  ConnTest(): now(0), packets(0) {
+    ix_conn_init(&c, 21, ix_packet_format_eeg(4), send_f, pac_f, this);
+    ix_conn_set_response_fn(&c, resp_f);
+  }
+
+  static void send_f(const uint8_t* buf, uint32_t len, void* user_data) {
+    static_cast<ConnTest*>(user_data)->sent.append(buf, buf + len);
+  }
+
+  static void pac_f(const ix_packet*, void* user_data) {
+    ++static_cast<ConnTest*>(user_data)->packets;
+  }
+
+  static void resp_f(ix_cmd cmd, const ix_response_reader* r,
+                     void* user_data) {
+    uint32_t len;
+    auto p = ix_response_text(r, &len);
+    static_cast<ConnTest*>(user_data)->responses.push_back(
+        string(1, static_cast<char>(cmd)) + string(p, len));
+  }
+
+  // Returns and forgets what was sent.
+  string take_sent() {
+    auto ret = sent;
+    sent.clear();
+    return ret;
+  }
+
+  ix_conn_state feed(parse_input const& buf) {
+    return ix_conn_feed(&c, buf.data(), buf.size(), now);
+  }
+
+  ix_conn_state feed(string const& s) { return feed(bytes(s)); }
+
+  ix_conn_state tick(uint64_t ms) {
+    now += ms;
+    return ix_conn_tick(&c, now);
+  }
+
+  // Brings the connection up to IX_CONN_READY.
+  void ready() {
+    ix_conn_handle(&c, IX_CONN_LINK_UP, now);
+    for (auto i = 0; i < 4; ++i) {
+      feed(k_ok);
+    }
+    ASSERT_EQ(IX_CONN_READY, ix_conn_get_state(&c));
+    take_sent();
+    responses.clear();
+  }
+
+  // Brings the connection up to IX_CONN_STREAMING.
+  void streaming() {
+    ready();
+    ix_conn_handle(&c, IX_CONN_START, now);
+    ASSERT_EQ(IX_CONN_STREAMING, feed(sync_packet()));
+    take_sent();
+  }
+
+  ix_conn c;
+  uint64_t now;
+  string sent;
+  vector<string> responses;
+  uint32_t packets;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test suite proper
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_F(ConnTest, Handshake) {
+  EXPECT_EQ(IX_CONN_DOWN, ix_conn_get_state(&c));
+  EXPECT_EQ(IX_CONN_DOWN, ix_conn_handle(&c, IX_CONN_START, now));
+  EXPECT_EQ("", take_sent());
+
+  // The whole configuration goes out at once.
+  EXPECT_EQ(IX_CONN_HALTING, ix_conn_handle(&c, IX_CONN_LINK_UP, now));
+  EXPECT_EQ("h\nv\n%21\ns\n", take_sent());
+  EXPECT_EQ(IX_CONN_VERSION, feed("\r\n" + k_ok + "\r\n"));
+  EXPECT_EQ(IX_CONN_VERSION, feed("{\"fw\":\"1.2\","));
+  EXPECT_EQ(IX_CONN_PRESET, feed("\"rc\":0}"));
+  EXPECT_EQ(IX_CONN_STATUS, feed(k_ok));
+  EXPECT_EQ(IX_CONN_READY, feed(k_ok));
+  EXPECT_EQ("", take_sent());
+  EXPECT_EQ((vector<string>{"h" + k_ok, "v{\"fw\":\"1.2\",\"rc\":0}",
+                            "%" + k_ok, "s" + k_ok}), responses);
+
+  EXPECT_EQ(IX_CONN_STARTING, ix_conn_handle(&c, IX_CONN_START, now));
+  EXPECT_EQ("d\n", take_sent());
+  EXPECT_EQ(IX_CONN_STREAMING, feed(sync_packet() + eeg_packet(1, 2, 3, 4)));
+  EXPECT_EQ(2u, packets);
+  EXPECT_STREQ("streaming", ix_conn_state_name(ix_conn_get_state(&c)));
+}
+
+TEST_F(ConnTest, Error) {
+  ix_conn_handle(&c, IX_CONN_LINK_UP, now);
+  feed(k_ok);
+  EXPECT_EQ(IX_CONN_FAILED, feed("{\"rc\":1}"));
+  EXPECT_EQ(IX_CONN_FAILED, tick(10000));
+  EXPECT_EQ(IX_CONN_FAILED, ix_conn_handle(&c, IX_CONN_START, now));
+  EXPECT_EQ("h\nv\n%21\ns\n", take_sent());
+  EXPECT_EQ(IX_CONN_HALTING, ix_conn_handle(&c, IX_CONN_LINK_UP, now));
+  EXPECT_EQ(IX_CONN_DOWN, ix_conn_handle(&c, IX_CONN_LINK_DOWN, now));
+}
+
+TEST_F(ConnTest, Pipelined) {
+  ix_conn_handle(&c, IX_CONN_LINK_UP, now);
+  auto pac = eeg_packet(1, 2, 3, 4);
+  auto ok = bytes(k_ok);
+  EXPECT_EQ(IX_CONN_READY, feed(pac + ok + ok + ok + ok + pac + pac + pac));
+  EXPECT_EQ(4u, packets);
+  EXPECT_EQ((vector<string>{"h" + k_ok, "v" + k_ok, "%" + k_ok,
+                            "s" + k_ok}), responses);
+  // Extra responses, e.g. to retries, are dropped.
+  EXPECT_EQ(IX_CONN_READY, feed(ok + ok));
+  EXPECT_EQ(4u, responses.size());
+}
+
+TEST_F(ConnTest, Retries) {
+  ix_conn_handle(&c, IX_CONN_LINK_UP, now);
+  EXPECT_EQ(IX_CONN_HALTING, tick(IX_CONN_RESPONSE_MS - 1));
+  EXPECT_EQ("h\nv\n%21\ns\n", take_sent());
+  for (auto i = 1u; i < IX_CONN_TRIES; ++i) {
+    EXPECT_EQ(IX_CONN_HALTING, tick(1));
+    EXPECT_EQ("h\nv\n%21\ns\n", take_sent());
+    tick(IX_CONN_RESPONSE_MS - 1);
+  }
+  // A response half read before a retry still counts, and only what is
+  // unanswered is sent again.
+  feed("{\"rc\"");
+  EXPECT_EQ(IX_CONN_VERSION, feed(":0}"));
+  EXPECT_EQ("", take_sent());
+
+  for (auto i = 0u; i < IX_CONN_TRIES; ++i) {
+    EXPECT_EQ(IX_CONN_VERSION, tick(IX_CONN_RESPONSE_MS - 1));
+    EXPECT_EQ(i ? "v\n%21\ns\n" : "", take_sent());
+    tick(1);
+  }
+  EXPECT_EQ(IX_CONN_FAILED, ix_conn_get_state(&c));
+}
+
+TEST_F(ConnTest, Streaming) {
+  streaming();
+  auto pac = eeg_packet(1, 2, 3, 4);
+  for (auto t = 0u; t < 3 * IX_CONN_KEEPALIVE_MS; t += 500) {
+    EXPECT_EQ(IX_CONN_STREAMING, feed(pac));
+    tick(500);
+  }
+  EXPECT_EQ("k\nk\nk\n", take_sent());
+
+  // No data: start again.
+  feed(pac);
+  EXPECT_EQ(IX_CONN_STREAMING, tick(IX_CONN_DATA_MS - 1));
+  EXPECT_EQ(IX_CONN_STARTING, tick(1));
+  EXPECT_EQ("d\n", take_sent());
+  EXPECT_EQ(IX_CONN_STARTING, tick(IX_CONN_DATA_MS));
+  EXPECT_EQ("d\n", take_sent());
+  EXPECT_EQ(IX_CONN_STREAMING, feed(pac));
+
+  // Stopping waits for the halt response, through whatever data is still
+  // coming.
+  EXPECT_EQ(IX_CONN_STOPPING, ix_conn_handle(&c, IX_CONN_STOP, now));
+  EXPECT_EQ("h\n", take_sent());
+  auto before = packets;
+  EXPECT_EQ(IX_CONN_STOPPING, feed(pac + bytes("\r\n{\"rc\"") + pac));
+  EXPECT_EQ(IX_CONN_READY, feed(bytes(":0}") + pac));
+  EXPECT_EQ(before + 3, packets);
+  EXPECT_EQ((vector<string>{"h" + k_ok}), responses);
+  EXPECT_EQ(IX_CONN_READY, tick(IX_CONN_DATA_MS + IX_CONN_KEEPALIVE_MS));
+  EXPECT_EQ("", take_sent());
+}
+
+TEST_F(ConnTest, CarriedOver) {
+  streaming();
+  ix_conn_handle(&c, IX_CONN_STOP, now);
+  // What looks like the start of a packet is carried over to the next feed,
+  // and only then skipped, along with the response after it.
+  auto sync = sync_packet();
+  auto pac = eeg_packet(1, 2, 3, 4);
+  EXPECT_EQ(IX_CONN_STOPPING,
+            feed(pac + parse_input(sync.begin(), sync.begin() + 2)));
+  EXPECT_EQ(IX_CONN_READY, feed(bytes("\r\n{\"rc\":0}") + pac));
+  EXPECT_EQ((vector<string>{"h" + k_ok}), responses);
+}
+
+TEST_F(ConnTest, LinkDown) {
+  streaming();
+  auto pac = eeg_packet(1, 2, 3, 4);
+  feed(parse_input(pac.begin(), pac.begin() + 3));
+  EXPECT_EQ(IX_CONN_DOWN, ix_conn_handle(&c, IX_CONN_LINK_DOWN, now));
+  EXPECT_EQ(IX_CONN_DOWN, tick(100000));
+  EXPECT_EQ("", take_sent());
+  // Nothing from the old link is carried over.
+  auto before = packets;
+  ix_conn_handle(&c, IX_CONN_LINK_UP, now);
+  feed(parse_input(pac.begin() + 3, pac.end()) + bytes(k_ok));
+  EXPECT_EQ(IX_CONN_VERSION, ix_conn_get_state(&c));
+  EXPECT_EQ(before, packets);
+}
+
+}  // namespace
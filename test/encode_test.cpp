@@ -0,0 +1,171 @@
+#include <cstdint>
+
+extern "C" {
+#include <muse_core/defs.h>
+#include <muse_core/packet.h>
+#include <muse_core/encode.h>
+}
+
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+#include "packet_builders.h"
+#include "stream_generator.h"
+
+using std::mt19937;
+using std::vector;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test fixtures
+////////////////////////////////////////////////////////////////////////////////
+
+bool same(ix_packet const& a, ix_packet const& b) {
+  auto t = ix_packet_type(&a);
+  if (t != ix_packet_type(&b)) return false;
+  if (t == IX_PAC_ERROR) return ix_packet_error(&a) == ix_packet_error(&b);
+  if (ix_packet_channels(&a) != ix_packet_channels(&b)) return false;
+  for (auto c = 0u; c < ix_packet_channels(&a); ++c) {
+    if (ix_packet_ch(&a, c) != ix_packet_ch(&b, c)) return false;
+  }
+  return (t != IX_PAC_EEG && t != IX_PAC_ACCELEROMETER) ||
+         ix_packet_dropped_samples(&a) == ix_packet_dropped_samples(&b);
+}
+
+vector<ix_packet> parse(const ix_packet_format* fmt, const uint8_t* buf,
+                        size_t len) {
+  auto ret = vector<ix_packet>(len);
+  uint32_t n, used;
+  EXPECT_EQ(IX_PARSE_END, ix_packet_parse_into_fmt(fmt, buf, len, ret.data(),
+                                                   ret.size(), &n, &used));
+  EXPECT_EQ(len, used);
+  ret.resize(n);
+  return ret;
+}
+
+class EncodeTest : public ::testing::Test {
+protected:
+  EncodeTest(): rng(0) {}
+
+  uint16_t sample() { return rng() % 1024; }
+
+  // Checks that encode writes exactly want, and nothing at all into any
+  // buffer that is too small.
+  template <typename F>
+  void expect_encodes(parse_input const& want, F encode) {
+    uint8_t buf[IX_PAC_MAXSIZE];
+    memset(buf, 0x5a, sizeof buf);
+    ASSERT_EQ(want.size(), encode(buf, sizeof buf));
+    EXPECT_EQ(want, parse_input(buf, buf + want.size()));
+    for (auto len = 0u; len < want.size(); ++len) {
+      memset(buf, 0x5a, sizeof buf);
+      EXPECT_EQ(0u, encode(buf, len));
+      EXPECT_EQ(parse_input(sizeof buf, 0x5a),
+                parse_input(buf, buf + sizeof buf));
+    }
+  }
+
+  mt19937 rng;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test suite proper
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_F(EncodeTest, MatchesBuilders) {
+  expect_encodes(sync_packet(), [](uint8_t* b, uint32_t n) {
+    return ix_encode_sync(b, n);
+  });
+  for (auto i = 0; i < 100; ++i) {
+    auto err = static_cast<uint32_t>(rng());
+    expect_encodes(error_packet(err), [=](uint8_t* b, uint32_t n) {
+      return ix_encode_error(b, n, err);
+    });
+    auto pct = sample(), fuel = static_cast<uint16_t>(rng());
+    auto temp = static_cast<int16_t>(rng());
+    expect_encodes(battery_packet(pct, fuel, 3, temp),
+                   [=](uint8_t* b, uint32_t n) {
+      return ix_encode_battery(b, n, pct, fuel, 3, temp);
+    });
+    auto drl = sample(), ref = sample();
+    expect_encodes(drlref_packet(drl, ref), [=](uint8_t* b, uint32_t n) {
+      return ix_encode_drlref(b, n, drl, ref);
+    });
+    uint16_t acc[3] = {sample(), sample(), sample()};
+    auto dropped = static_cast<uint16_t>(rng() | 1);
+    expect_encodes(acc_packet(acc[0], acc[1], acc[2]),
+                   [&](uint8_t* b, uint32_t n) {
+      return ix_encode_acc(b, n, acc, 0);
+    });
+    expect_encodes(acc_packet(dropped, acc[0], acc[1], acc[2]),
+                   [&](uint8_t* b, uint32_t n) {
+      return ix_encode_acc(b, n, acc, dropped);
+    });
+    uint16_t eeg[6] = {sample(), sample(), sample(), sample(), sample(),
+                       sample()};
+    expect_encodes(eeg_packet(eeg[0], eeg[1], eeg[2], eeg[3]),
+                   [&](uint8_t* b, uint32_t n) {
+      return ix_encode_eeg(b, n, eeg, 4, 0);
+    });
+    expect_encodes(eeg_packet(dropped, eeg[0], eeg[1], eeg[2], eeg[3]),
+                   [&](uint8_t* b, uint32_t n) {
+      return ix_encode_eeg(b, n, eeg, 4, dropped);
+    });
+    for (auto ch : {2u, 6u}) {
+      auto v = vector<uint16_t>(eeg, eeg + ch);
+      expect_encodes(eeg_packet_n(v), [&](uint8_t* b, uint32_t n) {
+        return ix_encode_eeg(b, n, eeg, ch, 0);
+      });
+      expect_encodes(eeg_packet_n(dropped, v), [&](uint8_t* b, uint32_t n) {
+        return ix_encode_eeg(b, n, eeg, ch, dropped);
+      });
+    }
+  }
+}
+
+TEST_F(EncodeTest, Unsendable) {
+  uint8_t buf[IX_PAC_MAXSIZE];
+  uint16_t s[6] = {0, 1024, 0, 0, 0, 0};
+  EXPECT_EQ(0u, ix_encode_eeg(buf, sizeof buf, s, 4, 0));
+  EXPECT_EQ(0u, ix_encode_eeg(buf, sizeof buf, s + 2, 3, 0));
+  EXPECT_EQ(0u, ix_encode_acc(buf, sizeof buf, s, 7));
+  EXPECT_EQ(0u, ix_encode_drlref(buf, sizeof buf, 1024, 0));
+  EXPECT_EQ(0u, ix_encode_drlref(buf, sizeof buf, 0, 0xffff));
+}
+
+TEST_F(EncodeTest, RoundTrip) {
+  // Every preset, every packet type: whatever parses encodes back to exactly
+  // the bytes it came from, and so to something that parses the same.
+  for (auto ch : {2u, 4u, 6u}) {
+    auto p = headset_profile::eeg_256hz();
+    p.eeg_channels = ch;
+    p.drop_rate = 0.05;
+    p.battery_hz = 20;
+    auto fmt = ix_packet_format_eeg(ch);
+    auto buf = parse_input(20000);
+    auto gen = stream_generator(p, ch);
+    gen.fill(buf.data(), buf.size());
+    auto wire = parse_input();
+    uint32_t n, used;
+    auto pacs = vector<ix_packet>(buf.size());
+    ix_packet_parse_into_fmt(fmt, buf.data(), buf.size(), pacs.data(),
+                             pacs.size(), &n, &used);
+    pacs.resize(n);
+    for (auto const& pac : pacs) {
+      uint8_t out[IX_PAC_MAXSIZE];
+      auto len = ix_packet_encode(&pac, out, sizeof out);
+      ASSERT_LT(0u, len);
+      wire.insert(wire.end(), out, out + len);
+    }
+    EXPECT_EQ(parse_input(buf.begin(), buf.begin() + used), wire);
+    auto again = parse(fmt, wire.data(), wire.size());
+    ASSERT_EQ(pacs.size(), again.size());
+    for (auto i = 0u; i < pacs.size(); ++i) {
+      EXPECT_TRUE(same(pacs[i], again[i])) << ch << " " << i;
+    }
+  }
+}
+
+}  // namespace
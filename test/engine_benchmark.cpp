@@ -0,0 +1,120 @@
+// Copyright 2015 Steven Dee.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <muse_core/muse_core.h>
+
+#include "benchmark.h"
+#include "packet_builders.h"
+#include "stream_generator.h"
+
+using std::vector;
+
+namespace {
+
+const auto k_streams = 64u;
+const auto k_stream_bytes = 256u * 1024;
+const auto k_chunk = 1024u;         // About what one link read delivers.
+const auto k_buf_size = 16u * 1024;
+const auto k_split_bytes = 32u * 1024 * 1024;
+
+// Seconds to parse all of streams with n_workers workers, fed from this
+// thread in k_chunk pieces round-robin. Stores the packets delivered.
+double engine_secs(vector<parse_input> const& streams, uint32_t n_workers,
+                   uint64_t* packets) {
+  ix_packet_fn count_f = [](const ix_packet*, void* user_data) {
+    ++*static_cast<uint64_t*>(user_data);
+  };
+  auto counts = vector<uint64_t>(streams.size(), 0);
+  auto e = ix_engine_new(n_workers, streams.size(), k_buf_size);
+  auto handles = vector<ix_engine_stream*>();
+  for (auto i = 0u; i < streams.size(); ++i) {
+    handles.push_back(ix_engine_add_stream(e, ix_packet_format_eeg(4),
+                                           count_f, NULL, &counts[i]));
+  }
+  auto offs = vector<size_t>(streams.size(), 0);
+
+  auto start = std::chrono::steady_clock::now();
+  for (auto busy = true; busy; ) {
+    busy = false;
+    for (auto i = 0u; i < streams.size(); ++i) {
+      auto n = std::min<size_t>(k_chunk, streams[i].size() - offs[i]);
+      if (!n) continue;
+      busy = true;
+      auto fed = ix_engine_feed(handles[i], streams[i].data() + offs[i], n);
+      if (!fed) std::this_thread::yield();
+      offs[i] += fed;
+    }
+  }
+  ix_engine_drain(e);
+  auto secs = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  ix_engine_free(e);
+  *packets = 0;
+  for (auto c : counts) {
+    *packets += c;
+  }
+  return secs;
+}
+
+// Seconds to parse buf with ix_split_feed on n_workers workers. Stores the
+// packets delivered.
+double split_secs(parse_input const& buf, uint32_t n_workers,
+                  uint64_t* packets) {
+  ix_packet_fn count_f = [](const ix_packet*, void* user_data) {
+    ++*static_cast<uint64_t*>(user_data);
+  };
+  ix_stream s;
+  *packets = 0;
+  ix_stream_init(&s, count_f, NULL, packets);
+
+  auto start = std::chrono::steady_clock::now();
+  ix_split_feed(&s, buf.data(), buf.size(), n_workers, 0);
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+// Aggregate throughput of k_streams simulated headsets, and of one long
+// recording, with 1, 2, 4, ... workers, up to the number of CPUs.
+void engine_benchmarks() {
+  auto streams = vector<parse_input>();
+  auto bytes = uint64_t{0};
+  for (auto i = 0u; i < k_streams; ++i) {
+    streams.push_back(parse_input(k_stream_bytes));
+    stream_generator(headset_profile::eeg_220hz(), i).fill(
+        streams.back().data(), k_stream_bytes);
+    bytes += k_stream_bytes;
+  }
+  auto n_cpus = std::max(1u, std::thread::hardware_concurrency());
+  auto workers = vector<uint32_t>();
+  for (auto n = 1u; n < n_cpus; n *= 2) {
+    workers.push_back(n);
+  }
+  workers.push_back(n_cpus);
+
+  for (auto n : workers) {
+    uint64_t packets;
+    auto secs = engine_secs(streams, n, &packets);
+    bench_record("engine/" + std::to_string(k_streams) + "_streams/" +
+                 std::to_string(n) + "_workers", packets, bytes, secs);
+  }
+
+  // One long recording, split up at sync packets.
+  auto recording = parse_input(k_split_bytes);
+  stream_generator(headset_profile::eeg_220hz(), 0).fill(recording.data(),
+                                                         recording.size());
+  for (auto n : workers) {
+    uint64_t packets;
+    auto secs = split_secs(recording, n, &packets);
+    bench_record("split/" + std::to_string(n) + "_workers", packets,
+                 recording.size(), secs);
+  }
+}
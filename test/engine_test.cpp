@@ -0,0 +1,222 @@
+#include <cstdint>
+
+extern "C" {
+#include <muse_core/defs.h>
+#include <muse_core/packet.h>
+#include <muse_core/unpack.h>
+#include <muse_core/resync.h>
+#include <muse_core/stats.h>
+#include <muse_core/stream.h>
+#include <muse_core/engine.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <gtest/gtest.h>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "packet_builders.h"
+
+using std::atomic;
+using std::mt19937;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test fixtures
+////////////////////////////////////////////////////////////////////////////////
+
+// What one engine stream has delivered so far.
+struct Consumer {
+  Consumer(): in_callback(false), overlapped(false), skipped(0) {}
+
+  vector<uint32_t> types;
+  vector<uint16_t> firsts;
+  atomic<bool> in_callback;
+  bool overlapped;
+  uint32_t skipped;
+};
+
+void pac_f(const ix_packet* p, void* user_data) {
+  auto c = static_cast<Consumer*>(user_data);
+  if (c->in_callback.exchange(true)) {
+    c->overlapped = true;
+  }
+  auto t = ix_packet_type(p);
+  c->types.push_back(t);
+  c->firsts.push_back(t == IX_PAC_EEG ? ix_packet_ch(p, 0) : 0);
+  c->in_callback = false;
+}
+
+void corrupt_f(uint64_t, uint32_t skipped, void* user_data) {
+  static_cast<Consumer*>(user_data)->skipped += skipped;
+}
+
+class EngineTest : public ::testing::Test {
+protected:
+  EngineTest(): rng(0), e(NULL) {}
+
+  ~EngineTest() {
+    if (e) {
+      ix_engine_free(e);
+    }
+  }
+
+  uint16_t sample() { return rng() % 1024; }
+
+  parse_input stream(size_t n) {
+    auto ret = parse_input();
+    for (auto i = 0u; i < n; ++i) {
+      switch (rng() % 4) {
+      case 0: ret = ret + acc_packet(sample(), sample(), sample()); break;
+      case 1: ret = ret + battery_packet(sample(), 2, 3, 4); break;
+      default:
+        ret = ret + eeg_packet(sample(), sample(), sample(), sample());
+      }
+    }
+    return ret;
+  }
+
+  // Feeds buf in random chunks, waiting whenever the stream's buffer is full.
+  void feed(ix_engine_stream* s, parse_input const& buf, size_t* off,
+            size_t max_chunk) {
+    auto n = std::min<size_t>(1 + rng() % max_chunk, buf.size() - *off);
+    while (n) {
+      auto fed = ix_engine_feed(s, buf.data() + *off, n);
+      *off += fed;
+      n -= fed;
+      if (n) std::this_thread::yield();
+    }
+  }
+
+  // What a single ix_stream makes of buf.
+  static unique_ptr<Consumer> expected(parse_input const& buf) {
+    auto c = unique_ptr<Consumer>(new Consumer);
+    ix_stream s;
+    ix_stream_init(&s, pac_f, corrupt_f, c.get());
+    ix_stream_feed(&s, buf.data(), buf.size());
+    return c;
+  }
+
+  mt19937 rng;
+  ix_engine* e;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test suite proper
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_F(EngineTest, Limits) {
+  EXPECT_EQ(NULL, ix_engine_new(1, 0, 64));
+  EXPECT_EQ(NULL, ix_engine_new(1, 2, 0));
+  e = ix_engine_new(0, 2, 64);
+  ASSERT_NE(nullptr, e);
+  EXPECT_LE(1u, ix_engine_workers(e));
+  Consumer c;
+  auto fmt = ix_packet_format_eeg(4);
+  EXPECT_NE(nullptr, ix_engine_add_stream(e, fmt, pac_f, NULL, &c));
+  EXPECT_NE(nullptr, ix_engine_add_stream(e, fmt, pac_f, NULL, &c));
+  EXPECT_EQ(NULL, ix_engine_add_stream(e, fmt, pac_f, NULL, &c));
+  ix_engine_drain(e);
+}
+
+TEST_F(EngineTest, MatchesStream) {
+  const auto n_streams = 24u;
+  e = ix_engine_new(4, n_streams, 256);
+  ASSERT_NE(nullptr, e);
+  auto consumers = vector<unique_ptr<Consumer>>();
+  auto streams = vector<ix_engine_stream*>();
+  auto bufs = vector<parse_input>();
+  for (auto i = 0u; i < n_streams; ++i) {
+    consumers.emplace_back(new Consumer);
+    streams.push_back(ix_engine_add_stream(e, ix_packet_format_eeg(4), pac_f,
+                                           corrupt_f, consumers.back().get()));
+    ASSERT_NE(nullptr, streams.back());
+    // Some streams get much more data than others.
+    bufs.push_back(stream(i % 3 ? 50 : 600));
+  }
+  auto offs = vector<size_t>(n_streams, 0);
+  for (auto busy = true; busy; ) {
+    busy = false;
+    for (auto i = 0u; i < n_streams; ++i) {
+      if (offs[i] < bufs[i].size()) {
+        feed(streams[i], bufs[i], &offs[i], 300);
+        busy = true;
+      }
+    }
+  }
+  ix_engine_drain(e);
+  for (auto i = 0u; i < n_streams; ++i) {
+    auto want = expected(bufs[i]);
+    EXPECT_EQ(want->types, consumers[i]->types) << i;
+    EXPECT_EQ(want->firsts, consumers[i]->firsts) << i;
+    EXPECT_EQ(0u, consumers[i]->skipped) << i;
+    EXPECT_FALSE(consumers[i]->overlapped) << i;
+  }
+}
+
+TEST_F(EngineTest, FreeFinishesFedData) {
+  e = ix_engine_new(2, 1, 4096);
+  ASSERT_NE(nullptr, e);
+  Consumer c;
+  auto s = ix_engine_add_stream(e, ix_packet_format_eeg(4), pac_f, corrupt_f,
+                                &c);
+  auto buf = stream(100);
+  ASSERT_GE(4096u, buf.size());
+  EXPECT_EQ(buf.size(), ix_engine_feed(s, buf.data(), buf.size()));
+  ix_engine_free(e);
+  e = NULL;
+  EXPECT_EQ(expected(buf)->types, c.types);
+}
+
+TEST_F(EngineTest, FeedDoesNotWaitForParsing) {
+  // A consumer stuck in its callback holds up its own stream only.
+  static atomic<bool> release;
+  release = false;
+  ix_packet_fn stuck_f = [](const ix_packet*, void* user_data) {
+    while (!release) std::this_thread::yield();
+    ++*static_cast<atomic<uint32_t>*>(user_data);
+  };
+  ix_packet_fn count_f = [](const ix_packet*, void* user_data) {
+    ++*static_cast<atomic<uint32_t>*>(user_data);
+  };
+  atomic<uint32_t> n_stuck(0), n_other(0);
+  e = ix_engine_new(2, 2, 64);
+  ASSERT_NE(nullptr, e);
+  auto fmt = ix_packet_format_eeg(4);
+  auto stuck = ix_engine_add_stream(e, fmt, stuck_f, NULL, &n_stuck);
+  auto other = ix_engine_add_stream(e, fmt, count_f, NULL, &n_other);
+
+  auto buf = parse_input();
+  while (buf.size() < 200) {
+    buf = buf + eeg_packet(1u, 2u, 3u, 4u);
+  }
+  auto fed = size_t{0};
+  for (auto i = 0; i < 10; ++i) {
+    fed += ix_engine_feed(stuck, buf.data() + fed, buf.size() - fed);
+  }
+  EXPECT_GT(buf.size(), fed);
+
+  // The other worker keeps the other stream going meanwhile.
+  auto pac = eeg_packet(5u, 6u, 7u, 8u);
+  EXPECT_EQ(pac.size(), ix_engine_feed(other, pac.data(), pac.size()));
+  for (auto i = 0; i < 1000000 && !n_other; ++i) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(1u, n_other);
+  EXPECT_EQ(0u, n_stuck);
+
+  release = true;
+  while (fed < buf.size()) {
+    feed(stuck, buf, &fed, buf.size());
+  }
+  ix_engine_drain(e);
+  EXPECT_EQ(expected(buf)->types.size(), n_stuck);
+}
+
+}  // namespace
@@ -1,94 +1,241 @@
 // Copyright 2015 Steven Dee.
 
 // Packet parser benchmarks.
-// This is kinda hack-and-slash just to get some useful numbers right away.
+//
+// Case names are <what>/<input>[/<variant>]:
+//   init/<decoder>           building and compiling a hammer grammar, once,
+//                            as one packet
+//   single/<type>/<decoder>  one packet of each type, parsed on its own
+//   est_len/<stream>         walking a stream with ix_packet_est_len
+//   parse_all/<stream>       ix_packet_parse_all over a whole stream
+//   parse_batch/<stream>     ix_packet_parse_all_batch
+//   parse_into/<stream>      ix_packet_parse_into with an IX_PARSE_BATCH array
+//   eeg_sum/<stream>/<api>   summing EEG channel 1 through a callback from
+//                            ix_packet_parse_all, or from an ix_packet_cursor
+//   parse_loop/<stream>/<decoder>  ix_packet_parse_with a hammer decoder
+//                            in a loop
+//   stream/<stream>/<resync>  ix_stream fed in link-sized chunks
+//   generate/<stream>         stream_generator itself, for comparison
+// Streams come from stream_generator. Only ix_stream gets through corrupt
+// streams, so they only get stream/ cases. Decoders are table, hammer
+// (packrat), hammer_llk, hammer_lalr and hammer_glr; a hammer backend that
+// rejects the grammar only gets an init/ case.
 
+#include <algorithm>
 #include <cassert>
-#include <cmath>
-
-#include <memory>
+#include <chrono>
+#include <cstdlib>
+#include <random>
 #include <string>
 #include <vector>
 
-#include <hammer/hammer.h>
-#include <hammer/glue.h>
 #include <muse_core/muse_core.h>
 
+#include "benchmark.h"
 #include "packet_builders.h"
+#include "stream_generator.h"
 
-using std::unique_ptr;
+using std::mt19937;
+using std::string;
 using std::vector;
 
+namespace {
 
-#define PAC_MIN IX_PAC_SYNC
-#define PAC_MAX IX_PAC_DRLREF
-#define PAC_N (PAC_MAX - PAC_MIN + 1)
+const auto k_stream_bytes = 64u * 1024;
+const auto k_chunk = 512u;
 
-extern HParser *g_ix_packet;
+struct named_input {
+  string name;
+  parse_input bytes;
+};
 
-// TODO(soon): separate benchmark main from individual benchmarks
-int main() {
-    srand(0);   // We're going for arbitrary, not random, here.
-    auto rand_eeg_packet = [] {
-        return eeg_packet(rand() % 1024, rand() % 1024, rand() % 1024,
-                          rand() % 1024);
-    };
-    auto rand_dropped_eeg_packet = [] {
-        return eeg_packet(rand(), rand() % 1024, rand() % 1024, rand() % 1024,
-                          rand() % 1024);
-    };
-    auto rand_acc_packet = [] {
-        return acc_packet(rand() % 1024, rand() % 1024, rand() % 1024);
-    };
-    auto rand_dropped_acc_packet = [] {
-        return acc_packet(rand(), rand() % 1024, rand() % 1024, rand() % 1024);
-    };
-    auto rand_drlref_packet = [] {
-        return drlref_packet(rand() % 1024, rand() % 1024);
-    };
-    auto rand_battery_packet = [] {
-        return battery_packet(rand(), rand(), rand(), rand() - RAND_MAX / 2);
-    };
-    auto rand_error_packet = [] {
-        return error_packet(rand());
-    };
+ix_packet_fn nil_f = [](const ix_packet*, void*) {};
 
-    auto all_types = std::vector<parse_input>();
-    auto names = std::vector<std::string>();
-    for (auto i = 0u; i < PAC_N; ++i) {
-        auto input = parse_input();
-        auto name = std::string();
-        switch (static_cast<ix_pac_type>(i) + PAC_MIN) {
-        case IX_PAC_SYNC: name = "SYNC"; input = sync_packet(); break;
-        case IX_PAC_ERROR: name = "ERROR"; input = rand_error_packet(); break;
-        case IX_PAC_EEG: name = "EEG4"; input = rand_eeg_packet(); break;
-        case IX_PAC_BATTERY: name = "BATTERY"; input = rand_battery_packet(); break;
-        case IX_PAC_ACCELEROMETER: name = "ACC"; input = rand_acc_packet(); break;
-        case IX_PAC_DRLREF: name = "DRL_REF"; input = rand_drlref_packet(); break;
-        default: assert(false);
-        }
-        all_types.push_back(input);
-        names.push_back(name);
-    }
+const char* decoder_name(ix_decoder d) {
+  switch (d) {
+  case IX_DECODER_TABLE: return "table";
+  case IX_DECODER_HAMMER: return "hammer";
+  case IX_DECODER_HAMMER_LLK: return "hammer_llk";
+  case IX_DECODER_HAMMER_LALR: return "hammer_lalr";
+  case IX_DECODER_HAMMER_GLR: return "hammer_glr";
+  }
+  return "?";
+}
+
+// The decoders to benchmark: the table decoder, and every hammer backend
+// that takes the grammar.
+vector<ix_decoder> g_decoders;
+
+ix_packet_fn count_f = [](const ix_packet*, void* user_data) {
+  ++*static_cast<uint64_t*>(user_data);
+};
 
-    auto extras = std::vector<parse_input>{rand_dropped_eeg_packet(), rand_dropped_acc_packet()};
-    names.push_back("EEG4_D");
-    names.push_back("ACC_D");
+// Where eeg_sum/ cases leave their sums, so they can't be optimized away.
+volatile uint64_t g_sink;
+
+// One of each kind of packet.
+vector<named_input> single_packets(mt19937& rng) {
+  auto sample = [&] { return static_cast<uint16_t>(rng() % 1024); };
+  return {
+    {"SYNC", sync_packet()},
+    {"ERROR", error_packet(rng())},
+    {"EEG4", eeg_packet(sample(), sample(), sample(), sample())},
+    {"EEG4_D", eeg_packet(rng(), sample(), sample(), sample(), sample())},
+    {"BATTERY", battery_packet(rng(), rng(), rng(), rng())},
+    {"ACC", acc_packet(sample(), sample(), sample())},
+    {"ACC_D", acc_packet(rng(), sample(), sample(), sample())},
+    {"DRL_REF", drlref_packet(sample(), sample())},
+  };
+}
+
+parse_input generated(headset_profile const& p) {
+  auto ret = parse_input(k_stream_bytes);
+  stream_generator(p, 0).fill(ret.data(), ret.size());
+  return ret;
+}
 
-    for (auto i = 0u; i < names.size(); ++i) {
-        printf("%d: %s\n", i, names[i].c_str());
+uint64_t count_packets(parse_input const& buf,
+                       ix_resync_mode mode = IX_RESYNC_HEADERS) {
+  auto n = uint64_t{0};
+  ix_stream s;
+  ix_stream_init(&s, count_f, NULL, &n);
+  ix_stream_set_resync(&s, mode);
+  ix_stream_feed(&s, buf.data(), buf.size());
+  return n;
+}
+
+void feed_in_chunks(ix_stream* s, parse_input const& buf) {
+  for (auto off = 0u; off < buf.size(); off += k_chunk) {
+    ix_stream_feed(s, buf.data() + off,
+                   std::min<size_t>(k_chunk, buf.size() - off));
+  }
+}
+
+void stream_cases(named_input const& in) {
+  for (auto mode : {IX_RESYNC_HEADERS, IX_RESYNC_SYNC}) {
+    auto packets = count_packets(in.bytes, mode);
+    ix_stream s;
+    ix_stream_init(&s, nil_f, NULL, NULL);
+    ix_stream_set_resync(&s, mode);
+    bench_run("stream/" + in.name + (mode == IX_RESYNC_SYNC ? "/sync" :
+                                     "/headers"),
+              packets, in.bytes.size(), [&] {
+      // Each rep starts from a fresh stream, not from the last one's carry.
+      ix_stream_reset(&s);
+      feed_in_chunks(&s, in.bytes);
+    });
+  }
+}
+
+void whole_stream_cases(named_input const& in) {
+  auto const& buf = in.bytes;
+  auto packets = count_packets(buf);
+  auto walk = [&] {
+    auto n = uint64_t{0};
+    for (auto off = 0u; off < buf.size(); ++n) {
+      auto k = ix_packet_est_len(buf.data() + off, buf.size() - off);
+      if (!k) break;
+      off += k;
     }
+    return n;
+  };
 
-    auto inputs = all_types;
-    inputs.insert(inputs.end(), extras.cbegin(), extras.cend());
+  bench_run("est_len/" + in.name, walk(), buf.size(), walk);
+  bench_run("parse_all/" + in.name, packets, buf.size(), [&] {
+    ix_packet_parse_all(buf.data(), buf.size(), nil_f, NULL, NULL);
+  });
+  bench_run("parse_batch/" + in.name, packets, buf.size(), [&] {
+    ix_packets_fn f = [](const ix_packet*, uint32_t, void*) {};
+    ix_packet_parse_all_batch(buf.data(), buf.size(), f, NULL, NULL);
+  });
+  bench_run("eeg_sum/" + in.name + "/callback", packets, buf.size(), [&] {
+    ix_packet_fn f = [](const ix_packet* p, void* user_data) {
+      if (ix_packet_type(p) == IX_PAC_EEG) {
+        *static_cast<uint64_t*>(user_data) += ix_packet_eeg_ch1(p);
+      }
+    };
+    auto sum = uint64_t{0};
+    ix_packet_parse_all(buf.data(), buf.size(), f, &sum, NULL);
+    g_sink = sum;
+  });
+  bench_run("eeg_sum/" + in.name + "/cursor", packets, buf.size(), [&] {
+    ix_packet_cursor c;
+    ix_packet p;
+    auto sum = uint64_t{0};
+    ix_packet_cursor_init(&c, buf.data(), buf.size());
+    while (ix_packet_cursor_next(&c, &p) == IX_PARSE_FULL) {
+      if (ix_packet_type(&p) == IX_PAC_EEG) sum += ix_packet_eeg_ch1(&p);
+    }
+    g_sink = sum;
+  });
+  bench_run("parse_into/" + in.name, packets, buf.size(), [&] {
+    ix_packet out[IX_PARSE_BATCH];
+    uint32_t off = 0, n, consumed;
+    while (ix_packet_parse_into(buf.data() + off, buf.size() - off, out,
+                                IX_PARSE_BATCH, &n, &consumed)
+           == IX_PARSE_FULL) {
+      off += consumed;
+    }
+  });
+  for (auto decoder : g_decoders) {
+    if (decoder == IX_DECODER_TABLE) continue;
+    bench_run("parse_loop/" + in.name + "/" + decoder_name(decoder), packets,
+              buf.size(), [&] {
+      for (auto off = 0u; off < buf.size(); ) {
+        auto r = ix_packet_parse_with(decoder, buf.data() + off,
+                                      buf.size() - off, nil_f, NULL);
+        if (!r) break;
+        off += r;
+      }
+    });
+  }
+  stream_cases(in);
+}
+
+}  // namespace
+
+void packet_benchmarks() {
+  auto rng = mt19937(0);   // We're going for arbitrary, not random, here.
 
-    auto tests = std::vector<HParserTestcase>();
-    tests.reserve(inputs.size() + 1);
-    for (auto i = 0u; i < inputs.size(); ++i) {
-        tests.push_back({(unsigned char*)inputs[i].data(), inputs[i].size(), const_cast<char*>("<u>")});
+  // Only the first call for each decoder does anything, so these have to
+  // come before any hammer parse.
+  g_decoders = {IX_DECODER_TABLE};
+  for (auto decoder : {IX_DECODER_HAMMER, IX_DECODER_HAMMER_LLK,
+                       IX_DECODER_HAMMER_LALR, IX_DECODER_HAMMER_GLR}) {
+    auto start = std::chrono::steady_clock::now();
+    auto runs_as = ix_packet_compile(decoder);
+    bench_record(string("init/") + decoder_name(decoder), 1, 0,
+                 std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start).count());
+    if (runs_as == decoder) g_decoders.push_back(decoder);
+  }
+
+  for (auto const& in : single_packets(rng)) {
+    auto packets = count_packets(in.bytes);
+    for (auto decoder : g_decoders) {
+      bench_run("single/" + in.name + "/" + decoder_name(decoder),
+                packets, in.bytes.size(), [&] {
+        auto r = ix_packet_parse_with(decoder, in.bytes.data(),
+                                      in.bytes.size(), nil_f, NULL);
+        assert(r == in.bytes.size());
+        (void)r;
+      });
     }
-    tests.push_back({ NULL, 0, NULL });
-    auto results = h_benchmark(g_ix_packet, tests.data());
-    h_benchmark_report(stdout, results);
-    return 0;
+  }
+
+  // A headset at 220Hz that drops the odd sample.
+  auto profile = headset_profile::eeg_220hz();
+  profile.drop_rate = 0.001;
+  auto realistic = named_input{"realistic", generated(profile)};
+  auto buf = parse_input(k_stream_bytes);
+  auto gen = stream_generator(profile, 0);
+  bench_run("generate/realistic", count_packets(realistic.bytes), buf.size(),
+            [&] { gen.fill(buf.data(), buf.size()); });
+  whole_stream_cases(realistic);
+
+  profile = headset_profile::eeg_256hz();
+  profile.corrupt_rate = 0.01;
+  stream_cases({"corrupt_1pct", generated(profile)});
+  profile.corrupt_rate = 0.1;
+  stream_cases({"corrupt_10pct", generated(profile)});
 }
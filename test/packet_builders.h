@@ -1,3 +1,5 @@
+#pragma once
+
 #include <cmath>
 #include <cstdint>
 
@@ -11,7 +13,8 @@ using std::vector;
 
 using parse_input = vector<uint8_t>;
 
-parse_input operator+(parse_input const& lhs, parse_input const& rhs) {
+inline parse_input operator+(parse_input const& lhs,
+                             parse_input const& rhs) {
   parse_input ret = lhs;
   ret.insert(ret.end(), rhs.begin(), rhs.end());
   return ret;
@@ -119,6 +122,33 @@ inline parse_input eeg_packet(Args&&... args) {
   return ret + bitpacked_samples(forward<Args>(args)...);
 }
 
+// Any number of samples, bitpacked the same way.
+inline parse_input bitpacked_samples(vector<uint16_t> const& samples) {
+  parse_input ret((10 * samples.size() + 7) / 8);
+  for (auto i = 0u; i < samples.size(); ++i) {
+    for (auto b = 0u; b < 10; ++b) {
+      auto bit = 10 * i + b;
+      ret[bit / 8] |= (samples[i] >> b & 1) << bit % 8;
+    }
+  }
+  return ret;
+}
+
+// EEG packets for presets other than 4 channels.
+inline parse_input eeg_packet_n(uint16_t dropped,
+                                vector<uint16_t> const& samples) {
+  parse_input ret;
+  ret.push_back(0xe << 4 | 1 << 3);
+  append_big_endian_bytes(&ret, dropped);
+  return ret + bitpacked_samples(samples);
+}
+
+inline parse_input eeg_packet_n(vector<uint16_t> const& samples) {
+  parse_input ret;
+  ret.push_back(0xe << 4);
+  return ret + bitpacked_samples(samples);
+}
+
 inline parse_input drlref_packet(uint16_t drl, uint16_t ref) {
   parse_input ret;
   ret.push_back(0x9 << 4);
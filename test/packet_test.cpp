@@ -7,6 +7,8 @@ extern "C" {
 
 #include <exception>
 #include <gtest/gtest.h>
+#include <random>
+#include <thread>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -15,6 +17,7 @@ extern "C" {
 
 using std::exception;
 using std::make_pair;
+using std::mt19937;
 using std::pair;
 using std::remove_reference;
 using std::vector;
@@ -30,11 +33,15 @@ constexpr bool has_dropped_samples(ix_pac_type t) {
 }
 
 struct IxPacket {
-  IxPacket(): type(static_cast<ix_pac_type>(0)), dropped_samples(0) {}
+  IxPacket(): type(static_cast<ix_pac_type>(0)), dropped_samples(0),
+              error(0), drl(0), ref(0), battery_pct(0), fuel_mv(0),
+              adc_mv(0), temp_c(0) {}
   IxPacket(const ix_packet* p):
     type(ix_packet_type(p)),
     dropped_samples(has_dropped_samples(type)?
-                    ix_packet_dropped_samples(p) : 0)
+                    ix_packet_dropped_samples(p) : 0),
+    error(0), drl(0), ref(0), battery_pct(0), fuel_mv(0), adc_mv(0),
+    temp_c(0)
   {
     if (type == IX_PAC_ACCELEROMETER) {
       samples.reserve(3);
@@ -43,11 +50,9 @@ struct IxPacket {
       samples.push_back(ix_packet_acc_ch3(p));
     }
     else if (type == IX_PAC_EEG) {
-      samples.reserve(4);
-      samples.push_back(ix_packet_eeg_ch1(p));
-      samples.push_back(ix_packet_eeg_ch2(p));
-      samples.push_back(ix_packet_eeg_ch3(p));
-      samples.push_back(ix_packet_eeg_ch4(p));
+      for (auto i = 0u; i < ix_packet_channels(p); ++i) {
+        samples.push_back(ix_packet_eeg_ch(p, i));
+      }
     }
     else if (type == IX_PAC_ERROR) {
       error = ix_packet_error(p);
@@ -76,8 +81,27 @@ struct IxPacket {
   int16_t temp_c;
 };
 
+bool operator==(IxPacket const& a, IxPacket const& b) {
+  return a.type == b.type && a.dropped_samples == b.dropped_samples &&
+         a.samples == b.samples && a.error == b.error && a.drl == b.drl &&
+         a.ref == b.ref && a.battery_pct == b.battery_pct &&
+         a.fuel_mv == b.fuel_mv && a.adc_mv == b.adc_mv &&
+         a.temp_c == b.temp_c;
+}
+
 struct PacketParseError : ::exception {};
 
+pair<uint32_t, vector<IxPacket>> parse_with(ix_decoder decoder,
+                                            parse_input const& buf) {
+  auto pacs = vector<IxPacket>();
+  ix_packet_fn pac_f = [](const ix_packet* p, void* user_data) {
+    auto pacs = static_cast<vector<IxPacket>*>(user_data);
+    pacs->push_back(IxPacket(p));
+  };
+  auto r = ix_packet_parse_with(decoder, buf.data(), buf.size(), pac_f, &pacs);
+  return make_pair(r, pacs);
+}
+
 pair<uint32_t, vector<IxPacket>> test_parse(parse_input const& buf) {
   auto pacs = vector<IxPacket>();
   ix_packet_fn pac_f = [](const ix_packet* p, void* user_data) {
@@ -216,6 +240,194 @@ TEST_F(PacketTest, ParseMultiplePackets) {
   EXPECT_EQ(0xabad1dea, pacs[8].error);
 }
 
+TEST_F(PacketTest, ParseAll) {
+  buf = sync_packet() + acc_packet(0, 0, 0) + eeg_packet(511, 512, 53, 400)
+                      + acc_packet(737, 20, 3)
+                      + eeg_packet(1023, 1022, 1021, 1000)
+                      + sync_packet()
+                      + drlref_packet(50, 60)
+                      + battery_packet(1, 2, 3, -1)
+                      + error_packet(0xabad1dea);
+  auto pacs = vector<IxPacket>();
+  ix_packet_fn pac_f = [](const ix_packet* p, void* user_data) {
+    static_cast<vector<IxPacket>*>(user_data)->push_back(IxPacket(p));
+  };
+  uint32_t consumed = 0;
+  EXPECT_EQ(IX_PARSE_END,
+            ix_packet_parse_all(buf.data(), buf.size(), pac_f, &pacs,
+                                &consumed));
+  EXPECT_EQ(buf.size(), consumed);
+  ASSERT_EQ(9u, pacs.size());
+  EXPECT_EQ(IX_PAC_SYNC, pacs[0].type);
+  EXPECT_EQ(53u, pacs[2].samples[2]);
+  EXPECT_EQ(737u, pacs[3].samples[0]);
+  EXPECT_EQ(IX_PAC_DRLREF, pacs[6].type);
+  EXPECT_EQ(-1, pacs[7].temp_c);
+  EXPECT_EQ(0xabad1dea, pacs[8].error);
+
+  EXPECT_EQ(IX_PARSE_END,
+            ix_packet_parse_all(NULL, 0, pac_f, &pacs, &consumed));
+  EXPECT_EQ(0u, consumed);
+}
+
+TEST_F(PacketTest, ParseAllPartial) {
+  auto whole = sync_packet() + eeg_packet(1, 2, 3, 4);
+  auto tail = eeg_packet(1u, 5u, 6u, 7u, 8u);
+  for (auto n = 1u; n < tail.size(); ++n) {
+    buf = whole + parse_input(tail.begin(), tail.begin() + n);
+    auto count = 0u;
+    ix_packet_fn pac_f = [](const ix_packet*, void* user_data) {
+      ++*static_cast<unsigned*>(user_data);
+    };
+    uint32_t consumed = 0;
+    EXPECT_EQ(IX_PARSE_PARTIAL,
+              ix_packet_parse_all(buf.data(), buf.size(), pac_f, &count,
+                                  &consumed));
+    EXPECT_EQ(whole.size(), consumed);
+    EXPECT_EQ(2u, count);
+  }
+}
+
+TEST_F(PacketTest, ParseAllCorrupt) {
+  auto whole = sync_packet() + acc_packet(1, 2, 3);
+  buf = whole + parse_input(1, 0x12) + sync_packet();
+  ix_packet_fn nil_f = [](const ix_packet*, void*) {};
+  uint32_t consumed = 0;
+  EXPECT_EQ(IX_PARSE_CORRUPT,
+            ix_packet_parse_all(buf.data(), buf.size(), nil_f, NULL,
+                                &consumed));
+  EXPECT_EQ(whole.size(), consumed);
+
+  // A full-length packet with bad flags is corrupt, not partial.
+  buf = whole + parse_input(1, 0xe3) + parse_input(5, 0);
+  EXPECT_EQ(IX_PARSE_CORRUPT,
+            ix_packet_parse_all(buf.data(), buf.size(), nil_f, NULL,
+                                &consumed));
+  EXPECT_EQ(whole.size(), consumed);
+}
+
+TEST_F(PacketTest, ParseAllBatch) {
+  auto n = 3u * IX_PARSE_BATCH + 5u;
+  for (auto i = 0u; i < n; ++i) {
+    buf = buf + eeg_packet(i % 1024, 0u, 0u, 0u);
+  }
+  struct Batches {
+    vector<uint32_t> sizes;
+    vector<uint16_t> firsts;
+  } batches;
+  ix_packets_fn pacs_f = [](const ix_packet* ps, uint32_t n, void* user_data) {
+    auto b = static_cast<Batches*>(user_data);
+    b->sizes.push_back(n);
+    for (auto i = 0u; i < n; ++i) {
+      b->firsts.push_back(ix_packet_eeg_ch1(&ps[i]));
+    }
+  };
+  uint32_t consumed = 0;
+  EXPECT_EQ(IX_PARSE_END,
+            ix_packet_parse_all_batch(buf.data(), buf.size(), pacs_f,
+                                      &batches, &consumed));
+  EXPECT_EQ(buf.size(), consumed);
+  ASSERT_EQ(n, batches.firsts.size());
+  for (auto i = 0u; i < n; ++i) {
+    EXPECT_EQ(i % 1024, batches.firsts[i]);
+  }
+  ASSERT_EQ(4u, batches.sizes.size());
+  EXPECT_EQ(IX_PARSE_BATCH, batches.sizes[0]);
+  EXPECT_EQ(5u, batches.sizes[3]);
+}
+
+TEST_F(PacketTest, ParseInto) {
+  buf = sync_packet() + eeg_packet(1, 2, 3, 4) + acc_packet(9u, 5u, 6u, 7u)
+                      + error_packet(42);
+  ix_packet out[3];
+  uint32_t n = 0, consumed = 0;
+  EXPECT_EQ(IX_PARSE_FULL,
+            ix_packet_parse_into(buf.data(), buf.size(), out, 3, &n,
+                                 &consumed));
+  ASSERT_EQ(3u, n);
+  EXPECT_EQ(IX_PAC_SYNC, ix_packet_type(&out[0]));
+  EXPECT_EQ(3u, ix_packet_eeg_ch3(&out[1]));
+  EXPECT_EQ(9u, ix_packet_dropped_samples(&out[2]));
+  EXPECT_EQ(7u, ix_packet_acc_ch3(&out[2]));
+
+  EXPECT_EQ(IX_PARSE_END,
+            ix_packet_parse_into(buf.data() + consumed, buf.size() - consumed,
+                                 out, 1, &n, &consumed));
+  ASSERT_EQ(1u, n);
+  EXPECT_EQ(42u, ix_packet_error(&out[0]));
+
+  buf = eeg_packet(1, 2, 3, 4);
+  EXPECT_EQ(IX_PARSE_PARTIAL,
+            ix_packet_parse_into(buf.data(), buf.size() - 1, out, 3, &n,
+                                 &consumed));
+  EXPECT_EQ(0u, n);
+  EXPECT_EQ(0u, consumed);
+}
+
+TEST_F(PacketTest, Cursor) {
+  for (auto i = 0; i < 40; ++i) {
+    buf = buf + sync_packet() + eeg_packet(i, 1, 2, 3, 4) +
+          acc_packet(4, 5, 6) + battery_packet(i, 2, 3, 4) +
+          drlref_packet(i, 7) + error_packet(i);
+  }
+  auto want = vector<IxPacket>();
+  ix_packet_fn pac_f = [](const ix_packet* p, void* user_data) {
+    static_cast<vector<IxPacket>*>(user_data)->push_back(IxPacket(p));
+  };
+  uint32_t consumed;
+  ix_packet pac;
+  for (auto tail : {parse_input(), parse_input{0xe8, 0x00},
+                    parse_input{0x00, 0xff}}) {
+    auto in = buf + tail;
+    want.clear();
+    auto st = ix_packet_parse_all(in.data(), in.size(), pac_f, &want,
+                                  &consumed);
+    ix_packet_cursor c;
+    ix_packet_cursor_init(&c, in.data(), in.size());
+    auto got = vector<IxPacket>();
+    while (ix_packet_cursor_next(&c, &pac) == IX_PARSE_FULL) {
+      got.push_back(IxPacket(&pac));
+    }
+    EXPECT_TRUE(want == got);
+    EXPECT_EQ(st, ix_packet_cursor_next(&c, &pac));
+    EXPECT_EQ(consumed, ix_packet_cursor_offset(&c));
+  }
+
+  ix_packet_cursor c;
+  ix_packet_cursor_init(&c, NULL, 0);
+  EXPECT_EQ(IX_PARSE_END, ix_packet_cursor_next(&c, &pac));
+  EXPECT_EQ(0u, ix_packet_cursor_offset(&c));
+
+  buf = eeg_packet_n({1, 2, 3, 4, 5, 6});
+  ix_packet_cursor_init_fmt(&c, ix_packet_format_eeg(6), buf.data(),
+                            buf.size());
+  ASSERT_EQ(IX_PARSE_FULL, ix_packet_cursor_next(&c, &pac));
+  EXPECT_EQ(6u, ix_packet_eeg_ch6(&pac));
+}
+
+TEST_F(PacketTest, InlineAccessors) {
+  buf = sync_packet() + eeg_packet(9, 1, 2, 3, 4) + acc_packet(4, 5, 6) +
+        battery_packet(1, 2, 3, 4) + drlref_packet(6, 7) + error_packet(8);
+  ix_packet_cursor c;
+  ix_packet_cursor_init(&c, buf.data(), buf.size());
+  ix_packet p;
+  while (ix_packet_cursor_next(&c, &p) == IX_PARSE_FULL) {
+    auto t = (ix_packet_type)(&p);
+    EXPECT_EQ(t, _ix_packet_type(&p));
+    EXPECT_EQ((ix_packet_channels)(&p), _ix_packet_channels(&p));
+    for (auto i = 0u; i < (ix_packet_channels)(&p); ++i) {
+      EXPECT_EQ((ix_packet_ch)(&p, i), _ix_packet_ch(&p, i));
+    }
+    if (t == IX_PAC_ERROR) {
+      EXPECT_EQ((ix_packet_error)(&p), _ix_packet_error(&p));
+    }
+    if (has_dropped_samples(t)) {
+      EXPECT_EQ((ix_packet_dropped_samples)(&p),
+                _ix_packet_dropped_samples(&p));
+    }
+  }
+}
+
 TEST_F(PacketTest, DroppedSamples) {
   buf = acc_packet(3u, 1u, 2u, 3u);
   parse();
@@ -281,9 +493,182 @@ TEST_F(PacketTest, ParsesErrorPacket) {
   EXPECT_EQ(0u, p.error);
 }
 
+TEST_F(PacketTest, Formats) {
+  EXPECT_EQ(NULL, ix_packet_format_eeg(0));
+  EXPECT_EQ(NULL, ix_packet_format_eeg(3));
+  EXPECT_EQ(NULL, ix_packet_format_eeg(8));
+
+  auto rng = mt19937(0);
+  for (auto channels : {2u, 4u, 6u}) {
+    auto fmt = ix_packet_format_eeg(channels);
+    ASSERT_NE(nullptr, fmt);
+    auto samples = vector<uint16_t>();
+    for (auto c = 0u; c < channels; ++c) {
+      samples.push_back(rng() % 1024);
+    }
+    auto plain = eeg_packet_n(samples);
+    auto dropped = eeg_packet_n(77u, samples);
+    buf = sync_packet() + plain + acc_packet(1u, 2u, 3u) + dropped;
+    EXPECT_EQ(plain.size(), ix_packet_est_len_fmt(fmt, plain.data(), 1));
+    EXPECT_EQ(dropped.size(), ix_packet_est_len_fmt(fmt, dropped.data(), 1));
+
+    auto got = vector<IxPacket>();
+    ix_packet_fn pac_f = [](const ix_packet* p, void* user_data) {
+      static_cast<vector<IxPacket>*>(user_data)->push_back(IxPacket(p));
+    };
+    uint32_t consumed;
+    EXPECT_EQ(IX_PARSE_END,
+              ix_packet_parse_all_fmt(fmt, buf.data(), buf.size(), pac_f,
+                                      &got, &consumed)) << channels;
+    EXPECT_EQ(buf.size(), consumed);
+    ASSERT_EQ(4u, got.size());
+    EXPECT_EQ(IX_PAC_SYNC, got[0].type);
+    EXPECT_EQ(samples, got[1].samples);
+    EXPECT_EQ(IX_PAC_ACCELEROMETER, got[2].type);
+    EXPECT_EQ(samples, got[3].samples);
+    EXPECT_EQ(77u, got[3].dropped_samples);
+
+    ix_packet out[2];
+    uint32_t n;
+    EXPECT_EQ(IX_PARSE_END,
+              ix_packet_parse_into_fmt(fmt, plain.data(), plain.size(), out,
+                                       2, &n, &consumed));
+    ASSERT_EQ(1u, n);
+    EXPECT_EQ(channels, ix_packet_channels(&out[0]));
+  }
+}
+
 // TODO(soon): compressed eeg
 // TODO(soon): NEED MORE vs BAD STR
 
+////////////////////////////////////////////////////////////////////////////////
+//  Table decoder vs. hammer grammar
+////////////////////////////////////////////////////////////////////////////////
+
+const ix_decoder k_hammer_decoders[] = {
+  IX_DECODER_HAMMER, IX_DECODER_HAMMER_LLK, IX_DECODER_HAMMER_LALR,
+  IX_DECODER_HAMMER_GLR
+};
+
+// The grammar is built on first use, by whichever thread gets there first.
+TEST(PacketInitTest, Concurrent) {
+  auto buf = sync_packet();
+  auto got = vector<uint32_t>(8);
+  auto threads = vector<std::thread>();
+  for (auto i = 0u; i < got.size(); ++i) {
+    threads.emplace_back([&, i] {
+      if (i % 2) ix_packet_init();
+      auto decoder = static_cast<ix_decoder>(IX_DECODER_HAMMER + i % 4);
+      got[i] = ix_packet_parse_with(decoder, buf.data(), buf.size(),
+                                    [](const ix_packet*, void*) {}, NULL);
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  for (auto r : got) {
+    EXPECT_EQ(got[0], r);
+  }
+  ix_packet_init();
+}
+
+// Every backend either takes the grammar or falls back to packrat, and says
+// the same every time.
+TEST(PacketInitTest, Compile) {
+  EXPECT_EQ(IX_DECODER_TABLE, ix_packet_compile(IX_DECODER_TABLE));
+  EXPECT_EQ(IX_DECODER_HAMMER, ix_packet_compile(IX_DECODER_HAMMER));
+  for (auto d : k_hammer_decoders) {
+    auto r = ix_packet_compile(d);
+    EXPECT_TRUE(r == d || r == IX_DECODER_HAMMER) << d;
+    EXPECT_EQ(r, ix_packet_compile(d));
+  }
+}
+
+// Anything that isn't an ix_decoder parses with the table decoder.
+TEST(PacketInitTest, UnknownDecoder) {
+  for (auto v : {5u, 100u, 0xffffffffu}) {
+    auto d = static_cast<ix_decoder>(v);
+    EXPECT_EQ(IX_DECODER_TABLE, ix_packet_compile(d)) << v;
+    auto buf = eeg_packet(1, 2, 3, 4) + sync_packet();
+    auto got = parse_with(d, buf);
+    EXPECT_TRUE(parse_with(IX_DECODER_TABLE, buf) == got) << v;
+    ASSERT_EQ(1u, got.second.size()) << v;
+    EXPECT_EQ(IX_PAC_EEG, got.second[0].type);
+  }
+}
+
+class DecoderDiffTest : public ::testing::Test {
+protected:
+  DecoderDiffTest(): rng(0) {}
+
+  // Checks that the table decoder and every hammer backend agree on every
+  // prefix of buf.
+  void expect_agree(parse_input const& buf) {
+    for (auto n = 0u; n <= buf.size(); ++n) {
+      auto in = parse_input(buf.begin(), buf.begin() + n);
+      auto table = parse_with(IX_DECODER_TABLE, in);
+      for (auto d : k_hammer_decoders) {
+        auto hammer = parse_with(d, in);
+        EXPECT_EQ(hammer.first, table.first)
+            << "prefix length " << n << ", decoder " << d;
+        EXPECT_EQ(hammer.second.size(), table.second.size());
+        EXPECT_TRUE(hammer.second == table.second)
+            << "prefix length " << n << ", decoder " << d;
+      }
+    }
+  }
+
+  uint16_t sample() { return rng() % 1024; }
+
+  mt19937 rng;
+};
+
+TEST_F(DecoderDiffTest, ValidPackets) {
+  for (auto i = 0; i < 64; ++i) {
+    expect_agree(sync_packet());
+    expect_agree(error_packet(rng()));
+    expect_agree(battery_packet(rng(), rng(), rng(), rng()));
+    expect_agree(drlref_packet(sample(), sample()));
+    expect_agree(acc_packet(sample(), sample(), sample()));
+    expect_agree(acc_packet(rng(), sample(), sample(), sample()));
+    expect_agree(eeg_packet(sample(), sample(), sample(), sample()));
+    expect_agree(eeg_packet(rng(), sample(), sample(), sample(), sample()));
+  }
+}
+
+TEST_F(DecoderDiffTest, EveryFirstByte) {
+  for (auto b = 0u; b < 256; ++b) {
+    for (auto i = 0; i < 8; ++i) {
+      auto buf = parse_input(1, b);
+      for (auto j = 0; j < 10; ++j) {
+        buf.push_back(rng());
+      }
+      expect_agree(buf);
+    }
+  }
+}
+
+TEST_F(DecoderDiffTest, NearSync) {
+  for (auto i = 0u; i < 4; ++i) {
+    for (auto b = 0u; b < 256; ++b) {
+      auto buf = sync_packet();
+      buf[i] = b;
+      expect_agree(buf);
+    }
+  }
+}
+
+TEST_F(DecoderDiffTest, Garbage) {
+  for (auto i = 0; i < 2048; ++i) {
+    auto buf = parse_input();
+    auto n = rng() % IX_PAC_MAXSIZE;
+    for (auto j = 0u; j < n; ++j) {
+      buf.push_back(rng());
+    }
+    expect_agree(buf);
+  }
+}
+
 TEST_F(EstLenTest, EmptyString) {
   EXPECT_EQ(4u, ix_packet_est_len(buf.data(), 0));
 }
@@ -0,0 +1,130 @@
+#include <cstdint>
+
+extern "C" {
+#include <muse_core/defs.h>
+#include <muse_core/packet.h>
+#include <muse_core/unpack.h>
+#include <muse_core/resync.h>
+}
+
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+#include "packet_builders.h"
+
+using std::mt19937;
+using std::vector;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test fixtures
+////////////////////////////////////////////////////////////////////////////////
+
+class ResyncTest : public ::testing::Test {
+protected:
+  ResyncTest(): rng(0) {}
+
+  // Bytes that never contain a sync packet or the start of one.
+  parse_input no_sync(size_t n) {
+    auto ret = parse_input(n);
+    for (auto& b : ret) {
+      b = rng() % 0xff;
+    }
+    return ret;
+  }
+
+  // Bytes that can never start a packet.
+  parse_input no_headers(size_t n) {
+    auto ret = parse_input(n);
+    for (auto& b : ret) {
+      b = rng() % 0x90;
+    }
+    return ret;
+  }
+
+  parse_input eeg_run(size_t n) {
+    auto ret = parse_input();
+    for (auto i = 0u; i < n; ++i) {
+      ret = ret + eeg_packet(rng() % 1024, rng() % 1024, rng() % 1024,
+                             rng() % 1024);
+    }
+    return ret;
+  }
+
+  // Checks that every SIMD level skips want bytes of buf.
+  void expect_skip(uint32_t want, ix_resync_mode mode,
+                   parse_input const& buf) {
+    for (auto s : {IX_SIMD_SCALAR, IX_SIMD_SSE4, IX_SIMD_AVX2}) {
+      EXPECT_EQ(want, ix_resync_with(s, mode, buf.data(), buf.size()))
+          << s << " " << buf.size();
+    }
+  }
+
+  mt19937 rng;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test suite proper
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_F(ResyncTest, Empty) {
+  EXPECT_EQ(0u, ix_resync(IX_RESYNC_SYNC, NULL, 0));
+  EXPECT_EQ(0u, ix_resync(IX_RESYNC_HEADERS, NULL, 0));
+}
+
+TEST_F(ResyncTest, SyncAnywhere) {
+  for (auto pos = 0u; pos < 100; ++pos) {
+    expect_skip(pos, IX_RESYNC_SYNC,
+                no_sync(pos) + sync_packet() + no_sync(rng() % 40));
+  }
+}
+
+TEST_F(ResyncTest, FirstSyncWins) {
+  auto buf = no_sync(50) + sync_packet() + no_sync(3) + sync_packet();
+  expect_skip(50, IX_RESYNC_SYNC, buf);
+  // After a longer run of 0xff.
+  buf = parse_input{0xff, 0xff, 0xff} + sync_packet();
+  expect_skip(3, IX_RESYNC_SYNC, buf);
+}
+
+TEST_F(ResyncTest, NoSync) {
+  for (auto n = 0u; n < 100; ++n) {
+    expect_skip(n, IX_RESYNC_SYNC, no_sync(n));
+  }
+}
+
+TEST_F(ResyncTest, SyncPartialTail) {
+  auto sync = sync_packet();
+  for (auto n = 40u; n < 80; ++n) {
+    for (auto k = 1u; k < sync.size(); ++k) {
+      auto buf = no_sync(n) + parse_input(sync.begin(), sync.begin() + k);
+      expect_skip(n, IX_RESYNC_SYNC, buf);
+    }
+  }
+}
+
+TEST_F(ResyncTest, HeadersAnywhere) {
+  for (auto pos = 0u; pos < 100; ++pos) {
+    expect_skip(pos, IX_RESYNC_HEADERS, no_headers(pos) + eeg_run(5));
+  }
+}
+
+TEST_F(ResyncTest, HeadersSkipDecoys) {
+  // A lone packet-like stretch isn't a run.
+  auto decoy = parse_input{0xe0, 1, 2, 3, 4, 5};
+  auto garbage = no_headers(20) + decoy + no_headers(20);
+  expect_skip(garbage.size(), IX_RESYNC_HEADERS, garbage + eeg_run(4));
+  expect_skip(garbage.size(), IX_RESYNC_HEADERS, garbage);
+}
+
+TEST_F(ResyncTest, HeadersPartialTail) {
+  auto run = eeg_run(2);
+  for (auto n = 0u; n < 70; ++n) {
+    auto buf = no_headers(n) + parse_input(run.begin(), run.end() - 1);
+    expect_skip(n, IX_RESYNC_HEADERS, buf);
+  }
+}
+
+}  // namespace
@@ -0,0 +1,186 @@
+#include <cstdint>
+
+extern "C" {
+#include <muse_core/defs.h>
+#include <muse_core/packet.h>
+#include <muse_core/unpack.h>
+#include <muse_core/resync.h>
+#include <muse_core/stats.h>
+#include <muse_core/stream.h>
+#include <muse_core/ring.h>
+}
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "packet_builders.h"
+
+using std::mt19937;
+using std::vector;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test fixtures
+////////////////////////////////////////////////////////////////////////////////
+
+const uint32_t k_size = 256;
+
+class RingTest : public ::testing::Test {
+protected:
+  RingTest(): rng(0), buf(IX_RING_BUFSIZE(k_size)) {
+    ix_ring_init(&r, buf.data(), k_size);
+  }
+
+  static void pac_f(const ix_packet* p, void* user_data) {
+    static_cast<vector<uint16_t>*>(user_data)->push_back(
+        ix_packet_type(p) == IX_PAC_EEG ? ix_packet_ch(p, 0) : 0xffff);
+  }
+
+  parse_input stream(size_t n) {
+    auto ret = parse_input();
+    for (auto i = 0u; i < n; ++i) {
+      switch (rng() % 4) {
+      case 0: ret = ret + acc_packet(rng() % 1024, 2u, 3u); break;
+      case 1: ret = ret + battery_packet(1, 2, 3, 4); break;
+      default:
+        ret = ret + eeg_packet(rng() % 1024, 2u, 3u, 4u);
+      }
+    }
+    return ret;
+  }
+
+  static vector<uint16_t> parse_all(const uint8_t* buf, uint32_t len) {
+    auto ret = vector<uint16_t>();
+    ix_packet_parse_all(buf, len, pac_f, &ret, NULL);
+    return ret;
+  }
+
+  // Moves the ring's positions to pos with nothing readable.
+  void advance(uint32_t pos) {
+    auto junk = parse_input(pos);
+    EXPECT_EQ(pos, ix_ring_write(&r, junk.data(), pos));
+    uint32_t n;
+    ix_ring_read_span(&r, &n);
+    EXPECT_EQ(pos, n);
+    ix_ring_consume(&r, n);
+  }
+
+  mt19937 rng;
+  parse_input buf;
+  ix_ring r;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test suite proper
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_F(RingTest, Empty) {
+  uint32_t n;
+  ix_ring_read_span(&r, &n);
+  EXPECT_EQ(0u, n);
+  EXPECT_EQ(buf.data(), ix_ring_write_span(&r, &n));
+  EXPECT_EQ(k_size, n);
+}
+
+TEST_F(RingTest, PaddedSides) {
+  EXPECT_EQ(3u * IX_RING_CACHELINE, sizeof(ix_ring));
+}
+
+TEST_F(RingTest, FullWritesComeUpShort) {
+  auto data = parse_input(k_size + 10, 7);
+  EXPECT_EQ(k_size, ix_ring_write(&r, data.data(), data.size()));
+  EXPECT_EQ(0u, ix_ring_write(&r, data.data(), data.size()));
+  uint32_t n;
+  ix_ring_write_span(&r, &n);
+  EXPECT_EQ(0u, n);
+  ix_ring_read_span(&r, &n);
+  EXPECT_EQ(k_size, n);
+  ix_ring_consume(&r, 10);
+  EXPECT_EQ(10u, ix_ring_write(&r, data.data(), data.size()));
+}
+
+TEST_F(RingTest, WriteSpanAndCommit) {
+  advance(k_size - 3);
+  uint32_t n;
+  auto p = ix_ring_write_span(&r, &n);
+  EXPECT_EQ(3u, n);
+  p[0] = 1;
+  p[1] = 2;
+  ix_ring_commit(&r, 2);
+  p = ix_ring_write_span(&r, &n);
+  EXPECT_EQ(1u, n);
+  p[0] = 3;
+  ix_ring_commit(&r, 1);
+  p = ix_ring_write_span(&r, &n);
+  EXPECT_EQ(buf.data(), p);
+  p[0] = 4;
+  ix_ring_commit(&r, 1);
+  auto q = ix_ring_read_span(&r, &n);
+  ASSERT_EQ(4u, n);
+  EXPECT_EQ((parse_input{1, 2, 3, 4}), parse_input(q, q + n));
+}
+
+TEST_F(RingTest, WrappedPacketsParseInPlace) {
+  auto data = stream(8);
+  ASSERT_GE(k_size, data.size());
+  auto pos = 0u;
+  for (auto start : {k_size - 1, k_size - 5, k_size - 40, k_size / 2}) {
+    advance((start - pos) % k_size);
+    pos = (start + data.size()) % k_size;
+    EXPECT_EQ(data.size(), ix_ring_write(&r, data.data(), data.size()));
+    uint32_t n;
+    auto p = ix_ring_read_span(&r, &n);
+    // Contiguous up to IX_RING_SLACK bytes past the end of the ring.
+    ASSERT_EQ(std::min<uint32_t>(data.size(), k_size - start + IX_RING_SLACK),
+              n) << start;
+    EXPECT_EQ(parse_input(data.begin(), data.begin() + n),
+              parse_input(p, p + n)) << start;
+    auto want = parse_all(data.data(), n);
+    EXPECT_EQ(want, parse_all(p, n)) << start;
+    ix_ring_consume(&r, n);
+    ix_ring_read_span(&r, &n);
+    ix_ring_consume(&r, n);
+    ix_ring_read_span(&r, &n);
+    EXPECT_EQ(0u, n);
+  }
+}
+
+TEST_F(RingTest, ReaderAndParserThreads) {
+  auto data = stream(1000);
+  auto got = vector<uint16_t>();
+  auto producer = std::thread([&] {
+    auto gen = mt19937(1);
+    auto off = size_t{0};
+    while (off < data.size()) {
+      if (gen() % 2) {
+        uint32_t n;
+        auto p = ix_ring_write_span(&r, &n);
+        n = std::min<uint32_t>(n, data.size() - off);
+        n = std::min<uint32_t>(n, 1 + gen() % 100);
+        std::copy(data.begin() + off, data.begin() + off + n, p);
+        ix_ring_commit(&r, n);
+        off += n;
+      } else {
+        auto n = std::min<size_t>(1 + gen() % 100, data.size() - off);
+        off += ix_ring_write(&r, data.data() + off, n);
+      }
+    }
+  });
+  ix_stream s;
+  ix_stream_init(&s, pac_f, NULL, &got);
+  auto fed = size_t{0};
+  while (fed < data.size()) {
+    auto n = ix_ring_drain(&r, &s);
+    if (!n) std::this_thread::yield();
+    fed += n;
+  }
+  producer.join();
+  EXPECT_EQ(data.size(), fed);
+  EXPECT_EQ(parse_all(data.data(), data.size()), got);
+}
+
+}  // namespace
@@ -0,0 +1,242 @@
+#include <cstdint>
+
+extern "C" {
+#include <muse_core/defs.h>
+#include <muse_core/packet.h>
+#include <muse_core/unpack.h>
+#include <muse_core/resync.h>
+#include <muse_core/stats.h>
+#include <muse_core/stream.h>
+#include <muse_core/capture.h>
+#include <muse_core/session.h>
+}
+
+#include <cerrno>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "packet_builders.h"
+#include "stream_generator.h"
+
+using std::mt19937;
+using std::string;
+using std::vector;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test fixtures
+////////////////////////////////////////////////////////////////////////////////
+
+using columns = vector<vector<uint32_t>>;
+
+class SessionTest : public ::testing::Test {
+protected:
+  SessionTest(): rng(0), want(IX_N_COLS) {
+    char tmpl[] = "/tmp/ix_session_test.XXXXXX";
+    auto fd = mkstemp(tmpl);
+    EXPECT_LE(0, fd);
+    close(fd);
+    path = tmpl;
+    s.file.data = NULL;
+    s.file.len = 0;
+  }
+
+  ~SessionTest() {
+    ix_session_close(&s);
+    unlink(path.c_str());
+  }
+
+  // Writes buf, as parsed by a stream, to a session, and works out the
+  // columns it should hold by hand.
+  void write(parse_input const& buf, uint8_t channels) {
+    auto w = ix_session_writer_new(path.c_str(), channels);
+    ASSERT_TRUE(w != NULL);
+    writer = w;
+    ix_stream st;
+    ix_stream_init(&st, pac_f, NULL, this);
+    ix_stream_set_format(&st, ix_packet_format_eeg(channels));
+    ix_stream_feed(&st, buf.data(), buf.size());
+    EXPECT_EQ(0, ix_session_writer_free(w));
+  }
+
+  static void pac_f(const ix_packet* p, void* user_data) {
+    auto t = static_cast<SessionTest*>(user_data);
+    auto& want = t->want;
+    ix_session_write(t->writer, p);
+    switch (ix_packet_type(p)) {
+    case IX_PAC_EEG:
+      if (ix_packet_dropped_samples(p)) {
+        want[IX_COL_EEG_GAP_AT].push_back(want[IX_COL_EEG1].size());
+        want[IX_COL_EEG_GAP_LEN].push_back(ix_packet_dropped_samples(p));
+      }
+      for (auto c = 0u; c < ix_packet_channels(p); ++c) {
+        want[IX_COL_EEG1 + c].push_back(ix_packet_eeg_ch(p, c));
+      }
+      break;
+    case IX_PAC_ACCELEROMETER:
+      if (ix_packet_dropped_samples(p)) {
+        want[IX_COL_ACC_GAP_AT].push_back(want[IX_COL_ACC1].size());
+        want[IX_COL_ACC_GAP_LEN].push_back(ix_packet_dropped_samples(p));
+      }
+      for (auto c = 0u; c < 3; ++c) {
+        want[IX_COL_ACC1 + c].push_back(ix_packet_acc_ch(p, c));
+      }
+      break;
+    case IX_PAC_DRLREF:
+      want[IX_COL_DRL].push_back(ix_packet_drl(p));
+      want[IX_COL_REF].push_back(ix_packet_ref(p));
+      break;
+    case IX_PAC_BATTERY:
+      for (auto c = 0u; c < 4; ++c) {
+        want[IX_COL_BATTERY_PERCENT + c].push_back(ix_packet_battery_ch(p, c));
+      }
+      break;
+    case IX_PAC_SYNC:
+      want[IX_COL_SYNC_AT].push_back(want[IX_COL_EEG1].size());
+      break;
+    default:
+      break;
+    }
+  }
+
+  vector<uint32_t> read(ix_session_col col, uint64_t first, uint32_t n) {
+    ix_session_column c;
+    ix_session_get_column(&s, col, &c);
+    auto ret = vector<uint32_t>(n);
+    ret.resize(ix_session_column_read(&c, first, n, ret.data()));
+    return ret;
+  }
+
+  off_t file_size() {
+    auto f = fopen(path.c_str(), "rb");
+    fseek(f, 0, SEEK_END);
+    auto ret = ftello(f);
+    fclose(f);
+    return ret;
+  }
+
+  mt19937 rng;
+  string path;
+  ix_session_writer* writer;
+  columns want;
+  ix_session s;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test suite proper
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_F(SessionTest, Empty) {
+  write(parse_input(), 4);
+  ASSERT_EQ(0, ix_session_open(&s, path.c_str()));
+  EXPECT_EQ(4u, ix_session_eeg_channels(&s));
+  for (auto col = 0u; col < IX_N_COLS; ++col) {
+    ix_session_column c;
+    ix_session_get_column(&s, static_cast<ix_session_col>(col), &c);
+    EXPECT_EQ(0u, ix_session_column_len(&c));
+    EXPECT_TRUE(read(static_cast<ix_session_col>(col), 0, 10).empty());
+  }
+}
+
+TEST_F(SessionTest, RoundTrip) {
+  auto p = headset_profile::eeg_256hz();
+  p.eeg_channels = 6;
+  p.drop_rate = 0.01;
+  p.battery_hz = 10;
+  auto buf = parse_input(500000);
+  stream_generator(p, 0).fill(buf.data(), buf.size());
+  write(buf, 6);
+  ASSERT_EQ(0, ix_session_open(&s, path.c_str()));
+  EXPECT_EQ(6u, ix_session_eeg_channels(&s));
+  for (auto col = 0u; col < IX_N_COLS; ++col) {
+    auto c = static_cast<ix_session_col>(col);
+    EXPECT_FALSE(want[col].empty()) << col;
+    EXPECT_EQ(want[col], read(c, 0, want[col].size() + 10)) << col;
+  }
+  // Random stretches, across block boundaries and off the end.
+  auto& eeg = want[IX_COL_EEG3];
+  for (auto i = 0; i < 1000; ++i) {
+    auto first = rng() % (eeg.size() + 10);
+    auto n = rng() % (3 * IX_SESSION_BLOCK);
+    auto end = std::min<size_t>(eeg.size(), first + n);
+    auto expect = first < end ?
+        vector<uint32_t>(eeg.begin() + first, eeg.begin() + end) :
+        vector<uint32_t>();
+    EXPECT_EQ(expect, read(IX_COL_EEG3, first, n)) << first << " " << n;
+  }
+  // A slow random walk packs down to well under the raw 10-bit packets.
+  EXPECT_LT(file_size(), static_cast<off_t>(buf.size() * 2 / 3));
+}
+
+TEST_F(SessionTest, ExtremeValues) {
+  // Full-range jumps need the widest deltas.
+  auto buf = parse_input();
+  for (auto i = 0u; i < 3000; ++i) {
+    auto v = i % 2 ? 0 : 1023;
+    buf = buf + eeg_packet(v, 1023 - v, rng() % 1024, 0) +
+          battery_packet(i % 3 ? 0 : 0xffff, 0xffff, 0, -1);
+  }
+  write(buf, 4);
+  ASSERT_EQ(0, ix_session_open(&s, path.c_str()));
+  for (auto col = 0u; col < IX_N_COLS; ++col) {
+    EXPECT_EQ(want[col], read(static_cast<ix_session_col>(col), 0,
+                              want[col].size())) << col;
+  }
+}
+
+TEST_F(SessionTest, Malformed) {
+  EXPECT_EQ(ENOENT, ix_session_open(&s, "/nonexistent/session"));
+  EXPECT_TRUE(ix_session_writer_new(path.c_str(), 5) == NULL);
+  EXPECT_EQ(EINVAL, errno);
+
+  auto buf = parse_input(50000);
+  stream_generator(headset_profile::eeg_220hz(), 0).fill(buf.data(),
+                                                        buf.size());
+  write(buf, 4);
+  auto f = fopen(path.c_str(), "rb");
+  auto good = parse_input(file_size());
+  EXPECT_EQ(good.size(), fread(good.data(), 1, good.size(), f));
+  fclose(f);
+
+  auto rewrite = [&](parse_input const& bytes) {
+    auto f = fopen(path.c_str(), "wb");
+    fwrite(bytes.data(), 1, bytes.size(), f);
+    fclose(f);
+    return ix_session_open(&s, path.c_str());
+  };
+  EXPECT_EQ(0, rewrite(good));
+  ix_session_close(&s);
+  // Truncated anywhere.
+  for (auto n : {0u, 10u, 40u, 1000u}) {
+    EXPECT_EQ(EINVAL, rewrite(parse_input(good.begin(), good.end() - n - 1)));
+  }
+  // A flipped bit anywhere in the index, column table or footer is either
+  // caught, or harmless, e.g. in a first value: reads stay in the file.
+  uint64_t index_off = 0;
+  for (auto i = 0u; i < 8; ++i) {
+    index_off |= static_cast<uint64_t>(good[good.size() - 24 + i]) << 8 * i;
+  }
+  auto caught = 0u;
+  for (auto i = index_off; i < good.size(); ++i) {
+    auto bad = good;
+    bad[i] ^= 0x80;
+    auto err = rewrite(bad);
+    if (err) {
+      EXPECT_EQ(EINVAL, err) << i;
+      ++caught;
+      continue;
+    }
+    for (auto col = 0u; col < IX_N_COLS; ++col) {
+      read(static_cast<ix_session_col>(col), 0, 100000);
+    }
+    ix_session_close(&s);
+  }
+  EXPECT_LT((good.size() - index_off) / 2, caught);
+}
+
+}  // namespace
@@ -0,0 +1,195 @@
+#include <cstdint>
+
+extern "C" {
+#include <muse_core/defs.h>
+#include <muse_core/packet.h>
+#include <muse_core/unpack.h>
+#include <muse_core/resync.h>
+#include <muse_core/stats.h>
+#include <muse_core/stream.h>
+#include <muse_core/split.h>
+}
+
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+#include "packet_builders.h"
+#include "stream_generator.h"
+
+using std::mt19937;
+using std::vector;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test fixtures
+////////////////////////////////////////////////////////////////////////////////
+
+// A packet, or a corrupt stretch if skipped is nonzero. Consecutive pieces of
+// one stretch are merged, since the stream may split them up differently.
+struct Event {
+  ix_pac_type type;
+  uint16_t first;
+  uint64_t offset;
+  uint64_t skipped;
+
+  bool operator==(Event const& o) const {
+    return type == o.type && first == o.first && offset == o.offset &&
+           skipped == o.skipped;
+  }
+};
+
+void PrintTo(Event const& e, std::ostream* os) {
+  *os << "{" << e.type << ", " << e.first << ", " << e.offset << ", "
+      << e.skipped << "}";
+}
+
+struct Recorder {
+  Recorder(const ix_packet_format* fmt, ix_resync_mode mode) {
+    ix_stream_init(&s, pac_f, corrupt_f, this);
+    ix_stream_set_format(&s, fmt);
+    ix_stream_set_resync(&s, mode);
+  }
+
+  static void pac_f(const ix_packet* p, void* user_data) {
+    auto t = ix_packet_type(p);
+    auto first = t == IX_PAC_SYNC ? 0 :
+                 t == IX_PAC_ERROR ? ix_packet_error(p) & 0xffff :
+                 ix_packet_ch(p, 0);
+    static_cast<Recorder*>(user_data)->got.push_back(
+        Event{t, static_cast<uint16_t>(first), 0, 0});
+  }
+
+  static void corrupt_f(uint64_t offset, uint32_t skipped, void* user_data) {
+    auto& got = static_cast<Recorder*>(user_data)->got;
+    if (!got.empty() && got.back().skipped &&
+        got.back().offset + got.back().skipped == offset) {
+      got.back().skipped += skipped;
+    } else {
+      got.push_back(Event{IX_PAC_SYNC, 0, offset, skipped});
+    }
+  }
+
+  ix_stream s;
+  vector<Event> got;
+};
+
+class SplitTest : public ::testing::Test {
+protected:
+  SplitTest(): rng(0) {}
+
+  // Checks that ix_split_feed of buf gives what ix_stream_feed64 does, and
+  // leaves the stream in the same state. Returns the chunks parsed again.
+  uint64_t check(parse_input const& buf, uint32_t n_workers,
+                 uint32_t chunk_size,
+                 ix_resync_mode mode = IX_RESYNC_HEADERS,
+                 const ix_packet_format* fmt = ix_packet_format_eeg(4),
+                 parse_input const& before = parse_input()) {
+    Recorder want(fmt, mode), got(fmt, mode);
+    // before may leave the streams resyncing, but not holding anything.
+    ix_stream_feed(&want.s, before.data(), before.size());
+    ix_stream_feed(&got.s, before.data(), before.size());
+    EXPECT_EQ(0u, ix_stream_pending(&got.s));
+
+    ix_stream_feed64(&want.s, buf.data(), buf.size());
+    auto ret = ix_split_feed(&got.s, buf.data(), buf.size(), n_workers,
+                             chunk_size);
+    EXPECT_EQ(want.got, got.got);
+    EXPECT_EQ(ix_stream_offset(&want.s), ix_stream_offset(&got.s));
+    EXPECT_EQ(ix_stream_pending(&want.s), ix_stream_pending(&got.s));
+
+    // Same state: the same again for whatever comes next.
+    auto more = generated(headset_profile::eeg_220hz(), 2000, 1);
+    ix_stream_feed(&want.s, more.data(), more.size());
+    ix_stream_feed(&got.s, more.data(), more.size());
+    EXPECT_EQ(want.got, got.got);
+    return ret;
+  }
+
+  static parse_input generated(headset_profile const& p, size_t n,
+                               uint32_t seed) {
+    auto ret = parse_input(n);
+    stream_generator(p, seed).fill(ret.data(), ret.size());
+    return ret;
+  }
+
+  // Sync packets, and battery packets with a sync word in the middle.
+  parse_input decoys(size_t n) {
+    auto ret = parse_input();
+    for (auto i = 0u; i < n; ++i) {
+      switch (rng() % 4) {
+      case 0: ret = ret + sync_packet(); break;
+      case 1: ret = ret + battery_packet(0x00ff, 0xffaa, 0x5500, 0); break;
+      default:
+        ret = ret + eeg_packet(rng() % 1024, rng() % 1024, rng() % 1024,
+                               rng() % 1024);
+      }
+    }
+    return ret;
+  }
+
+  mt19937 rng;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test suite proper
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_F(SplitTest, Empty) {
+  Recorder r(ix_packet_format_eeg(4), IX_RESYNC_HEADERS);
+  EXPECT_EQ(0u, ix_split_feed(&r.s, NULL, 0, 4, 0));
+  EXPECT_EQ(0u, ix_stream_offset(&r.s));
+  EXPECT_TRUE(r.got.empty());
+}
+
+TEST_F(SplitTest, MatchesStream) {
+  auto clean = generated(headset_profile::eeg_220hz(), 100000, 0);
+  for (auto chunk : {0u, 100u, 1000u, 4096u}) {
+    for (auto n : {1u, 2u, 4u}) {
+      EXPECT_EQ(0u, check(clean, n, chunk)) << chunk << " " << n;
+    }
+  }
+  auto p = headset_profile::eeg_256hz();
+  p.eeg_channels = 6;
+  check(generated(p, 100000, 0), 3, 1000, IX_RESYNC_HEADERS,
+        ix_packet_format_eeg(6));
+}
+
+TEST_F(SplitTest, Corruption) {
+  auto p = headset_profile::eeg_256hz();
+  p.drop_rate = 0.01;
+  for (auto rate : {0.01, 0.1, 0.5}) {
+    p.corrupt_rate = rate;
+    auto buf = generated(p, 100000, 0);
+    for (auto mode : {IX_RESYNC_SYNC, IX_RESYNC_HEADERS}) {
+      check(buf, 4, 1000, mode);
+      check(buf, 2, 333, mode);
+    }
+  }
+  // Nothing but garbage: one stretch that runs off the end.
+  auto garbage = parse_input(10000, 0x30);
+  check(garbage, 4, 1000, IX_RESYNC_SYNC);
+  check(garbage, 4, 1000, IX_RESYNC_HEADERS);
+}
+
+TEST_F(SplitTest, SyncWordsInsidePackets) {
+  auto buf = decoys(20000);
+  EXPECT_LT(0u, check(buf, 4, 97));
+  check(buf, 4, 97, IX_RESYNC_SYNC);
+  check(buf, 2, 1000);
+}
+
+TEST_F(SplitTest, Ends) {
+  auto buf = generated(headset_profile::eeg_220hz(), 50000, 0);
+  // Cut off mid-packet, so the rest is carried over.
+  for (auto cut = 1u; cut < 40; ++cut) {
+    check(parse_input(buf.begin(), buf.end() - cut), 4, 1000);
+  }
+  // Starting out resyncing.
+  auto garbage = parse_input(100, 0x30);
+  check(buf, 4, 1000, IX_RESYNC_SYNC, ix_packet_format_eeg(4), garbage);
+  check(buf, 4, 1000, IX_RESYNC_HEADERS, ix_packet_format_eeg(4), garbage);
+}
+
+}  // namespace
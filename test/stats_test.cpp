@@ -0,0 +1,222 @@
+#include <cstdint>
+
+extern "C" {
+#include <muse_core/defs.h>
+#include <muse_core/packet.h>
+#include <muse_core/unpack.h>
+#include <muse_core/resync.h>
+#include <muse_core/stats.h>
+#include <muse_core/stream.h>
+#if !defined _WIN32
+#include <muse_core/engine.h>
+#include <muse_core/split.h>
+#endif
+}
+
+#include <atomic>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "packet_builders.h"
+#include "stream_generator.h"
+
+using std::mt19937;
+using std::vector;
+
+// ix_stats is a C struct in the global namespace, so these have to be too
+// for gtest to find them.
+bool operator==(ix_stats const& a, ix_stats const& b) {
+  return !memcmp(&a, &b, sizeof a);
+}
+
+void PrintTo(ix_stats const& s, std::ostream* os) {
+  *os << "{bytes " << s.bytes << ", packets";
+  for (auto n : s.packets) *os << " " << n;
+  *os << ", corrupt " << s.corrupt << ", bad_len " << s.bad_len
+      << ", skipped " << s.skipped << ", dropped " << s.eeg_dropped << "/"
+      << s.acc_dropped << "}";
+}
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test fixtures
+////////////////////////////////////////////////////////////////////////////////
+
+// Tallies what a stream delivers, to check its counters against.
+struct Recorder {
+  Recorder() {
+    memset(&got, 0, sizeof got);
+    ix_stream_init(&s, pac_f, corrupt_f, this);
+  }
+
+  static void pac_f(const ix_packet* p, void* user_data) {
+    auto& got = static_cast<Recorder*>(user_data)->got;
+    auto t = ix_packet_type(p);
+    got.packets[t]++;
+    if (t == IX_PAC_EEG) got.eeg_dropped += ix_packet_dropped_samples(p);
+    if (t == IX_PAC_ACCELEROMETER) {
+      got.acc_dropped += ix_packet_dropped_samples(p);
+    }
+  }
+
+  static void corrupt_f(uint64_t, uint32_t skipped, void* user_data) {
+    static_cast<Recorder*>(user_data)->got.skipped += skipped;
+  }
+
+  ix_stats stats() {
+    ix_stats ret;
+    ix_stream_stats(&s, &ret);
+    return ret;
+  }
+
+  ix_stream s;
+  ix_stats got;
+};
+
+class StatsTest : public ::testing::Test {
+protected:
+  StatsTest(): rng(0) {}
+
+  // Feeds buf in random pieces.
+  void feed(ix_stream* s, parse_input const& buf) {
+    for (size_t off = 0; off < buf.size();) {
+      auto n = std::min<size_t>(rng() % 300, buf.size() - off);
+      ix_stream_feed(s, buf.data() + off, n);
+      off += n;
+    }
+  }
+
+  static parse_input generated(headset_profile const& p, size_t n) {
+    auto ret = parse_input(n);
+    stream_generator(p, 0).fill(ret.data(), ret.size());
+    return ret;
+  }
+
+  mt19937 rng;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test suite proper
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_F(StatsTest, Counts) {
+  auto bad_sync = parse_input{0xff, 0xff, 0x00, 0x00};
+  auto bad_len = parse_input{0xc0, 0xff};
+  auto buf = sync_packet() + eeg_packet(1, 2, 3, 4) +
+             eeg_packet(5, 1, 2, 3, 4) + acc_packet(2, 1, 2, 3) +
+             acc_packet(1, 2, 3) + bad_sync + sync_packet() +
+             battery_packet(1, 2, 3, 4) + drlref_packet(1, 2) + bad_len +
+             sync_packet() + error_packet(7) + eeg_packet(1, 2, 3, 4);
+  Recorder r;
+  ix_stream_set_resync(&r.s, IX_RESYNC_SYNC);
+  ix_stream_feed(&r.s, buf.data(), buf.size());
+  auto st = r.stats();
+  EXPECT_EQ(buf.size(), st.bytes);
+  EXPECT_EQ(0u, st.packets[0]);
+  EXPECT_EQ(3u, st.packets[IX_PAC_SYNC]);
+  EXPECT_EQ(1u, st.packets[IX_PAC_ERROR]);
+  EXPECT_EQ(3u, st.packets[IX_PAC_EEG]);
+  EXPECT_EQ(1u, st.packets[IX_PAC_BATTERY]);
+  EXPECT_EQ(2u, st.packets[IX_PAC_ACCELEROMETER]);
+  EXPECT_EQ(1u, st.packets[IX_PAC_DRLREF]);
+  EXPECT_EQ(2u, st.corrupt);
+  EXPECT_EQ(1u, st.bad_len);
+  EXPECT_EQ(bad_sync.size() + bad_len.size(), st.skipped);
+  EXPECT_EQ(5u, st.eeg_dropped);
+  EXPECT_EQ(2u, st.acc_dropped);
+
+  ix_stream_init(&r.s, Recorder::pac_f, NULL, &r);
+  memset(&st, 0, sizeof st);
+  EXPECT_EQ(st, r.stats());
+}
+
+TEST_F(StatsTest, MatchesDelivered) {
+  auto p = headset_profile::eeg_256hz();
+  p.drop_rate = 0.02;
+  p.corrupt_rate = 0.05;
+  p.battery_hz = 10;
+  auto buf = generated(p, 200000);
+  Recorder whole, pieces;
+  ix_stream_feed(&whole.s, buf.data(), buf.size());
+  feed(&pieces.s, buf);
+  for (auto r : {&whole, &pieces}) {
+    auto st = r->stats();
+    EXPECT_EQ(buf.size(), st.bytes);
+    EXPECT_LT(0u, st.corrupt);
+    EXPECT_LE(st.bad_len, st.corrupt);
+    EXPECT_LT(0u, st.eeg_dropped);
+    // Everything but the failure counts is exactly what was delivered.
+    auto want = r->got;
+    want.bytes = st.bytes;
+    want.corrupt = st.corrupt;
+    want.bad_len = st.bad_len;
+    EXPECT_EQ(want, st);
+  }
+}
+
+#if !defined _WIN32
+TEST_F(StatsTest, Split) {
+  auto p = headset_profile::eeg_220hz();
+  p.drop_rate = 0.01;
+  p.corrupt_rate = 0.02;
+  auto buf = generated(p, 300000);
+  Recorder want, got;
+  ix_stream_feed64(&want.s, buf.data(), buf.size());
+  ix_split_feed(&got.s, buf.data(), buf.size(), 3, 10000);
+  EXPECT_EQ(want.stats(), got.stats());
+}
+
+TEST_F(StatsTest, Engine) {
+  auto buf = generated(headset_profile::eeg_220hz(), 100000);
+  auto e = ix_engine_new(2, 4, 4096);
+  ASSERT_TRUE(e != NULL);
+  vector<ix_engine_stream*> streams;
+  for (auto i = 0; i < 4; ++i) {
+    streams.push_back(ix_engine_add_stream(e, ix_packet_format_eeg(4),
+                                           [](const ix_packet*, void*) {},
+                                           NULL, NULL));
+  }
+  // Snapshots race the workers, and only ever go up.
+  std::atomic<bool> done(false);
+  std::thread watcher([&] {
+    uint64_t last = 0;
+    while (!done) {
+      ix_stats st;
+      ix_engine_stats(e, &st);
+      EXPECT_LE(last, st.packets[IX_PAC_EEG]);
+      last = st.packets[IX_PAC_EEG];
+    }
+  });
+  for (size_t off = 0; off < buf.size();) {
+    auto n = std::min<size_t>(1000, buf.size() - off);
+    for (auto s : streams) {
+      for (uint32_t k = 0; k < n;) {
+        k += ix_engine_feed(s, buf.data() + off + k, n - k);
+      }
+    }
+    off += n;
+  }
+  ix_engine_drain(e);
+  done = true;
+  watcher.join();
+
+  Recorder r;
+  ix_stream_feed(&r.s, buf.data(), buf.size());
+  ix_stats total, one, want;
+  memset(&want, 0, sizeof want);
+  for (auto s : streams) {
+    ix_engine_stream_stats(s, &one);
+    EXPECT_EQ(r.stats(), one);
+    ix_stats_add(&want, &one);
+  }
+  ix_engine_stats(e, &total);
+  EXPECT_EQ(want, total);
+  ix_engine_free(e);
+}
+#endif
+
+}  // namespace
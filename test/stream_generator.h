@@ -0,0 +1,259 @@
+// Copyright 2015 Steven Dee.
+
+// Synthetic headset streams.
+//
+// A stream_generator writes the byte stream a headset would send, at its
+// packet mix and rates, straight into a caller-owned buffer: EEG as a random
+// walk per channel, accelerometer, DRL/REF, and periodic sync and battery
+// packets, with optional dropped samples and corruption. Packets have the
+// same layouts as the builders in packet_builders.h, but nothing here
+// allocates, and generating costs a few times less per packet than the
+// builders. Parsing is still faster than generating, so benchmarks that want
+// the parser to be the only cost fill a large buffer once and replay it.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include "packet_builders.h"
+
+// xorshift64: plenty random for test data, and much cheaper than mt19937.
+class xorshift {
+public:
+  explicit xorshift(uint64_t seed): s(seed * 0x9e3779b97f4a7c15ull + 1) {}
+
+  uint32_t operator()() {
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return static_cast<uint32_t>(s >> 32);
+  }
+
+private:
+  uint64_t s;
+};
+
+struct headset_profile {
+  headset_profile()
+      : eeg_hz(220), eeg_channels(4), eeg_step(8), acc_hz(50), drlref_hz(10),
+        sync_hz(1), battery_hz(0.1), drop_rate(0), corrupt_rate(0) {}
+
+  static headset_profile eeg_220hz() { return headset_profile(); }
+
+  static headset_profile eeg_256hz() {
+    auto ret = headset_profile();
+    ret.eeg_hz = 256;
+    return ret;
+  }
+
+  double eeg_hz;
+  unsigned eeg_channels;      // 2, 4 or 6.
+  unsigned eeg_step;          // Largest step of the walk.
+  double acc_hz;
+  double drlref_hz;
+  double sync_hz;
+  double battery_hz;
+  double drop_rate;           // Chance that any one sample is lost.
+  double corrupt_rate;        // Chance that a packet gets a random byte.
+};
+
+class stream_generator {
+public:
+  enum kind { EEG, ACC, DRLREF, SYNC, BATTERY, N_KINDS };
+
+  stream_generator(headset_profile const& p, uint32_t seed)
+      : p(p), rng(seed), now(0), out(NULL), pending_len(0), pending_off(0),
+        n_packets(0), n_corrupted(0), n_bytes(0) {
+    assert(p.eeg_channels == 2 || p.eeg_channels == 4 ||
+           p.eeg_channels == 6);
+    double hz[N_KINDS] = {p.eeg_hz, p.acc_hz, p.drlref_hz, p.sync_hz,
+                          p.battery_hz};
+    for (auto k = 0u; k < N_KINDS; ++k) {
+      period[k] = hz[k] > 0 ? 1 / hz[k] : 0;
+      next[k] = 0;
+      dropped[k] = 0;
+      samples[k] = 0;
+    }
+    for (auto c = 0u; c < 6; ++c) {
+      eeg[c] = rng() % 1024;
+    }
+  }
+
+  // Fills all len bytes of buf and returns len. Packets are written straight
+  // into buf; one that doesn't fit is finished at the start of the next call.
+  size_t fill(uint8_t* buf, size_t len) {
+    auto off = std::min(len, pending_len - pending_off);
+    memcpy(buf, pending + pending_off, off);
+    pending_off += off;
+    while (len - off >= sizeof pending) {
+      off += next_packet(buf + off);
+    }
+    while (off < len) {
+      pending_len = next_packet(pending);
+      pending_off = std::min(len - off, pending_len);
+      memcpy(buf + off, pending, pending_off);
+      off += pending_off;
+    }
+    n_bytes += len;
+    return len;
+  }
+
+  // Simulated seconds of headset time generated so far.
+  double time() const { return now; }
+  // Packets on the wire so far, counting any written only in part.
+  uint64_t packets() const { return n_packets; }
+  uint64_t corrupted() const { return n_corrupted; }
+  uint64_t bytes() const { return n_bytes; }
+  // Samples of one kind generated so far, including dropped ones.
+  uint64_t sample_count(kind k) const { return samples[k]; }
+
+private:
+  // Writes the next packet to buf, which has room for any packet, and
+  // returns its length.
+  size_t next_packet(uint8_t* buf) {
+    for (;;) {
+      auto k = N_KINDS;
+      for (auto i = 0u; i < N_KINDS; ++i) {
+        if (period[i] && (k == N_KINDS || next[i] < next[k])) {
+          k = static_cast<kind>(i);
+        }
+      }
+      assert(k != N_KINDS);
+      now = next[k];
+      next[k] += period[k];
+      out = buf;
+      if (make(k)) {
+        break;
+      }
+    }
+    auto n = static_cast<size_t>(out - buf);
+    ++n_packets;
+    if (p.corrupt_rate > 0 && chance(p.corrupt_rate)) {
+      buf[rng() % n] = rng();
+      ++n_corrupted;
+    }
+    return n;
+  }
+
+  bool chance(double rate) {
+    return rng() < rate * 4294967296.0;
+  }
+
+  // Steps every channel of the walk, using 8 random bits per channel.
+  void walk() {
+    auto span = 2 * p.eeg_step + 1;
+    auto r = rng();
+    for (auto c = 0u; c < p.eeg_channels; ++c, r >>= 8) {
+      if (c % 4 == 0 && c) r = rng();
+      auto v = static_cast<int>(eeg[c]) +
+               static_cast<int>((r & 0xff) * span >> 8) -
+               static_cast<int>(p.eeg_step);
+      eeg[c] = v < 0 ? 0 : v > 1023 ? 1023 : v;
+    }
+  }
+
+  // Writes a packet of kind k into pending, or returns false if there is
+  // nothing to send this time round.
+  bool make(kind k) {
+    uint16_t s[6];
+    uint32_t r;
+    switch (k) {
+    case EEG:
+      ++samples[EEG];
+      walk();
+      if (p.drop_rate > 0 && chance(p.drop_rate)) {
+        ++dropped[EEG];
+        return false;
+      }
+      header(0xe, EEG);
+      bitpack(eeg, p.eeg_channels);
+      return true;
+    case ACC:
+      ++samples[ACC];
+      if (p.drop_rate > 0 && chance(p.drop_rate)) {
+        ++dropped[ACC];
+        return false;
+      }
+      r = rng();
+      for (auto c = 0u; c < 3; ++c, r >>= 6) {
+        s[c] = 480 + (r & 0x3f);
+      }
+      header(0xa, ACC);
+      bitpack(s, 3);
+      return true;
+    case DRLREF:
+      r = rng();
+      s[0] = 400 + (r & 0xff);
+      s[1] = 400 + (r >> 8 & 0xff);
+      put(0x90);
+      bitpack(s, 2);
+      return true;
+    case SYNC:
+      put(0xff);
+      put(0xff);
+      put(0xaa);
+      put(0x55);
+      return true;
+    case BATTERY:
+      put(0xb0);
+      put16(static_cast<uint16_t>(100 - std::min(now / 360, 100.0)));
+      put16(3700);
+      put16(3650);
+      put16(25);
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  void put(uint8_t b) {
+    *out++ = b;
+  }
+
+  void put16(uint16_t v) {
+    put(v >> 8);
+    put(v);
+  }
+
+  // Type nibble, plus the dropped sample count if there is one.
+  void header(uint8_t type, kind k) {
+    if (dropped[k]) {
+      put(type << 4 | 1 << 3);
+      put16(static_cast<uint16_t>(dropped[k]));
+      dropped[k] = 0;
+    } else {
+      put(type << 4);
+    }
+  }
+
+  void bitpack(const uint16_t* s, unsigned n) {
+    auto acc = uint32_t{0};
+    auto bits = 0u;
+    for (auto i = 0u; i < n; ++i) {
+      acc |= static_cast<uint32_t>(s[i] & 0x3ff) << bits;
+      for (bits += 10; bits >= 8; bits -= 8, acc >>= 8) {
+        put(acc);
+      }
+    }
+    if (bits) put(acc);
+  }
+
+  headset_profile p;
+  xorshift rng;
+  double now;
+  double period[N_KINDS];
+  double next[N_KINDS];
+  uint64_t dropped[N_KINDS];
+  uint64_t samples[N_KINDS];
+  uint16_t eeg[6];
+  uint8_t* out;
+  uint8_t pending[32];  // IX_PAC_MAXSIZE
+  size_t pending_len;
+  size_t pending_off;
+  uint64_t n_packets;
+  uint64_t n_corrupted;
+  uint64_t n_bytes;
+};
@@ -0,0 +1,316 @@
+#include <cstdint>
+
+extern "C" {
+#include <muse_core/defs.h>
+#include <muse_core/packet.h>
+#include <muse_core/unpack.h>
+#include <muse_core/resync.h>
+#include <muse_core/stats.h>
+#include <muse_core/stream.h>
+}
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "packet_builders.h"
+#include "stream_generator.h"
+
+using std::make_pair;
+using std::mt19937;
+using std::pair;
+using std::vector;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test fixtures
+////////////////////////////////////////////////////////////////////////////////
+
+// Just enough of a packet to tell packets apart.
+struct Seen {
+  ix_pac_type type;
+  uint16_t first;
+
+  bool operator==(Seen const& o) const {
+    return type == o.type && first == o.first;
+  }
+};
+
+Seen seen(const ix_packet* p) {
+  auto t = ix_packet_type(p);
+  auto first = t == IX_PAC_SYNC ? 0 :
+               t == IX_PAC_ERROR ? ix_packet_error(p) & 0xffff :
+               ix_packet_ch(p, 0);
+  return Seen{t, static_cast<uint16_t>(first)};
+}
+
+class StreamTest : public ::testing::Test {
+protected:
+  StreamTest(): rng(0) {
+    ix_stream_init(&s, pac_f, corrupt_f, this);
+  }
+
+  static void pac_f(const ix_packet* p, void* user_data) {
+    static_cast<StreamTest*>(user_data)->got.push_back(seen(p));
+  }
+
+  static void corrupt_f(uint64_t offset, uint32_t skipped, void* user_data) {
+    static_cast<StreamTest*>(user_data)->corrupt.push_back(
+        make_pair(offset, skipped));
+  }
+
+  uint16_t sample() { return rng() % 1024; }
+
+  parse_input stream(size_t n) {
+    auto ret = parse_input();
+    for (auto i = 0u; i < n; ++i) {
+      switch (rng() % 8) {
+      case 0: ret = ret + sync_packet(); break;
+      case 1: ret = ret + battery_packet(sample(), 2, 3, 4); break;
+      case 2: ret = ret + error_packet(rng()); break;
+      case 3: ret = ret + eeg_packet(rng(), sample(), sample(), sample(),
+                                     sample()); break;
+      case 4: ret = ret + acc_packet(sample(), sample(), sample()); break;
+      case 5: ret = ret + drlref_packet(sample(), sample()); break;
+      default:
+        ret = ret + eeg_packet(sample(), sample(), sample(), sample());
+      }
+    }
+    return ret;
+  }
+
+  // Feeds buf in random chunks of up to max_chunk bytes.
+  void feed(parse_input const& buf, size_t max_chunk) {
+    auto base = ix_stream_offset(&s);
+    auto off = 0u;
+    while (off < buf.size()) {
+      auto n = std::min<size_t>(rng() % (max_chunk + 1), buf.size() - off);
+      ix_stream_feed(&s, buf.data() + off, n);
+      off += n;
+      EXPECT_LT(ix_stream_pending(&s), static_cast<uint32_t>(IX_PAC_MAXSIZE));
+      EXPECT_EQ(base + off, ix_stream_offset(&s));
+    }
+  }
+
+  static vector<Seen> parse_all(parse_input const& buf) {
+    auto ret = vector<Seen>();
+    ix_packet_fn pac_f = [](const ix_packet* p, void* user_data) {
+      static_cast<vector<Seen>*>(user_data)->push_back(seen(p));
+    };
+    ix_packet_parse_all(buf.data(), buf.size(), pac_f, &ret, NULL);
+    return ret;
+  }
+
+  mt19937 rng;
+  ix_stream s;
+  vector<Seen> got;
+  vector<pair<uint64_t, uint32_t>> corrupt;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test suite proper
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_F(StreamTest, Empty) {
+  ix_stream_feed(&s, NULL, 0);
+  EXPECT_EQ(0u, ix_stream_pending(&s));
+  EXPECT_EQ(0u, ix_stream_offset(&s));
+  EXPECT_TRUE(got.empty());
+}
+
+TEST_F(StreamTest, WholeBuffer) {
+  auto buf = stream(100);
+  ix_stream_feed(&s, buf.data(), buf.size());
+  EXPECT_EQ(parse_all(buf), got);
+  EXPECT_EQ(0u, ix_stream_pending(&s));
+  EXPECT_TRUE(corrupt.empty());
+}
+
+TEST_F(StreamTest, ByteAtATime) {
+  auto buf = stream(100);
+  for (auto b : buf) {
+    ix_stream_feed(&s, &b, 1);
+  }
+  EXPECT_EQ(parse_all(buf), got);
+  EXPECT_TRUE(corrupt.empty());
+}
+
+TEST_F(StreamTest, RandomChunks) {
+  for (auto max_chunk : {2u, 5u, 7u, 13u, 40u, 1000u}) {
+    got.clear();
+    auto buf = stream(500);
+    feed(buf, max_chunk);
+    EXPECT_EQ(parse_all(buf), got) << max_chunk;
+    EXPECT_EQ(0u, ix_stream_pending(&s));
+    EXPECT_TRUE(corrupt.empty());
+  }
+}
+
+TEST_F(StreamTest, PartialTailIsHeld) {
+  auto buf = eeg_packet(1u, 2u, 3u, 4u, 5u);
+  ix_stream_feed(&s, buf.data(), buf.size() - 1);
+  EXPECT_TRUE(got.empty());
+  EXPECT_EQ(buf.size() - 1, ix_stream_pending(&s));
+  ix_stream_feed(&s, buf.data() + buf.size() - 1, 1);
+  ASSERT_EQ(1u, got.size());
+  EXPECT_EQ(IX_PAC_EEG, got[0].type);
+  EXPECT_EQ(2u, got[0].first);
+  EXPECT_EQ(0u, ix_stream_pending(&s));
+}
+
+TEST_F(StreamTest, Corruption) {
+  auto garbage = parse_input{0x01, 0x02, 0x03};
+  auto before = stream(10);
+  auto after = stream(10);
+  auto buf = before + garbage + after;
+  feed(buf, 7);
+  auto want = parse_all(before);
+  auto want_after = parse_all(after);
+  want.insert(want.end(), want_after.begin(), want_after.end());
+  EXPECT_EQ(want, got);
+  auto skipped = 0u;
+  for (auto c : corrupt) {
+    EXPECT_EQ(before.size() + skipped, c.first);
+    skipped += c.second;
+  }
+  EXPECT_EQ(garbage.size(), skipped);
+}
+
+TEST_F(StreamTest, SixChannels) {
+  auto fmt = ix_packet_format_eeg(6);
+  ix_stream_set_format(&s, fmt);
+  auto buf = parse_input();
+  for (auto i = 0u; i < 100; ++i) {
+    switch (rng() % 4) {
+    case 0: buf = buf + drlref_packet(sample(), sample()); break;
+    case 1: buf = buf + acc_packet(sample(), sample(), sample()); break;
+    default:
+      buf = buf + eeg_packet_n({sample(), sample(), sample(), sample(),
+                                sample(), sample()});
+    }
+  }
+  auto want = vector<Seen>();
+  ix_packet_fn pac_f = [](const ix_packet* p, void* user_data) {
+    EXPECT_TRUE(ix_packet_type(p) != IX_PAC_EEG ||
+                ix_packet_channels(p) == 6);
+    static_cast<vector<Seen>*>(user_data)->push_back(seen(p));
+  };
+  ix_packet_parse_all_fmt(fmt, buf.data(), buf.size(), pac_f, &want, NULL);
+  feed(buf, 13);
+  EXPECT_EQ(want, got);
+  EXPECT_TRUE(corrupt.empty());
+}
+
+TEST_F(StreamTest, ResyncAtSync) {
+  // Everything up to the next sync packet is lost, valid or not.
+  ix_stream_set_resync(&s, IX_RESYNC_SYNC);
+  auto garbage = parse_input{0x01, 0x02, 0x03};
+  auto before = stream(10);
+  auto lost = eeg_packet(1u, 2u, 3u, 4u) + acc_packet(5u, 6u, 7u);
+  auto after = sync_packet() + stream(10);
+  auto buf = before + garbage + lost + after;
+  feed(buf, 7);
+  auto want = parse_all(before);
+  auto want_after = parse_all(after);
+  want.insert(want.end(), want_after.begin(), want_after.end());
+  EXPECT_EQ(want, got);
+  auto skipped = 0u;
+  for (auto c : corrupt) {
+    EXPECT_EQ(before.size() + skipped, c.first);
+    skipped += c.second;
+  }
+  EXPECT_EQ(garbage.size() + lost.size(), skipped);
+}
+
+TEST_F(StreamTest, CorruptionInCarry) {
+  // A battery packet with bad flags looks partial at the end of one chunk,
+  // then turns out to be corrupt, with a complete packet hidden behind it.
+  auto buf = parse_input{0xb1} + sync_packet() + error_packet(7);
+  ix_stream_feed(&s, buf.data(), 7);
+  EXPECT_TRUE(got.empty());
+  EXPECT_EQ(7u, ix_stream_pending(&s));
+  ix_stream_feed(&s, buf.data() + 7, buf.size() - 7);
+  ASSERT_EQ(2u, got.size());
+  EXPECT_EQ(IX_PAC_SYNC, got[0].type);
+  EXPECT_EQ(IX_PAC_ERROR, got[1].type);
+  ASSERT_EQ(1u, corrupt.size());
+  EXPECT_EQ(0u, corrupt[0].first);
+  EXPECT_EQ(1u, corrupt[0].second);
+  EXPECT_EQ(0u, ix_stream_pending(&s));
+}
+
+TEST_F(StreamTest, GeneratedHeadsets) {
+  // Every sample the generator makes up arrives, or is reported dropped.
+  struct Tally {
+    uint64_t eeg, acc, dropped_eeg, dropped_acc, other;
+  };
+  ix_packet_fn tally_f = [](const ix_packet* p, void* user_data) {
+    auto t = static_cast<Tally*>(user_data);
+    switch (ix_packet_type(p)) {
+    case IX_PAC_EEG:
+      ++t->eeg;
+      t->dropped_eeg += ix_packet_dropped_samples(p);
+      break;
+    case IX_PAC_ACCELEROMETER:
+      ++t->acc;
+      t->dropped_acc += ix_packet_dropped_samples(p);
+      break;
+    default: ++t->other;
+    }
+  };
+  auto profiles = vector<headset_profile>(4, headset_profile::eeg_220hz());
+  profiles[1] = headset_profile::eeg_256hz();
+  profiles[1].drop_rate = 0.01;
+  profiles[2].eeg_channels = 2;
+  profiles[2].drop_rate = 0.01;
+  profiles[3].eeg_channels = 6;
+  for (auto const& p : profiles) {
+    Tally t = {};
+    ix_stream_init(&s, tally_f, corrupt_f, &t);
+    ix_stream_set_format(&s, ix_packet_format_eeg(p.eeg_channels));
+    auto gen = stream_generator(p, 0);
+    uint8_t buf[300];
+    while (gen.time() < 10) {
+      auto n = gen.fill(buf, sizeof buf);
+      ix_stream_feed(&s, buf, n);
+    }
+    EXPECT_TRUE(corrupt.empty());
+    // Anything not yet delivered is still in the generator or the stream.
+    auto eeg = gen.sample_count(stream_generator::EEG);
+    EXPECT_LE(t.eeg + t.dropped_eeg, eeg);
+    EXPECT_GE(t.eeg + t.dropped_eeg + 32, eeg);
+    auto acc = gen.sample_count(stream_generator::ACC);
+    EXPECT_LE(t.acc + t.dropped_acc, acc);
+    EXPECT_GE(t.acc + t.dropped_acc + 8, acc);
+    EXPECT_NEAR(p.eeg_hz * 10, eeg, p.eeg_hz);
+    EXPECT_NEAR(p.acc_hz * 10, acc, p.acc_hz);
+    EXPECT_EQ(p.drop_rate > 0, t.dropped_eeg > 0);
+  }
+}
+
+TEST_F(StreamTest, GeneratedCorruption) {
+  auto p = headset_profile::eeg_220hz();
+  p.corrupt_rate = 0.02;
+  auto gen = stream_generator(p, 0);
+  auto buf = parse_input(20000);
+  gen.fill(buf.data(), buf.size());
+  EXPECT_LT(0u, gen.corrupted());
+  feed(buf, 100);
+  EXPECT_FALSE(corrupt.empty());
+  EXPECT_LT(0.9 * (gen.packets() - gen.corrupted()), got.size());
+}
+
+TEST_F(StreamTest, Reset) {
+  auto buf = eeg_packet(1u, 2u, 3u, 4u);
+  ix_stream_feed(&s, buf.data(), 3);
+  ix_stream_reset(&s);
+  EXPECT_EQ(0u, ix_stream_pending(&s));
+  EXPECT_EQ(3u, ix_stream_offset(&s));
+  ix_stream_feed(&s, buf.data(), buf.size());
+  ASSERT_EQ(1u, got.size());
+}
+
+}  // namespace
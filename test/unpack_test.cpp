@@ -0,0 +1,205 @@
+#include <cstdint>
+
+extern "C" {
+#include <muse_core/defs.h>
+#include <muse_core/packet.h>
+#include <muse_core/unpack.h>
+}
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+#include "packet_builders.h"
+
+using std::mt19937;
+using std::vector;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+//  Helpers
+////////////////////////////////////////////////////////////////////////////////
+
+// Per-channel sample arrays, as filled in by the unpackers.
+struct Channels {
+  explicit Channels(size_t n_ch, size_t n): data(n_ch, vector<uint16_t>(n)) {
+    for (auto& ch : data) {
+      ptrs.push_back(ch.data());
+    }
+  }
+
+  vector<vector<uint16_t>> data;
+  vector<uint16_t*> ptrs;
+};
+
+// Channels as decoded by ix_packet_parse, one packet at a time, for as long as
+// the packets are of the given type.
+Channels parse_run(parse_input const& buf, ix_pac_type type, size_t n_ch) {
+  auto ret = Channels(n_ch, 0);
+  auto off = 0u;
+  while (off < buf.size()) {
+    struct Out {
+      ix_pac_type type;
+      Channels* ret;
+      bool stop;
+    } out = {type, &ret, false};
+    ix_packet_fn pac_f = [](const ix_packet* p, void* user_data) {
+      auto out = static_cast<Out*>(user_data);
+      if (ix_packet_type(p) != out->type || ix_packet_dropped_samples(p)) {
+        out->stop = true;
+        return;
+      }
+      for (auto c = 0u; c < out->ret->data.size(); ++c) {
+        out->ret->data[c].push_back(ix_packet_ch(p, c));
+      }
+    };
+    auto r = ix_packet_parse(buf.data() + off, buf.size() - off, pac_f, &out);
+    if (!r || out.stop) break;
+    off += r;
+  }
+  return ret;
+}
+
+class UnpackTest : public ::testing::Test {
+protected:
+  UnpackTest(): rng(0) {}
+
+  uint16_t sample() { return rng() % 1024; }
+
+  parse_input eeg_run(size_t n) {
+    auto ret = parse_input();
+    for (auto i = 0u; i < n; ++i) {
+      ret = ret + eeg_packet(sample(), sample(), sample(), sample());
+    }
+    return ret;
+  }
+
+  parse_input acc_run(size_t n) {
+    auto ret = parse_input();
+    for (auto i = 0u; i < n; ++i) {
+      ret = ret + acc_packet(sample(), sample(), sample());
+    }
+    return ret;
+  }
+
+  // Checks every SIMD level against parse_run for buf, limited to max.
+  void expect_eeg4(parse_input const& buf, uint32_t max = UINT32_MAX) {
+    auto want = parse_run(buf, IX_PAC_EEG, 4);
+    auto n = std::min<size_t>(want.data[0].size(), max);
+    for (auto s : {IX_SIMD_SCALAR, IX_SIMD_SSE4, IX_SIMD_AVX2}) {
+      auto got = Channels(4, n + 8);
+      EXPECT_EQ(n, ix_unpack_eeg4_with(s, buf.data(), buf.size(),
+                                       got.ptrs.data(), max)) << s;
+      for (auto c = 0u; c < 4; ++c) {
+        for (auto i = 0u; i < n; ++i) {
+          EXPECT_EQ(want.data[c][i], got.data[c][i]) << s << " " << c << " "
+                                                     << i;
+        }
+        // Nothing written past the run.
+        for (auto i = n; i < n + 8; ++i) {
+          EXPECT_EQ(0u, got.data[c][i]);
+        }
+      }
+    }
+  }
+
+  void expect_acc(parse_input const& buf, uint32_t max = UINT32_MAX) {
+    auto want = parse_run(buf, IX_PAC_ACCELEROMETER, 3);
+    auto n = std::min<size_t>(want.data[0].size(), max);
+    for (auto s : {IX_SIMD_SCALAR, IX_SIMD_SSE4, IX_SIMD_AVX2}) {
+      auto got = Channels(3, n + 8);
+      EXPECT_EQ(n, ix_unpack_acc_with(s, buf.data(), buf.size(),
+                                      got.ptrs.data(), max)) << s;
+      for (auto c = 0u; c < 3; ++c) {
+        for (auto i = 0u; i < n; ++i) {
+          EXPECT_EQ(want.data[c][i], got.data[c][i]) << s << " " << c << " "
+                                                     << i;
+        }
+        for (auto i = n; i < n + 8; ++i) {
+          EXPECT_EQ(0u, got.data[c][i]);
+        }
+      }
+    }
+  }
+
+  mt19937 rng;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Test suite proper
+////////////////////////////////////////////////////////////////////////////////
+
+TEST_F(UnpackTest, Detect) {
+  auto s = ix_simd_detect();
+  EXPECT_GE(s, IX_SIMD_SCALAR);
+  EXPECT_LE(s, IX_SIMD_AVX2);
+}
+
+TEST_F(UnpackTest, EmptyAndShort) {
+  expect_eeg4(parse_input());
+  expect_acc(parse_input());
+  auto buf = eeg_run(1);
+  expect_eeg4(parse_input(buf.begin(), buf.end() - 1));
+  buf = acc_run(1);
+  expect_acc(parse_input(buf.begin(), buf.end() - 1));
+}
+
+TEST_F(UnpackTest, Eeg4Runs) {
+  for (auto n = 0u; n < 40; ++n) {
+    expect_eeg4(eeg_run(n));
+    // Every length of trailing partial packet.
+    for (auto k = 1u; k < 6; ++k) {
+      auto buf = eeg_run(n) + eeg_run(1);
+      buf.resize(buf.size() - k);
+      expect_eeg4(buf);
+    }
+  }
+}
+
+TEST_F(UnpackTest, AccRuns) {
+  for (auto n = 0u; n < 40; ++n) {
+    expect_acc(acc_run(n));
+    for (auto k = 1u; k < 5; ++k) {
+      auto buf = acc_run(n) + acc_run(1);
+      buf.resize(buf.size() - k);
+      expect_acc(buf);
+    }
+  }
+}
+
+TEST_F(UnpackTest, StopsAtOtherPackets) {
+  for (auto n = 0u; n < 20; ++n) {
+    expect_eeg4(eeg_run(n) + eeg_packet(5u, 1u, 2u, 3u, 4u) + eeg_run(20));
+    expect_eeg4(eeg_run(n) + sync_packet() + eeg_run(20));
+    expect_eeg4(eeg_run(n) + acc_run(20));
+    expect_acc(acc_run(n) + acc_packet(5u, 1u, 2u, 3u) + acc_run(20));
+    expect_acc(acc_run(n) + drlref_packet(1, 2) + acc_run(20));
+    expect_acc(acc_run(n) + eeg_run(20));
+  }
+}
+
+TEST_F(UnpackTest, Max) {
+  for (auto max = 0u; max < 30; ++max) {
+    expect_eeg4(eeg_run(30), max);
+    expect_acc(acc_run(30), max);
+  }
+}
+
+TEST_F(UnpackTest, ExtremeValues) {
+  auto buf = parse_input();
+  for (auto i = 0u; i < 33; ++i) {
+    buf = buf + (i % 2 ? eeg_packet(1023u, 0u, 1023u, 0u)
+                       : eeg_packet(0u, 1023u, 0u, 1023u));
+  }
+  expect_eeg4(buf);
+  buf.clear();
+  for (auto i = 0u; i < 33; ++i) {
+    buf = buf + (i % 2 ? acc_packet(1023u, 0u, 1023u)
+                       : acc_packet(0u, 1023u, 0u));
+  }
+  expect_acc(buf);
+}
+
+}  // namespace